@@ -211,7 +211,19 @@ void ODriveArduino::SetCoupledPosition(float theta, float gamma) {
     SendByte(checkSum);
 }
 
+/**
+ * Sends a coupled position command with PD gains in the form
+ * "<1><14>S<sp_theta><kp_theta><kd_theta><sp_gamma><kp_gamma><kd_gamma><checksum>",
+ * or stores it in the capture set by CaptureCoupledPosition.
+ */
 void ODriveArduino::SetCoupledPosition(float sp_theta, float sp_gamma, struct LegGain gains) {
+    if (capture_ != NULL) {
+        capture_->sp_theta = sp_theta;
+        capture_->sp_gamma = sp_gamma;
+        capture_->gains = gains;
+        capture_->count++;
+        return;
+    }
 
     const int POS_MULTIPLIER = 1000;
     const int GAIN_MULTIPLIER = 100;
@@ -246,6 +258,15 @@ void ODriveArduino::SetCoupledPosition(float sp_theta, float sp_gamma, struct Le
     SendByte(checkSum);
 }
 
+/**
+ * Keep the setpoint and gains of coupled position commands in capture
+ * instead of sending them, so a controller on the Teensy can track them with
+ * current commands. NULL goes back to sending 'S' frames.
+ */
+void ODriveArduino::CaptureCoupledPosition(struct CoupledPositionCommand* capture) {
+    capture_ = capture;
+}
+
 void ODriveArduino::SetCoupledPosition(struct LegGain gains) {
     // TODO: correct but where S command doesn't get enough parameters
 }
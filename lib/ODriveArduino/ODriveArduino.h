@@ -4,6 +4,8 @@
 
 #include "Arduino.h"
 
+struct CoupledPositionCommand;
+
 class ODriveArduino {
 public:
     enum AxisState_t {
@@ -25,6 +27,7 @@ public:
     void SetCoupledPosition(float theta, float gamma);
     void SetCoupledPosition(float sp_theta, float sp_gamma, struct LegGain gains);
     void SetCoupledPosition(struct LegGain gains);
+    void CaptureCoupledPosition(struct CoupledPositionCommand* capture);
     void SetCurrent(int motor_number, float current);
     void SetPosition(int motor_number, float position);
     void SetPosition(int motor_number, float position, float velocity_feedforward);
@@ -51,6 +54,7 @@ public:
     bool run_state(int axis, int requested_state, bool wait);
 private:
     HardwareSerial& serial_;
+    struct CoupledPositionCommand* capture_ = NULL;
     void SendNLLen();
     void SendStartByte();
     void SendByte(uint8_t byte);
@@ -69,4 +73,13 @@ struct LegGain {
     float kd_gamma = 0;
 };
 
+// Arguments of the latest SetCoupledPosition with gains, kept instead of sent
+// while a controller on the Teensy closes the loop (CaptureCoupledPosition)
+struct CoupledPositionCommand {
+    float sp_theta = 0;
+    float sp_gamma = 0;
+    struct LegGain gains;
+    uint32_t count = 0; // Number of commands captured so far
+};
+
 #endif //ODriveArduino_h
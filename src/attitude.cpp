@@ -0,0 +1,144 @@
+#include "attitude.h"
+#include <math.h>
+
+static const float GRAVITY = 9.81f;
+
+void AttitudeInit(struct AttitudeEstimator& e, float kp, float ki, float accel_gate) {
+    e.q0 = 1.0f;
+    e.q1 = e.q2 = e.q3 = 0.0f;
+    e.bias_x = e.bias_y = e.bias_z = 0.0f;
+    e.kp = kp;
+    e.ki = ki;
+    e.accel_gate = accel_gate;
+    e.initialized = false;
+}
+
+/**
+ * Set the attitude straight from a normalized gravity direction, with zero
+ * yaw.
+ */
+static void AttitudeFromGravity(struct AttitudeEstimator& e, float ax, float ay, float az) {
+    // Roll about x, then pitch about y, per AttitudeEuler
+    float roll = asinf(fmaxf(-1.0f, fminf(1.0f, ay)));
+    float theta = -atan2f(ax, az);
+    float cr = cosf(0.5f * roll), sr = sinf(0.5f * roll);
+    float cp = cosf(0.5f * theta), sp = sinf(0.5f * theta);
+    e.q0 = cr * cp;
+    e.q1 = sr * cp;
+    e.q2 = cr * sp;
+    e.q3 = sr * sp;
+}
+
+bool AttitudeUpdate(struct AttitudeEstimator& e, float gx, float gy, float gz,
+                    float ax, float ay, float az, float dt) {
+    float q0 = e.q0, q1 = e.q1, q2 = e.q2, q3 = e.q3;
+
+    // Only trust the accelerometer for the gravity direction when the body
+    // isn't accelerating much: not in flight, pushing off or landing
+    float a2 = ax * ax + ay * ay + az * az;
+    float lo = (1.0f - e.accel_gate) * GRAVITY;
+    float hi = (1.0f + e.accel_gate) * GRAVITY;
+    bool use_accel = a2 > lo * lo && a2 < hi * hi;
+
+    gx -= e.bias_x;
+    gy -= e.bias_y;
+    gz -= e.bias_z;
+
+    if (use_accel) {
+        float inv_a = 1.0f / sqrtf(a2);
+        ax *= inv_a;
+        ay *= inv_a;
+        az *= inv_a;
+        if (!e.initialized) {
+            AttitudeFromGravity(e, ax, ay, az);
+            e.initialized = true;
+            return true;
+        }
+
+        // Estimated gravity direction in the body frame, the third row of the
+        // rotation matrix
+        float vx = 2.0f * (q1 * q3 - q0 * q2);
+        float vy = 2.0f * (q0 * q1 + q2 * q3);
+        float vz = q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3;
+
+        // Rotation that takes the estimate towards the measurement
+        float ex = ay * vz - az * vy;
+        float ey = az * vx - ax * vz;
+        float ez = ax * vy - ay * vx;
+
+        e.bias_x -= e.ki * ex * dt;
+        e.bias_y -= e.ki * ey * dt;
+        e.bias_z -= e.ki * ez * dt;
+        gx += e.kp * ex;
+        gy += e.kp * ey;
+        gz += e.kp * ez;
+    }
+
+    // q' = q + 0.5 * q * (0, g) * dt
+    float hx = 0.5f * dt * gx, hy = 0.5f * dt * gy, hz = 0.5f * dt * gz;
+    e.q0 = q0 - q1 * hx - q2 * hy - q3 * hz;
+    e.q1 = q1 + q0 * hx + q2 * hz - q3 * hy;
+    e.q2 = q2 + q0 * hy - q1 * hz + q3 * hx;
+    e.q3 = q3 + q0 * hz + q1 * hy - q2 * hx;
+
+    float inv_q = 1.0f / sqrtf(e.q0 * e.q0 + e.q1 * e.q1 + e.q2 * e.q2 + e.q3 * e.q3);
+    e.q0 *= inv_q;
+    e.q1 *= inv_q;
+    e.q2 *= inv_q;
+    e.q3 *= inv_q;
+    return use_accel;
+}
+
+void AttitudeEuler(const struct AttitudeEstimator& e, float& yaw, float& pitch, float& roll) {
+    float q0 = e.q0, q1 = e.q1, q2 = e.q2, q3 = e.q3;
+    float vx = 2.0f * (q1 * q3 - q0 * q2);
+    float vy = 2.0f * (q0 * q1 + q2 * q3);
+    float vz = q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3;
+    pitch = atan2f(vx, vz);
+    roll = asinf(fmaxf(-1.0f, fminf(1.0f, vy)));
+    yaw = atan2f(2.0f * (q0 * q3 - q1 * q2), q0 * q0 - q1 * q1 + q2 * q2 - q3 * q3);
+}
+
+/**
+ * Fill in the angle rates of a from its roll, its body rates and the body's
+ * pitch. Yaw rate is undefined at +-90 degrees of roll and is left at 0 there.
+ * @param pitch Pitch as AttitudeEuler gives it. a.pitch has the tare taken
+ *              off, so it isn't the angle the body rates are turned by.
+ */
+void AttitudeSetEulerRates(struct Attitude& a, float pitch) {
+    // Body rates are pitch rate about y, plus roll rate about x and yaw rate
+    // about z, both turned by the pitch. Pitch is minus the y rotation.
+    float cp = cosf(pitch), sp = sinf(pitch);
+    float cr = cosf(a.roll);
+    a.roll_rate = cp * a.rate_x - sp * a.rate_z;
+    float yaw_rate_cr = sp * a.rate_x + cp * a.rate_z;
+    if (fabsf(cr) > 1e-3f) {
+        a.yaw_rate = yaw_rate_cr / cr;
+        a.pitch_rate = -a.rate_y + sinf(a.roll) * a.yaw_rate;
+    } else {
+        a.yaw_rate = 0;
+        a.pitch_rate = -a.rate_y;
+    }
+}
+
+/**
+ * Extrapolate an attitude to t_us with its angle rates, eg to the time a
+ * control tick runs rather than when the IMU last sampled.
+ * @param max_us Longest extrapolation; an older attitude is only carried
+ *               forward this far, so a stalled IMU doesn't run away
+ * @return Age of latest at t_us, in us, 0 if it is newer than t_us
+ */
+uint32_t AttitudePredict(const struct Attitude& latest, uint32_t t_us, uint32_t max_us,
+                         struct Attitude& predicted) {
+    int32_t age = (int32_t)(t_us - latest.t_us);
+    if (age < 0) {
+        age = 0;
+    }
+    float dt = (age < (int32_t)max_us ? age : max_us) * 1e-6f;
+    predicted = latest;
+    predicted.t_us = t_us;
+    predicted.yaw += latest.yaw_rate * dt;
+    predicted.pitch += latest.pitch_rate * dt;
+    predicted.roll += latest.roll_rate * dt;
+    return age;
+}
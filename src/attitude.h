@@ -0,0 +1,65 @@
+#ifndef ATTITUDE_H
+#define ATTITUDE_H
+
+#include <stdint.h>
+
+// Body attitude estimator: a Mahony complementary filter on the unit
+// quaternion. Gyro rates are integrated every update, and the error between
+// the measured and estimated gravity direction is fed back proportionally
+// (kp, pulls the attitude towards the accelerometer) and through an integral
+// (ki, which estimates the gyro bias).
+//
+// Body frame is the BNO080's, z up when the robot stands level. Everything is
+// float so it runs on the Teensy's single precision FPU. No Arduino or ChibiOS
+// dependencies, so tools/attitude can build it on the host.
+
+struct AttitudeEstimator {
+    float q0, q1, q2, q3;             // Body to world rotation
+    float bias_x, bias_y, bias_z;     // Gyro bias estimate, rad/s
+    float kp, ki;
+    float accel_gate;                 // Accelerometer samples further than this fraction from 1g are ignored
+    bool initialized;
+};
+
+/**
+ * Reset the estimator to level with no bias estimate. The first update with a
+ * usable accelerometer sample snaps the attitude to it.
+ */
+void AttitudeInit(struct AttitudeEstimator& e, float kp, float ki, float accel_gate);
+
+/**
+ * Advance the estimate by one gyro sample.
+ * @param gx, gy, gz Body rates, rad/s
+ * @param ax, ay, az Specific force, m/s^2, eg the latest accelerometer
+ *                   sample; all 0 for a gyro only update
+ * @param dt Time since the last update, s
+ * @return true if the accelerometer sample was used for correction
+ */
+bool AttitudeUpdate(struct AttitudeEstimator& e, float gx, float gy, float gz,
+                    float ax, float ay, float az, float dt);
+
+/**
+ * Euler angles of the estimate, rad: yaw about world z, then roll about body
+ * x, then pitch about body y, so pitch stays well defined through a flip.
+ * Pitch is minus the rotation about y, the sign imu.cpp has always used (the
+ * accelerometer alone gives atan2(ax, az)), and spans -pi to pi; the caller
+ * unwraps it. Roll spans -pi/2 to pi/2.
+ */
+void AttitudeEuler(const struct AttitudeEstimator& e, float& yaw, float& pitch, float& roll);
+
+/**
+ * Body attitude at one instant, as the IMU thread publishes it after every
+ * gyro sample
+ */
+struct Attitude {
+    uint32_t t_us;                         // micros() at the INT edge of the gyro sample
+    float yaw, pitch, roll;                // rad, see AttitudeEuler; pitch is unwrapped and tared
+    float rate_x, rate_y, rate_z;          // Body rates with the bias estimate removed, rad/s
+    float yaw_rate, pitch_rate, roll_rate; // Rates of the angles above, rad/s
+};
+
+void AttitudeSetEulerRates(struct Attitude& a, float pitch);
+uint32_t AttitudePredict(const struct Attitude& latest, uint32_t t_us, uint32_t max_us,
+                         struct Attitude& predicted);
+
+#endif
@@ -3,33 +3,61 @@
 #include "globals.h"
 #include "position_control.h"
 #include "imu.h"
+#include "imu_trigger.h"
+#include "flight_recorder.h"
+#include "console.h"
+#include "gait_params.h"
+#include "phase_sequencer.h"
+
+enum FlipPhase {
+    FLIP_PREP,   // Crouch the front legs before jumping
+    FLIP_LAUNCH, // Push off with the front feet, until retracting them
+    FLIP_TIMED_PHASES
+};
+static const uint32_t flip_phase_us[FLIP_TIMED_PHASES] = {600000, 100000};
+static struct PhaseSequencer flip_sequence_;
 
-float flip_start_time_ = 0.0f;
+// Pitch at which each airborne phase of the flip ends. The IMU thread fires a
+// trigger on each crossing, so the next phase's leg commands go out within a
+// gyro sample of it rather than up to a control period later.
+static const float flip_phase_end_pitch[] = {90.0*M_PI/180.0, 130.0*M_PI/180.0, 180.0*M_PI/180.0};
+static const int FLIP_AIRBORNE_PHASES = 3;
+static int flip_trigger_ = -1;
+static int flip_trigger_phase_ = 0; // Airborne phase whose end flip_trigger_ watches
 
 enum LegSet {
     FRONT,
     BACK
 };
 
-void pointDown(struct GaitParams params) {
-    float pitch = global_debug_values.imu.pitch;
+void pointDown(struct GaitParams params, struct LegGain gains) {
+    struct Attitude attitude;
+    IMUPredictAttitude(micros(), attitude);
+    float pitch = attitude.pitch;
     if (pitch > M_PI/2 || pitch < -M_PI/2) return;
     float y = params.stance_height;
     float theta, gamma;
     CartesianToThetaGamma(0.0, y, 1, theta, gamma);
-    odrv0Interface.SetCoupledPosition(pitch, gamma, gait_gains);
-    odrv1Interface.SetCoupledPosition(pitch, gamma, gait_gains);
-    odrv2Interface.SetCoupledPosition(-pitch, gamma, gait_gains);
-    odrv3Interface.SetCoupledPosition(-pitch, gamma, gait_gains);
+    odrv0Interface.SetCoupledPosition(pitch, gamma, gains);
+    odrv1Interface.SetCoupledPosition(pitch, gamma, gains);
+    odrv2Interface.SetCoupledPosition(-pitch, gamma, gains);
+    odrv3Interface.SetCoupledPosition(-pitch, gamma, gains);
 }
 
-void StartFlip(float start_time_s) {
+/**
+ * @param start_us The Micros64() time of when the flip command was sent
+ */
+void StartFlip(uint64_t start_us) {
     state = FLIP;
     IMUTarePitch();
-    Serial.println("FLIP");
-    flip_start_time_ = start_time_s;
+    ConsoleMessage().println("FLIP");
+    // Left over if the last flip was cut short
+    EndFlip();
+    PhaseSequencerStart(flip_sequence_, "Flip", flip_phase_us, FLIP_TIMED_PHASES, start_us);
+    FlightRecorderTrigger(FR_REASON_FLIP);
     UpdateStateGaitParams(FLIP);
     gait_gains = {120,1,140,1};
+    GaitParamsCommit();
     PrintGaitParams();
 }
 
@@ -57,56 +85,102 @@ void CommandLegsThetaY(float theta, float r, struct LegGain lg, LegSet ls) {
     }
 }
 
-void ExecuteFlip(struct GaitParams params) {
-    const float prep_time = 0.6f; // Duration before jumping [s]
-    const float launch_time = 0.1f; // Duration before retracting the leg [s]
+static void ReleaseFlipTrigger() {
+    IMUDisarmTrigger(flip_trigger_);
+    flip_trigger_ = -1;
+}
+
+/**
+ * Wrap up the flip once it has landed or when the robot leaves FLIP before
+ * that: release its IMU trigger and print its phase times. Safe to call again.
+ */
+void EndFlip() {
+    ReleaseFlipTrigger();
+    PhaseSequencerReport(flip_sequence_);
+}
 
+/**
+ * Keep a trigger armed on the end of the current airborne phase. Call after
+ * the phase's leg commands are sent, so the latency recorded for a fired
+ * trigger runs up to the commands it caused.
+ */
+static void WatchFlipPhase(int phase) {
+    if (IMUTriggerFired(flip_trigger_)) {
+        IMUTriggerHandled(flip_trigger_);
+        flip_trigger_ = -1;
+    }
+    // The predicted pitch can cross before a sample does
+    if (flip_trigger_phase_ != phase) {
+        ReleaseFlipTrigger();
+    }
+    if (flip_trigger_ < 0 && phase < FLIP_AIRBORNE_PHASES) {
+        flip_trigger_ = IMUArmTrigger(IMU_PITCH_ABOVE, flip_phase_end_pitch[phase]);
+        flip_trigger_phase_ = phase;
+    }
+    if (phase >= FLIP_AIRBORNE_PHASES) {
+        EndFlip();
+    }
+}
+
+void ExecuteFlip(struct GaitParams params, struct LegGain gains) {
     struct LegGain rear_gains = {120,1,80,1};
     float rear_up_len = 0.08;
     float rear_down_len = 0.24;
 
-    float t = millis()/1000.0f - flip_start_time_;
-    float pitch = global_debug_values.imu.pitch;
+    int timed_phase = PhaseSequencerUpdate(flip_sequence_, Micros64());
+    // The body turns fast in the air, so use the pitch now rather than at
+    // the last IMU sample for the phase changes below
+    struct Attitude attitude;
+    IMUPredictAttitude(micros(), attitude);
+    float pitch = attitude.pitch;
 
     float theta=0,gamma=0;
 
     // Preparing to jump
-    if (t < prep_time) {
+    if (timed_phase == FLIP_PREP) {
         float y_back = rear_up_len;
         CommandLegsThetaY(pitch, y_back, rear_gains, BACK);
 
         float y_front = params.stance_height - params.up_amp;
-        CommandLegsThetaY(pitch, y_front, gait_gains, FRONT);
+        CommandLegsThetaY(pitch, y_front, gains, FRONT);
+        return;
 
     // Push off with front feet
-    } else if (t >= prep_time && t < prep_time + launch_time) {
+    } else if (timed_phase == FLIP_LAUNCH) {
         float y_back = rear_up_len;
         CommandLegsThetaY(pitch, y_back, rear_gains, BACK);
 
         float y_front = params.stance_height + params.down_amp;
-        CommandLegsThetaY(pitch, y_front, gait_gains, FRONT);
+        CommandLegsThetaY(pitch, y_front, gains, FRONT);
+        return;
+    }
+
+    int phase = 0;
+    while (phase < FLIP_AIRBORNE_PHASES && pitch >= flip_phase_end_pitch[phase]) {
+        phase++;
+    }
 
     // Rotate front legs to catch
-} else if (pitch < 90.0*M_PI/180.0) {
+    if (phase == 0) {
         float y_back = rear_up_len;
         CommandLegsThetaY(pitch, y_back, rear_gains, BACK);
 
         float y_front = params.stance_height;
-        CommandLegsThetaY(-pitch, y_front, gait_gains, FRONT);
+        CommandLegsThetaY(-pitch, y_front, gains, FRONT);
 
     // Push off with back feet, keep rotating front legs to catch
-    } else  if (pitch < 130.0*M_PI/180.0) {
+    } else if (phase == 1) {
         float y_back = rear_down_len;
-        CommandLegsThetaY(pitch, y_back, gait_gains, BACK);
+        CommandLegsThetaY(pitch, y_back, gains, BACK);
 
         float y_front = params.stance_height;
-        CommandLegsThetaY(-pitch, y_front, gait_gains, FRONT);
-    } else if (pitch < 180.0*M_PI/180.0){
+        CommandLegsThetaY(-pitch, y_front, gains, FRONT);
+    } else if (phase == 2) {
         float y_back = params.stance_height;
-        CommandLegsThetaY(pitch, y_back, gait_gains, BACK);
+        CommandLegsThetaY(pitch, y_back, gains, BACK);
 
         float y_front = params.stance_height;
-        CommandLegsThetaY(-pitch, y_front, gait_gains, FRONT);
+        CommandLegsThetaY(-pitch, y_front, gains, FRONT);
     } else {
         struct LegGain landing_gains = {120,1,50,1.5};
         float y_back = params.stance_height;
@@ -115,4 +189,5 @@ void ExecuteFlip(struct GaitParams params) {
         float y_front = params.stance_height;
         CommandLegsThetaY(pitch - 2*M_PI, y_front, landing_gains, FRONT);
     }
+    WatchFlipPhase(phase);
 }
@@ -1,9 +1,12 @@
 #ifndef BACKFLIP_H
 #define BACKFLIP_H
 
-void StartFlip(float start_time_s);
-void ExecuteFlip(struct GaitParams params);
-void pointDown(struct GaitParams params);
+#include <stdint.h>
+
+void StartFlip(uint64_t start_us);
+void EndFlip();
+void ExecuteFlip(struct GaitParams params, struct LegGain gains);
+void pointDown(struct GaitParams params, struct LegGain gains);
 
 
 #endif
@@ -0,0 +1,126 @@
+#ifndef COMMAND_FORMAT_H
+#define COMMAND_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "script_format.h"
+
+// Binary host command frames, read on the same port as the text commands
+// (see ProcessUSBSerial). Only depends on the C library so host programs such
+// as joystick controllers can include it.
+//
+// Frames use the same layout as the ODrive UART protocol:
+//   uint8_t start      COMMAND_START_BYTE, never sent in text commands
+//   uint8_t length     Number of payload bytes
+//   payload:
+//     uint8_t type     CommandType, | COMMAND_NO_ACK to skip the ack
+//     uint8_t seq      Chosen by the host, echoed in the ack
+//     ...              Type specific data
+//   uint8_t checksum   XOR of the payload bytes
+// All multi-byte values are little endian. Every frame is answered with a
+// TELEMETRY_ACK frame (see telemetry_format.h) unless it has COMMAND_NO_ACK
+// set and was applied successfully.
+
+const uint8_t COMMAND_START_BYTE = 1;
+const int COMMAND_MAX_PAYLOAD = 24;
+const uint8_t COMMAND_NO_ACK = 0x80;
+
+enum CommandType {
+    COMMAND_MOTION = 'V', // CommandMotion
+    COMMAND_STATE = 'M', // CommandState
+    COMMAND_GAINS = 'G', // CommandGains
+    COMMAND_KEYFRAME = 'K', // CommandKeyframe
+    COMMAND_TRAJECTORY = 'Q', // CommandTrajectoryPoint, answered with TELEMETRY_TRAJECTORY_ACK
+    COMMAND_GAIT_PATTERN = 'P' // CommandGaitPattern
+};
+
+enum CommandStatus {
+    COMMAND_OK = 0,
+    COMMAND_REJECTED = 1, // Failed validation, nothing changed
+    COMMAND_BAD_CHECKSUM = 2,
+    COMMAND_BAD_FORMAT = 3 // Unknown type or wrong length
+};
+
+// Fields equal to this are left unchanged
+const int16_t COMMAND_UNCHANGED = INT16_MIN;
+
+#pragma pack(push, 1)
+// Gait parameters of the current state, committed together
+struct CommandMotion {
+    int16_t step_length; // mm, sets forward speed
+    int16_t step_diff; // mm, sets turn rate
+    int16_t stance_height; // mm
+    int16_t freq; // 1/100 Hz
+};
+
+// Same letters as the text commands that change the state, eg 'T' to trot
+// or 'S' to stop. Other letters are rejected.
+struct CommandState {
+    uint8_t command;
+};
+
+// Leg gains in 1/100 units, like the ODrive 'S' command
+struct CommandGains {
+    int16_t kp_theta, kd_theta, kp_gamma, kd_gamma;
+};
+
+// One keyframe of the motion script. Rejected while a script is running.
+struct CommandKeyframe {
+    uint8_t index;
+    struct ScriptKeyframe keyframe;
+};
+
+// Set on the final point of a trajectory
+const uint8_t COMMAND_TRAJECTORY_LAST = 1;
+
+// Joint setpoints for every leg at one time of a streamed trajectory,
+// appended to the trajectory buffer. A point with t_ms 0 starts a new
+// trajectory and discards anything still buffered; after that t_ms has to
+// increase. A COMMAND_TRAJECTORY frame with no data only asks for the
+// buffer state.
+struct CommandTrajectoryPoint {
+    uint32_t t_ms; // Time from the trajectory start
+    uint8_t flags;
+    int16_t theta[4]; // Per ODrive, as sent to it (mrad)
+    int16_t gamma[4];
+};
+
+// Defines a runtime gait pattern (see src/gait_patterns.h). 'G <index>'
+// switches to it. Redefining the running pattern switches to the new
+// definition.
+struct CommandGaitPattern {
+    uint8_t index; // Entry in the gait pattern table, past the built-in gaits
+    uint16_t offset[4]; // Where each leg is in the cycle, odrv0 to odrv3 (1/65536 cycle)
+    uint16_t duty; // Part of the cycle in stance (1/65536), 0 to use the flight percent
+    uint8_t swing; // 0 sine, 1 cycloid
+    uint8_t stance; // 0 sine, 1 flat
+    int16_t kp_theta, kd_theta, kp_gamma, kd_gamma; // Gains it starts with, 1/100 units
+};
+#pragma pack(pop)
+
+inline uint8_t CommandChecksum(const uint8_t* payload, size_t len) {
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len; i++) {
+        sum ^= payload[i];
+    }
+    return sum;
+}
+
+/**
+ * Build a command frame. out must hold COMMAND_MAX_PAYLOAD + 3 bytes.
+ * @return Frame length, or 0 if the data doesn't fit
+ */
+inline size_t CommandEncode(uint8_t type, uint8_t seq, const void* data, size_t len, uint8_t* out) {
+    if (len + 2 > (size_t)COMMAND_MAX_PAYLOAD) return 0;
+    out[0] = COMMAND_START_BYTE;
+    out[1] = (uint8_t)(len + 2);
+    out[2] = type;
+    out[3] = seq;
+    memcpy(out + 4, data, len);
+    out[4 + len] = CommandChecksum(out + 2, len + 2);
+    return len + 5;
+}
+
+#endif
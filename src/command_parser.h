@@ -0,0 +1,130 @@
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Lexer for the text commands (see InterpretCommand). Works in place on a
+// NUL terminated buffer, never allocates and only depends on stdint, so it
+// costs a few hundred cycles per command instead of pulling in scanf.
+//
+// A command is a letter followed by space separated arguments:
+//   f 2.0      g 80 0.5 50 0.5      M est_* 2
+
+const int COMMAND_MAX_ARGS = 4;
+
+struct CommandText {
+    char letter;
+    int argc; // Number of arguments found, up to COMMAND_MAX_ARGS
+    const char* args[COMMAND_MAX_ARGS]; // Start of each argument
+    uint8_t arg_len[COMMAND_MAX_ARGS];
+};
+
+inline bool CommandIsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * Split a command into its letter and arguments.
+ * @return False if there is no command letter or too many arguments
+ */
+inline bool CommandTokenize(const char* text, CommandText& cmd) {
+    const char* p = text;
+    while (CommandIsSpace(*p)) p++;
+    if (*p == '\0') return false;
+    cmd.letter = *p++;
+    cmd.argc = 0;
+    while (true) {
+        while (CommandIsSpace(*p)) p++;
+        if (*p == '\0') return true;
+        if (cmd.argc == COMMAND_MAX_ARGS) return false;
+        const char* start = p;
+        while (*p != '\0' && !CommandIsSpace(*p)) p++;
+        if (p - start > 255) return false;
+        cmd.args[cmd.argc] = start;
+        cmd.arg_len[cmd.argc] = (uint8_t)(p - start);
+        cmd.argc++;
+    }
+}
+
+/**
+ * Parse a whole argument as a decimal float: optional sign, digits with an
+ * optional point, optional e/E exponent. Up to 7 significant digits are kept,
+ * which is all a float holds; the result is correctly rounded when the value
+ * has at most 7 significant digits and exponent within +-10.
+ * @return False if the argument isn't a number
+ */
+inline bool CommandParseFloat(const char* s, int len, float& out) {
+    static const float POW10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+    const char* p = s;
+    const char* end = s + len;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    uint32_t mantissa = 0;
+    int digits = 0; // Significant digits kept in mantissa
+    int exponent = 0;
+    bool any_digit = false;
+    bool point = false;
+    for (; p < end; p++) {
+        if (*p >= '0' && *p <= '9') {
+            any_digit = true;
+            if (digits < 7) {
+                if (mantissa != 0 || *p != '0') {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits++;
+                }
+                if (point) exponent--;
+            } else if (!point) {
+                exponent++; // Dropped digit before the point
+            }
+        } else if (*p == '.' && !point) {
+            point = true;
+        } else {
+            break;
+        }
+    }
+    if (!any_digit) return false;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool exp_negative = false;
+        if (p < end && (*p == '-' || *p == '+')) exp_negative = *p++ == '-';
+        if (p == end) return false;
+        int e = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (e < 100) e = e * 10 + (*p - '0');
+        }
+        exponent += exp_negative ? -e : e;
+    }
+    if (p != end) return false;
+
+    float value = (float)mantissa;
+    while (exponent > 10) { value *= 1e10f; exponent -= 10; }
+    while (exponent < -10) { value /= 1e10f; exponent += 10; }
+    value = exponent >= 0 ? value * POW10[exponent] : value / POW10[-exponent];
+    out = negative ? -value : value;
+    return true;
+}
+
+/**
+ * Parse a whole argument as a decimal integer with an optional sign.
+ * @return False if the argument isn't an integer or doesn't fit
+ */
+inline bool CommandParseInt(const char* s, int len, int32_t& out) {
+    const char* p = s;
+    const char* end = s + len;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if (p == end) return false;
+    int64_t value = 0;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') return false;
+        value = value * 10 + (*p - '0');
+        if (value > INT32_MAX) return false;
+    }
+    out = (int32_t)(negative ? -value : value);
+    return true;
+}
+
+#endif
@@ -10,17 +10,35 @@
 //------------------------------------------------------------------------------
 // Thread execution rates
 #define POSITION_CONTROL_FREQ 100
-#define DEBUG_PRINT_FREQ 20
+#define TELEMETRY_FREQ 200
+// The default telemetry subscription ('D' with nothing subscribed) sends every
+// Nth telemetry period. Its 17 channels make 49 byte frames on the wire, so at
+// 2 (100Hz) they take 4.9kB/s of the 11.5kB/s XBee link (SERIAL_BAUD) and
+// leave room for acks, console text and channels added with 'M'. 1 (200Hz)
+// would take 9.8kB/s.
+#define TELEMETRY_DEFAULT_DECIMATION 2
 #define UART_FREQ 2000
-#define USB_SERIAL_FREQ 100
-#define DATALOG_FREQ 10
-#define IMU_FREQ 400
+#define USB_SERIAL_FREQ 1000 // Command port polling; also bounds command arrival timestamp error
+#define DATALOG_FREQ 50 // How often the datalog thread flushes full blocks to the SD card
+#define CONSOLE_FREQ 100 // How often queued console messages are written out
+#define IMU_INT_TIMEOUT_MS 50 // Longest the IMU thread waits for the BNO080 INT line before checking anyway
 #define IMU_SEND_FREQ 100
 
 //------------------------------------------------------------------------------
 // Robot Safety Parameters
 #define CURRENT_LIM 50.0f
 
+//------------------------------------------------------------------------------
+// Gait pattern parameters (see src/gait_patterns.h)
+// Gaits that can be defined at runtime, after the built-in ones
+#define GAIT_PATTERN_SLOTS 4
+// Gait cycles the legs take to move from one gait's offsets to the next's.
+// 0 switches straight away.
+#define GAIT_SWITCH_CYCLES 1.0f
+// Control ticks the 'C' gait kernel benchmark simulates per gait. It blocks
+// the control thread for the whole run, about 0.15s per 1000 ticks.
+#define GAIT_BENCHMARK_TICKS 1000
+
 //------------------------------------------------------------------------------
 // XBEE Config
 // Define USE_XBEE to cause all debug prints to go through the xbee
@@ -32,11 +50,45 @@
 #define Serial Serial5
 #endif
 
+// Baud rate of the command/debug serial port
+#define SERIAL_BAUD 115200
+
+// Received commands that can wait for the next control tick
+#define COMMAND_MAILBOX_LEN 16
+
+//------------------------------------------------------------------------------
+// Console output queue
+// Messages waiting for the console thread, CONSOLE_MESSAGE_LEN bytes each
+#define CONSOLE_QUEUE_LEN 16
+// Further messages in the same second are dropped and counted
+#define CONSOLE_MAX_MESSAGES_PER_S 50
+// Identical messages closer together than this are counted, not printed
+#define CONSOLE_REPEAT_MS 1000
+
+// Extra transmit buffer for the XBee port so telemetry frames and console
+// output queue up instead of waiting on the UART
+#define XBEE_TX_BUFFER_SIZE 512
+
 //------------------------------------------------------------------------------
 // IMU Parameters
-// Set enable flag to 1 to use accelerometer and gyro, set to 0 to just use gyro
-#define IMU_ENABLE_COMPLEMENTARY_FILTER 0
-#define IMU_COMPLEMENTARY_FILTER_TAU 0.95f
+// Attitude estimator gains (see src/attitude.h). KP pulls the attitude
+// towards the accelerometer's gravity direction, in rad/s per radian of error,
+// so 2 corrects with a ~0.5s time constant. KI sets how fast the gyro bias
+// estimate follows.
+#define IMU_ATTITUDE_KP 2.0f
+#define IMU_ATTITUDE_KI 0.2f
+// Accelerometer samples more than this fraction away from 1g (jumping,
+// flipping, landing) are not used for correction
+#define IMU_ACCEL_GATE 0.15f
+// Longest the attitude is extrapolated past the latest gyro sample
+// (IMUPredictAttitude). Two IMU periods at IMU_SEND_FREQ.
+#define IMU_MAX_PREDICT_US 20000
+// Attitude triggers that can be armed at once (see src/imu_trigger.h)
+#define IMU_MAX_TRIGGERS 4
+
+// Gyro and accelerometer samples kept for IMUReadSamples. 64 is 320ms of
+// both at IMU_SEND_FREQ
+#define IMU_SAMPLE_RING 64
 
 // Set above 0 to print imu debug messages
 #define IMU_VERBOSE 0
@@ -55,4 +107,116 @@
 // Set above 0 to print debugging messages
 #define DATALOGGER_VERBOSE 0
 
+// Number of 512 byte blocks buffered in RAM between the control thread and
+// the SD card. Must cover the longest SD write stall.
+#define DATALOG_RING_BLOCKS 16
+
+// Size of the preallocated log file in 512 byte blocks (~25 min at 100Hz)
+#define DATALOG_FILE_BLOCKS 40000UL
+
+//------------------------------------------------------------------------------
+// Body state estimator parameters (see src/state_estimator.h)
+// Fraction of the gap to the leg odometry velocity and height closed every
+// control tick while feet are on the ground. Higher trusts the legs more and
+// the integrated accelerometer less.
+#define STATE_EST_VELOCITY_GAIN 0.2f
+#define STATE_EST_HEIGHT_GAIN 0.2f
+// Feet within this height of the lowest foot count as on the ground (m)
+#define STATE_EST_STANCE_MARGIN 0.015f
+// Below this specific force (fraction of 1g) the body is taken to be in
+// flight and the legs are ignored
+#define STATE_EST_FLIGHT_ACCEL 0.5f
+// Longer gaps between updates (s) restart leg odometry
+#define STATE_EST_MAX_DT 0.05f
+// Fore-aft distance from the body centre to the hip axles (m). An estimate
+// from the frame drawings, not a measurement of the robot
+#define BODY_HIP_X 0.2f
+// Budget for one update: 30us on the M4 at 144MHz (board_build.f_cpu)
+#define STATE_EST_BUDGET_CYCLES 4320
+
+//------------------------------------------------------------------------------
+// Foot contact detector parameters (see src/contact.h)
+// Leg compression, setpoint length minus measured length, that starts and
+// ends contact when the ODrives close the loop (m)
+#define CONTACT_COMPRESSION_ON 0.012f
+#define CONTACT_COMPRESSION_OFF 0.005f
+// Estimated foot force that starts and ends contact with the impedance
+// controller on (N)
+#define CONTACT_FORCE_ON 8.0f
+#define CONTACT_FORCE_OFF 3.0f
+
+//------------------------------------------------------------------------------
+// Impedance controller parameters (see src/impedance.h)
+// Set to 1 to close the leg position loops on the Teensy with 'C' current
+// frames instead of sending 'S' frames for the ODrives' own PD loops
+#define ENABLE_IMPEDANCE_CONTROL 0
+#define IMPEDANCE_FREQ 1000
+// Weight of each new finite difference, one per ODrive reply, in the
+// filtered leg velocities
+#define IMPEDANCE_VELOCITY_FILTER 0.3f
+// Leg positions older than this are not trusted and the leg goes limp (us)
+#define IMPEDANCE_FEEDBACK_TIMEOUT_US 5000
+// Per tick budgets for computing the currents and for handing the four frames
+// to the UARTs. An 8 byte frame takes 160us to send at 500k baud.
+#define IMPEDANCE_COMPUTE_BUDGET_US 50
+#define IMPEDANCE_IO_BUDGET_US 50
+// How often the budgets are reported on the console (ms)
+#define IMPEDANCE_REPORT_MS 1000
+// Weight the stance feet are given feedforward current to carry (kg)
+#define ROBOT_MASS 4.8f
+
+//------------------------------------------------------------------------------
+// Stance force distribution parameters (see src/stance_forces.h)
+#define STANCE_FRICTION 0.6f
+// Least vertical force a stance foot pushes with, so it stays planted (N)
+#define STANCE_MIN_FORCE 2.0f
+// Pitch torque asked of the stance feet per rad of pitch (Nm/rad) and per
+// rad/s of pitch rate (Nm s/rad)
+#define STANCE_PITCH_KP 20.0f
+#define STANCE_PITCH_KD 1.0f
+// Weights of force (per N^2) and torque (per (Nm)^2) errors. The feet are
+// ~0.2m from the centre, so 1Nm weighs about as much as 10N.
+#define STANCE_FORCE_WEIGHT 1.0f
+#define STANCE_TORQUE_WEIGHT 100.0f
+// Pull of the forces the wrench leaves free towards an even share (per N^2).
+// About the force weight keeps the solve well conditioned.
+#define STANCE_REGULARIZATION 1.0f
+#define STANCE_SOLVER_ITERATIONS 20
+// Motor current the feedforward may use, leaving the rest of CURRENT_LIM to
+// the impedance controller's PD terms (A)
+#define STANCE_CURRENT_LIM (0.8f * CURRENT_LIM)
+// Budget for one solve of four legs: 50us on the M4 at 144MHz (board_build.f_cpu)
+#define STANCE_SOLVER_BUDGET_CYCLES 7200
+
+//------------------------------------------------------------------------------
+// Flight recorder parameters
+// Set to 1 to keep recent control ticks and IMU samples in RAM and dump them
+// over serial around jumps, flips, stops and ODrive link faults
+#define ENABLE_FLIGHT_RECORDER 1
+
+// Ring size in entries. One control tick or IMU sample per entry, 48 bytes
+// each, so 1024 entries is ~49kB and ~5s at 100Hz control + 100Hz IMU
+#define FLIGHT_RECORDER_RECORDS 1024
+
+// Window dumped around each trigger. PRE + POST must fit in the ring.
+#define FLIGHT_RECORDER_PRE_MS 1000
+#define FLIGHT_RECORDER_POST_MS 3000
+
+// Time without an ODrive reply that counts as a link fault
+#define FLIGHT_RECORDER_LINK_TIMEOUT_MS 50
+
+// How often the flight recorder thread checks for a frozen ring
+#define FLIGHT_RECORDER_POLL_MS 50
+
+//------------------------------------------------------------------------------
+// Motion script parameters
+// Keyframes that fit in the uploaded script, 20 bytes each
+#define SCRIPT_MAX_KEYFRAMES 64
+
+//------------------------------------------------------------------------------
+// Streamed trajectory parameters
+// Points buffered ahead of playback, 21 bytes each. At 100 points/s, 256
+// points ride out 2.5s of link stalls.
+#define TRAJECTORY_BUFFER_POINTS 256
+
 #endif
@@ -0,0 +1,150 @@
+#include "console.h"
+#include "config.h"
+
+struct ConsoleSlot {
+    uint8_t len;
+    char text[CONSOLE_MESSAGE_LEN];
+};
+
+// Ring of queued messages. Every producer runs at NORMALPRIO under cooperative
+// scheduling and never from an interrupt, so a message is always enqueued
+// without another producer or the console thread running in between and no
+// lock is needed.
+static ConsoleSlot queue[CONSOLE_QUEUE_LEN];
+static volatile uint8_t queue_head = 0;
+static volatile uint8_t queue_tail = 0;
+
+// Repeats of the last queued message within CONSOLE_REPEAT_MS of each other
+// are counted instead of queued
+static char last_text[CONSOLE_MESSAGE_LEN];
+static uint8_t last_len = 0;
+static uint32_t last_ms = 0;
+static uint32_t repeat_count = 0;
+static uint32_t repeat_start_ms = 0;
+
+// Messages queued in the current rate limit window
+static uint32_t window_start_ms = 0;
+static uint32_t window_count = 0;
+
+volatile uint32_t console_dropped_messages = 0;
+static uint32_t reported_dropped = 0;
+
+/**
+ * Put a message on the queue if it isn't full.
+ * @return False if the message was dropped
+ */
+static bool Enqueue(const char* text, uint8_t len) {
+    uint8_t next = (queue_head + 1) % CONSOLE_QUEUE_LEN;
+    if (next == queue_tail) {
+        console_dropped_messages++;
+        return false;
+    }
+    queue[queue_head].len = len;
+    memcpy(queue[queue_head].text, text, len);
+    queue_head = next;
+    return true;
+}
+
+/**
+ * Queue a "repeated N times" line for the last message, if it was repeated.
+ */
+static void FlushRepeats() {
+    if (repeat_count == 0) {
+        return;
+    }
+    char line[40];
+    int n = snprintf(line, sizeof(line), "(last message repeated %lu times)\n", (unsigned long)repeat_count);
+    Enqueue(line, n);
+    repeat_count = 0;
+}
+
+size_t ConsoleMessage::write(uint8_t b) {
+    if (len_ < CONSOLE_MESSAGE_LEN) {
+        text_[len_++] = b;
+    }
+    return 1;
+}
+
+ConsoleMessage::~ConsoleMessage() {
+    if (len_ == 0) {
+        return;
+    }
+    if (len_ == CONSOLE_MESSAGE_LEN) {
+        text_[len_ - 1] = '\n'; // Truncated
+    }
+
+    uint32_t now = millis();
+    if (len_ == last_len && memcmp(text_, last_text, len_) == 0) {
+        bool recent = now - last_ms < CONSOLE_REPEAT_MS;
+        last_ms = now;
+        if (recent) {
+            if (repeat_count == 0) {
+                repeat_start_ms = now;
+            }
+            repeat_count++;
+            return;
+        }
+    }
+    FlushRepeats();
+
+    if (now - window_start_ms >= 1000) {
+        window_start_ms = now;
+        window_count = 0;
+    }
+    if (window_count >= CONSOLE_MAX_MESSAGES_PER_S) {
+        console_dropped_messages++;
+        return;
+    }
+    window_count++;
+
+    if (Enqueue(text_, len_)) {
+        memcpy(last_text, text_, len_);
+        last_len = len_;
+        last_ms = now;
+    }
+}
+
+/**
+ * Write queued messages to the serial port, as many as fit in its transmit
+ * buffer without waiting, and report repeats and drops.
+ */
+void ProcessConsole() {
+    // Report a long run of repeats once per CONSOLE_REPEAT_MS while it lasts
+    if (repeat_count > 0 && millis() - repeat_start_ms >= CONSOLE_REPEAT_MS) {
+        FlushRepeats();
+    }
+    if (console_dropped_messages != reported_dropped) {
+        char line[48];
+        int n = snprintf(line, sizeof(line), "(console dropped %lu messages)\n",
+                         (unsigned long)(console_dropped_messages - reported_dropped));
+        if (Enqueue(line, n)) {
+            reported_dropped = console_dropped_messages;
+        }
+    }
+
+    while (queue_tail != queue_head) {
+        const ConsoleSlot& slot = queue[queue_tail];
+        if (Serial.availableForWrite() < slot.len) {
+            break;
+        }
+        Serial.write((const uint8_t*)slot.text, slot.len);
+        queue_tail = (queue_tail + 1) % CONSOLE_QUEUE_LEN;
+    }
+}
+
+//------------------------------------------------------------------------------
+// ConsoleThread: Write queued console messages to the serial port
+//
+// Meant to be the lowest priority work in the system, but runs at NORMALPRIO
+// like the rest: the idle thread spins at NORMALPRIO, so anything below it
+// would never run.
+THD_WORKING_AREA(waConsoleThread, 512);
+
+THD_FUNCTION(ConsoleThread, arg) {
+    (void)arg;
+
+    while(true) {
+        ProcessConsole();
+        chThdSleepMicroseconds(1000000/CONSOLE_FREQ);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "Arduino.h"
+#include "ChRt.h"
+#include "globals.h"
+
+extern THD_WORKING_AREA(waConsoleThread, 512);
+extern THD_FUNCTION(ConsoleThread, arg);
+
+const int CONSOLE_MESSAGE_LEN = 96;
+
+// One line of console output. Text printed into it is collected and queued
+// for the console thread when the message is destroyed, so a statement like
+//   ConsoleMessage() << "Set freq. to: " << f << "\n";
+// never waits on the serial port. Longer messages are truncated.
+class ConsoleMessage : public Print {
+public:
+    ConsoleMessage() : len_(0) {}
+    ~ConsoleMessage();
+    ConsoleMessage(const ConsoleMessage&) = delete;
+    ConsoleMessage& operator=(const ConsoleMessage&) = delete;
+
+    using Print::write;
+    size_t write(uint8_t b) override;
+
+private:
+    char text_[CONSOLE_MESSAGE_LEN];
+    uint8_t len_;
+};
+
+// Lets a temporary ConsoleMessage start a << chain, which otherwise can't bind
+// to the Print& operator in globals.h
+template<class T> inline Print& operator <<(ConsoleMessage&& msg, T arg) { return (Print&)msg << arg; }
+
+void ProcessConsole();
+
+// Messages lost to a full queue or the rate limit
+extern volatile uint32_t console_dropped_messages;
+
+#endif
@@ -0,0 +1,74 @@
+#include "contact.h"
+#include "config.h"
+#include "globals.h"
+#include "foot_forces.h"
+#include "kinematics.h"
+
+uint8_t contact_legs = 0;
+uint8_t contact_touchdowns = 0;
+uint8_t contact_liftoffs = 0;
+volatile uint32_t contact_latency_us = 0;
+volatile uint32_t contact_max_latency_us = 0;
+
+// micros() when each leg's load last rose above the OFF threshold
+static uint32_t rise_us[4];
+static uint8_t rising = 0;
+
+/**
+ * Forget all contacts, eg before a maneuver that starts in the air or when
+ * the setpoints jump.
+ */
+void ContactReset() {
+    contact_legs = 0;
+    contact_touchdowns = 0;
+    contact_liftoffs = 0;
+    rising = 0;
+}
+
+/**
+ * Update contact_legs and the touchdown and liftoff events from the latest
+ * leg measurements.
+ * @param t_us micros() now
+ */
+void ContactUpdate(uint32_t t_us) {
+    const struct ODrive* legs[4] = {&global_debug_values.odrv0, &global_debug_values.odrv1,
+                                    &global_debug_values.odrv2, &global_debug_values.odrv3};
+    float on, off;
+    if (ENABLE_IMPEDANCE_CONTROL) {
+        on = CONTACT_FORCE_ON;
+        off = CONTACT_FORCE_OFF;
+    } else {
+        on = CONTACT_COMPRESSION_ON;
+        off = CONTACT_COMPRESSION_OFF;
+    }
+
+    uint8_t previous = contact_legs;
+    for (int i = 0; i < 4; i++) {
+        uint8_t bit = 1 << i;
+        float load;
+        if (ENABLE_IMPEDANCE_CONTROL) {
+            load = foot_forces[i].fy;
+        } else {
+            load = LegLength(legs[i]->sp_gamma) - LegLength(legs[i]->est_gamma);
+        }
+
+        if (load < off) {
+            contact_legs &= ~bit;
+            rising &= ~bit;
+        } else if (!(contact_legs & bit)) {
+            if (!(rising & bit)) {
+                rising |= bit;
+                rise_us[i] = t_us;
+            }
+            if (load > on) {
+                contact_legs |= bit;
+                contact_latency_us = t_us - rise_us[i];
+                if (contact_latency_us > contact_max_latency_us) {
+                    contact_max_latency_us = contact_latency_us;
+                }
+            }
+        }
+    }
+    contact_touchdowns = contact_legs & ~previous;
+    contact_liftoffs = previous & ~contact_legs;
+}
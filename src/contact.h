@@ -0,0 +1,30 @@
+#ifndef CONTACT_H
+#define CONTACT_H
+
+#include <stdint.h>
+
+// Per leg foot contact detector, updated by the control thread every tick
+// (and by blocking maneuvers like hop() while they wait). A foot on the
+// ground is pushed back along the leg, so its load is how far the measured
+// leg is shorter than the setpoint it is tracking, or with the impedance
+// controller on, the estimated foot force (src/foot_forces.h), which is
+// quicker and doesn't depend on the gains. Contact starts when the load
+// rises above the ON threshold and ends when it falls below the lower OFF
+// threshold, so noise around one threshold doesn't chatter.
+//
+// Detection latency is the time from the load first rising above OFF to
+// contact being declared, ie how long the rise took to become certain.
+
+// Bit i is odrv i
+extern uint8_t contact_legs;       // Feet on the ground after the latest update
+extern uint8_t contact_touchdowns; // Feet that touched down in the latest update
+extern uint8_t contact_liftoffs;   // Feet that lifted off in the latest update
+
+void ContactUpdate(uint32_t t_us);
+void ContactReset();
+
+// Latest and worst touchdown detection latency, us
+extern volatile uint32_t contact_latency_us;
+extern volatile uint32_t contact_max_latency_us;
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef CYCLE_COUNTER_H
+#define CYCLE_COUNTER_H
+
+#include "Arduino.h"
+
+// Thin wrapper around the Cortex-M4 DWT cycle counter for measuring short code
+// paths. On host builds (tools/replay) there is no cycle counter and every
+// reading is 0.
+
+inline void CycleCounterInit() {
+    #ifdef __arm__
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+    #endif
+}
+
+inline uint32_t CycleCount() {
+    #ifdef __arm__
+    return ARM_DWT_CYCCNT;
+    #else
+    return 0;
+    #endif
+}
+
+#endif
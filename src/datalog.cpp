@@ -1,19 +1,163 @@
-#ifndef DATALOG_H
-#define DATALOG_H
-
-#include "arduino.h"
 #include "datalog.h"
+#include "Arduino.h"
 #include "ChRt.h"
 #include "SdFat.h"
 #include "config.h"
 #include "globals.h"
+#include "position_control.h"
+#include "console.h"
+#include "gait_params.h"
+#include "state_estimator.h"
+#include "foot_forces.h"
+#include "contact.h"
+
+// One SD block of encoded records
+struct DatalogBlock {
+    LogBlockHeader header;
+    uint8_t data[LOG_BLOCK_PAYLOAD];
+};
+static_assert(sizeof(DatalogBlock) == LOG_BLOCK_SIZE, "DatalogBlock must fill exactly one SD block");
 
+// Per field encoding, in schema order
+#define X(name, member, encoding, scale) encoding,
+static const uint8_t field_encoding[] = { DATALOG_FIELDS(X) };
+#undef X
+const int DATALOG_FIELD_COUNT = sizeof(field_encoding);
+// Worst case size of one encoded record: a 5 byte varint per field
+const int DATALOG_RECORD_MAX_BYTES = 5 * DATALOG_FIELD_COUNT;
 
 // Initialize SD card pin, file on card, and IMU Project
 File file;
 SdFatSdio sd;
 
-char fileName;
+// Ring of blocks shared between the control thread (producer) and the datalog
+// thread (consumer). The control thread encodes into ring[ring_head]; once it
+// is full it advances ring_head and the datalog thread writes ring[ring_tail]
+// out. If the ring is full the record is dropped rather than waiting for the
+// card.
+static DatalogBlock ring[DATALOG_RING_BLOCKS];
+static volatile uint8_t ring_head = 0;
+static volatile uint8_t ring_tail = 0;
+static uint16_t pending_dropped = 0;
+static uint32_t block_seq = 0;
+// Quantized values of the previous record in the current block
+static int32_t prev_values[DATALOG_FIELD_COUNT];
+
+// Set by the datalog thread once the file is ready so that nothing is
+// buffered when logging is disabled or the card is missing
+static volatile bool datalog_active = false;
+
+volatile uint32_t datalog_dropped_records = 0;
+volatile uint32_t datalog_max_write_us = 0;
+
+/**
+ * Snapshot the robot state, encode it and append it to the log ring. Called
+ * by the control thread after every tick; never blocks.
+ * @param tick_start_us micros() at the start of the control tick
+ * @param tick_us       Time spent in the control tick (us)
+ */
+void DatalogRecordTick(uint32_t tick_start_us, uint32_t tick_us) {
+    if (!datalog_active) {
+        return;
+    }
+
+    if (ring[ring_head].header.bytes + DATALOG_RECORD_MAX_BYTES > LOG_BLOCK_PAYLOAD) {
+        uint8_t next = (ring_head + 1) % DATALOG_RING_BLOCKS;
+        if (next == ring_tail) {
+            // The card fell behind and every block is waiting to be written
+            pending_dropped++;
+            datalog_dropped_records++;
+            return;
+        }
+        ring_head = next;
+    }
+
+    DatalogBlock& block = ring[ring_head];
+    if (block.header.bytes == 0) {
+        block.header.magic = LOG_BLOCK_MAGIC;
+        block.header.seq = block_seq++;
+        block.header.dropped = pending_dropped;
+        pending_dropped = 0;
+        memset(prev_values, 0, sizeof(prev_values));
+    }
+
+    DatalogRecord r;
+    r.t_us = tick_start_us;
+    r.tick_us = tick_us > 0xFFFF ? 0xFFFF : tick_us;
+    r.state = state;
+    r.reserved = 0;
+    const struct ODrive* legs[4] = {&global_debug_values.odrv0, &global_debug_values.odrv1,
+                                    &global_debug_values.odrv2, &global_debug_values.odrv3};
+    for (int i = 0; i < 4; i++) {
+        r.sp_theta[i] = legs[i]->sp_theta;
+        r.sp_gamma[i] = legs[i]->sp_gamma;
+        r.est_theta[i] = legs[i]->est_theta;
+        r.est_gamma[i] = legs[i]->est_gamma;
+    }
+    const struct LegGain& gains = GaitParamsPublishedGains();
+    r.kp_theta = gains.kp_theta;
+    r.kd_theta = gains.kd_theta;
+    r.kp_gamma = gains.kp_gamma;
+    r.kd_gamma = gains.kd_gamma;
+    r.yaw = global_debug_values.imu.yaw;
+    r.pitch = global_debug_values.imu.pitch;
+    r.roll = global_debug_values.imu.roll;
+    r.position_reply_time = global_debug_values.position_reply_time;
+    r.vx = body_state.vx;
+    r.vz = body_state.vz;
+    r.height = body_state.height;
+    r.stance = body_state.stance;
+    r.estimator_cycles = state_estimator_cycles;
+    for (int i = 0; i < 4; i++) {
+        r.foot_fx[i] = foot_forces[i].fx;
+        r.foot_fy[i] = foot_forces[i].fy;
+    }
+    r.contact = contact_legs;
+
+    int32_t values[DATALOG_FIELD_COUNT];
+    int n = 0;
+    #define X(name, member, encoding, scale) values[n++] = LogQuantize(r.member, scale);
+    DATALOG_FIELDS(X)
+    #undef X
+
+    uint16_t bytes = block.header.bytes;
+    for (int i = 0; i < DATALOG_FIELD_COUNT; i++) {
+        bytes += LogEncodeValue(&block.data[bytes], values[i], prev_values[i], field_encoding[i]);
+        prev_values[i] = values[i];
+    }
+    block.header.bytes = bytes;
+}
+
+/**
+ * Serialize the file header and schema into buf.
+ * @return Number of bytes used, or 0 if buf is too small
+ */
+static size_t WriteLogHeader(uint8_t* buf, size_t size) {
+    LogFileHeader header;
+    header.magic = LOG_FILE_MAGIC;
+    header.version = LOG_FORMAT_VERSION;
+    header.field_count = DATALOG_FIELD_COUNT;
+    header.record_max_bytes = DATALOG_RECORD_MAX_BYTES;
+
+    size_t len = sizeof(header);
+    #define X(name, member, encoding, scale) \
+        { \
+            size_t name_len = strlen(name) + 1; \
+            float s = scale; \
+            if (len + name_len + 1 + sizeof(s) > size) return 0; \
+            memcpy(buf + len, name, name_len); \
+            len += name_len; \
+            buf[len++] = encoding; \
+            memcpy(buf + len, &s, sizeof(s)); \
+            len += sizeof(s); \
+        }
+    DATALOG_FIELDS(X)
+    #undef X
+
+    header.header_blocks = (len + LOG_BLOCK_SIZE - 1) / LOG_BLOCK_SIZE;
+    memcpy(buf, &header, sizeof(header));
+    return len;
+}
 
 THD_WORKING_AREA(waDatalogThread, 2048);
 
@@ -24,59 +168,91 @@ THD_FUNCTION(DatalogThread, arg) {
         return;
     }
 
-    Serial.begin(115200);
-
     //check card is present and can be initialized
     if(!sd.begin()) {
-        sd.initErrorHalt();
-        Serial.println("Failed to initialize SD Card");
+        ConsoleMessage().println("Failed to initialize SD Card");
         return;
     }
     if (DATALOGGER_VERBOSE > 0) {
-        Serial.println("Initialized SD Card");
+        ConsoleMessage().println("Initialized SD Card");
     }
 
-    //Open the file on SD card (only one open at a time)
-    // using BNO080 library
-    char fileName[13] = "LOGGER00.CSV";
-
     // Create a new file in the current working directory
     // and generate a new name if the file already exists
-    for (uint8_t i = 0; i < 50; i++)
-    {
+    char fileName[13] = "LOGGER00.BIN";
+    for (uint8_t i = 0; i < 100; i++) {
         fileName[6] = i/10 + '0';
         fileName[7] = i%10 + '0';
-        if (sd.exists(fileName)) {
-            continue;
-        } else {
-            if(!file.open(fileName, O_CREAT | O_WRITE | O_EXCL)) {
-                Serial.println("file.open error");
-            }
+        if (!sd.exists(fileName)) {
+            break;
+        }
+    }
+
+    // Preallocate the whole file as one contiguous run of blocks so the log
+    // can be written with raw block writes, with no FAT updates in between
+    uint32_t first_block, last_block;
+    if (!file.createContiguous(fileName, 512UL * DATALOG_FILE_BLOCKS) ||
+        !file.contiguousRange(&first_block, &last_block)) {
+        ConsoleMessage().println("Failed to create contiguous log file");
+        return;
+    }
+    // Erase so stale data from an older file is never mistaken for records
+    sd.card()->erase(first_block, last_block);
+
+    // Use the first two ring blocks to assemble the header and schema
+    uint8_t* header_buf = (uint8_t*)ring;
+    memset(header_buf, 0, 2 * LOG_BLOCK_SIZE);
+    size_t header_len = WriteLogHeader(header_buf, 2 * LOG_BLOCK_SIZE);
+    if (header_len == 0) {
+        ConsoleMessage().println("Log schema does not fit in the file header");
+        return;
+    }
+    uint32_t next_block = first_block;
+    for (size_t off = 0; off < header_len; off += LOG_BLOCK_SIZE) {
+        if (!sd.card()->writeBlock(next_block++, header_buf + off)) {
+            ConsoleMessage().println("SD write failed, no log header written");
+            return;
         }
-        break;
     }
+    memset(ring, 0, sizeof(ring));
     if (DATALOGGER_VERBOSE > 0) {
-        Serial << ("Writing to file: ") << fileName << "\n";
+        ConsoleMessage() << ("Writing to file: ") << fileName << "\n";
     }
 
+    long last_report = millis();
+    datalog_active = true;
+
     while(true) {
-        long tic = micros();
+        while (ring_tail != ring_head) {
+            if (next_block > last_block) {
+                datalog_active = false;
+                ConsoleMessage().println("Log file full, datalogging stopped");
+                return;
+            }
 
-        // TODO: Query the attitude data from the imu struct
-        file.print(global_debug_values.imu.yaw);
-        file.print(",");
-        file.print(global_debug_values.imu.pitch);
-        file.print(",");
-        file.println(global_debug_values.imu.roll);
+            long tic = micros();
+            if (!sd.card()->writeBlock(next_block, (const uint8_t*)&ring[ring_tail])) {
+                datalog_active = false;
+                ConsoleMessage().println("SD write failed, datalogging stopped");
+                return;
+            }
+            uint32_t write_us = micros() - tic;
+            if (write_us > datalog_max_write_us) {
+                datalog_max_write_us = write_us;
+            }
 
-        if (DATALOGGER_VERBOSE > 0) {
-            Serial << "Write took: " << micros()-tic << "us\n";
+            next_block++;
+            ring[ring_tail].header.bytes = 0;
+            ring_tail = (ring_tail + 1) % DATALOG_RING_BLOCKS;
         }
 
-        // TODO: sd write takes [x] us
+        if (DATALOGGER_VERBOSE > 0 && millis() - last_report > 1000) {
+            last_report = millis();
+            ConsoleMessage() << "Log blocks: " << next_block - first_block
+                   << " dropped: " << datalog_dropped_records
+                   << " max write: " << datalog_max_write_us << "us\n";
+        }
 
         chThdSleepMicroseconds(1000000/DATALOG_FREQ);
     }
 }
-
-#endif
@@ -2,9 +2,82 @@
 #define DATALOG_H
 
 #include "ChRt.h"
+#include "log_format.h"
 
 extern THD_WORKING_AREA(waDatalogThread, 2048);
 
 extern THD_FUNCTION(DatalogThread, arg);
 
+// Full robot state captured once per control tick
+struct DatalogRecord {
+    uint32_t t_us; // Start of the control tick (us)
+    uint16_t tick_us; // Time spent computing and sending the tick (us)
+    uint8_t state; // States enum
+    uint8_t reserved;
+    float sp_theta[4], sp_gamma[4]; // Leg setpoints, odrv0..odrv3 (rad)
+    float est_theta[4], est_gamma[4]; // Leg estimates, odrv0..odrv3 (rad)
+    float kp_theta, kd_theta, kp_gamma, kd_gamma; // Published gait gains
+    float yaw, pitch, roll; // Body attitude (rad)
+    int32_t position_reply_time; // ODrive reply latency (us)
+    float vx, vz, height; // Body state estimate (m/s, m/s, m)
+    uint8_t stance; // Feet taken to be on the ground, bit per ODrive
+    uint32_t estimator_cycles; // Cycles the state estimator took this tick
+    float foot_fx[4], foot_fy[4]; // Estimated foot forces, odrv0..odrv3 (N)
+    uint8_t contact; // Feet the contact detector found on the ground, bit per ODrive
+};
+
+// Log schema: X(column name, DatalogRecord member, LogEncoding, scale).
+// The schema is written into the header of every log file, so fields can be
+// added or reordered here without breaking the host decoder. Leg angles use
+// the same 1/1000 rad resolution as the ODrive wire protocol and gains the
+// same 1/100 resolution.
+#define DATALOG_FIELDS(X) \
+    X("t_us", t_us, LOG_ENC_COUNTER, 1) \
+    X("tick_us", tick_us, LOG_ENC_VARINT, 1) \
+    X("state", state, LOG_ENC_VARINT, 1) \
+    X("sp_theta0", sp_theta[0], LOG_ENC_DELTA, 1000) \
+    X("sp_gamma0", sp_gamma[0], LOG_ENC_DELTA, 1000) \
+    X("est_theta0", est_theta[0], LOG_ENC_DELTA, 1000) \
+    X("est_gamma0", est_gamma[0], LOG_ENC_DELTA, 1000) \
+    X("sp_theta1", sp_theta[1], LOG_ENC_DELTA, 1000) \
+    X("sp_gamma1", sp_gamma[1], LOG_ENC_DELTA, 1000) \
+    X("est_theta1", est_theta[1], LOG_ENC_DELTA, 1000) \
+    X("est_gamma1", est_gamma[1], LOG_ENC_DELTA, 1000) \
+    X("sp_theta2", sp_theta[2], LOG_ENC_DELTA, 1000) \
+    X("sp_gamma2", sp_gamma[2], LOG_ENC_DELTA, 1000) \
+    X("est_theta2", est_theta[2], LOG_ENC_DELTA, 1000) \
+    X("est_gamma2", est_gamma[2], LOG_ENC_DELTA, 1000) \
+    X("sp_theta3", sp_theta[3], LOG_ENC_DELTA, 1000) \
+    X("sp_gamma3", sp_gamma[3], LOG_ENC_DELTA, 1000) \
+    X("est_theta3", est_theta[3], LOG_ENC_DELTA, 1000) \
+    X("est_gamma3", est_gamma[3], LOG_ENC_DELTA, 1000) \
+    X("kp_theta", kp_theta, LOG_ENC_DELTA, 100) \
+    X("kd_theta", kd_theta, LOG_ENC_DELTA, 100) \
+    X("kp_gamma", kp_gamma, LOG_ENC_DELTA, 100) \
+    X("kd_gamma", kd_gamma, LOG_ENC_DELTA, 100) \
+    X("yaw", yaw, LOG_ENC_DELTA, 10000) \
+    X("pitch", pitch, LOG_ENC_DELTA, 10000) \
+    X("roll", roll, LOG_ENC_DELTA, 10000) \
+    X("reply_us", position_reply_time, LOG_ENC_DELTA, 1) \
+    X("vx", vx, LOG_ENC_DELTA, 1000) \
+    X("vz", vz, LOG_ENC_DELTA, 1000) \
+    X("height", height, LOG_ENC_DELTA, 1000) \
+    X("stance", stance, LOG_ENC_VARINT, 1) \
+    X("est_cycles", estimator_cycles, LOG_ENC_VARINT, 1) \
+    X("foot_fx0", foot_fx[0], LOG_ENC_DELTA, 100) \
+    X("foot_fy0", foot_fy[0], LOG_ENC_DELTA, 100) \
+    X("foot_fx1", foot_fx[1], LOG_ENC_DELTA, 100) \
+    X("foot_fy1", foot_fy[1], LOG_ENC_DELTA, 100) \
+    X("foot_fx2", foot_fx[2], LOG_ENC_DELTA, 100) \
+    X("foot_fy2", foot_fy[2], LOG_ENC_DELTA, 100) \
+    X("foot_fx3", foot_fx[3], LOG_ENC_DELTA, 100) \
+    X("foot_fy3", foot_fy[3], LOG_ENC_DELTA, 100) \
+    X("contact", contact, LOG_ENC_VARINT, 1)
+
+void DatalogRecordTick(uint32_t tick_start_us, uint32_t tick_us);
+
+// Logger health, updated by the datalog thread
+extern volatile uint32_t datalog_dropped_records;
+extern volatile uint32_t datalog_max_write_us;
+
 #endif
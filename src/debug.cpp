@@ -3,57 +3,240 @@
 #include "Arduino.h"
 #include "config.h"
 #include "globals.h"
+#include "position_control.h"
+#include "telemetry_format.h"
+#include "telemetry_channels.h"
+#include "console.h"
+#include "gait_params.h"
+#include "usb_serial.h"
+#include "trajectory.h"
+#include "imu.h"
+#include "flight_recorder.h"
+
+#define X(name, expr, scale) name,
+static const char* const channel_names[] = { TELEMETRY_CHANNELS(X) };
+#undef X
+const int TELEMETRY_CHANNEL_COUNT = sizeof(channel_names) / sizeof(channel_names[0]);
+static_assert(TELEMETRY_CHANNEL_COUNT <= TELEMETRY_MAX_CHANNELS, "Too many telemetry channels for the frame mask");
+
+// Send channel i in every telemetry_decimation[i]th frame period, 0 = off
+static uint8_t telemetry_decimation[TELEMETRY_CHANNEL_COUNT];
+
+// Frames skipped because the serial transmit buffer was full
+volatile uint32_t telemetry_dropped_frames = 0;
+
+// Sequence number of the next telemetry frame, shared by every frame type so
+// the host can count lost frames
+static uint8_t telemetry_seq = 0;
+
+static void SendTelemetry(uint8_t* frame, size_t len);
 
 //------------------------------------------------------------------------------
-// PrintDebugThread: Print debugging information to the serial montior at fixed rate
+// PrintDebugThread: Stream debugging information to the host at a fixed rate
 //
-// TODO: characterize how much bandwidth it uses
+// Every 1/TELEMETRY_FREQ while debugging is enabled, sends one binary
+// telemetry frame (see telemetry_format.h) with the subscribed channels that
+// are due. Use tools/teledecode on the host to turn the stream back into text.
+// Pauses while the flight recorder dumps, which needs the link to itself.
 THD_WORKING_AREA(waPrintDebugThread, 1024);
 THD_FUNCTION(PrintDebugThread, arg) {
     (void)arg;
 
-    while(true) { // execute at 10hz
-        // Print a line saying the variable names every 1s
-        // if(count == DEBUG_PRINT_FREQ) {
-        //     Serial << "odrv0.axis0.pos_estimate\todrv0.axis1.pos_estimate\n";
-        //     count = 0;
-        // }
-
-        if (enable_debug) {
-            // Print leg positions
-            PrintODriveDebugInfo(global_debug_values.odrv0);
-            Serial << '\t';
-            PrintODriveDebugInfo(global_debug_values.odrv1);
-            Serial << '\t';
-            PrintODriveDebugInfo(global_debug_values.odrv2);
-            Serial << '\t';
-            PrintODriveDebugInfo(global_debug_values.odrv3);
-            Serial << '\t';
-            Serial << global_debug_values.imu.pitch;
-            Serial.println();
+    uint32_t period = 0;
+
+    while(true) {
+        if (enable_debug && !FlightRecorderDumping()) {
+            SendTelemetryFrame(period++);
         }
 
-        chThdSleepMilliseconds(1000/DEBUG_PRINT_FREQ);
-    }
-}
-
-void PrintODriveDebugInfo(struct ODrive odrv) {
-    Serial.print(odrv.sp_theta, 2);
-    Serial.print("\t");
-    Serial.print(odrv.est_theta, 2);
-    Serial.print("\t");
-    Serial.print(odrv.sp_gamma, 2);
-    Serial.print("\t");
-    Serial.print(odrv.est_gamma, 2);
-    // Serial.printf("odrv%d: sp_th %.2f est_th %.2f sp_ga %.2f est_ga %.2f",
-    //               odrvNum, odrv.sp_theta, 0.0,//odrv.est_theta,
-    //               odrv.sp_gamma, 0.0);//odrv.est_gamma);
-    // Serial.print()
-    // Serial.print(odrv.sp_theta, 2);
-    // Serial.print('\t');
-    // Serial.print(odrv.est_theta, 2);
-    // Serial.print('\t');
-    // Serial.print(odrv.sp_gamma, 2);
-    // Serial.print('\t');
-    // Serial.print(odrv.est_gamma, 2);
+        chThdSleepMicroseconds(1000000/TELEMETRY_FREQ);
+    }
+}
+
+/**
+ * Build and send one TELEMETRY_CHANNELS frame with every subscribed channel
+ * due in this period. If the transmit buffer can't take the whole frame it is
+ * dropped instead of waiting on the UART.
+ * @param period Frame period counter, used for decimation
+ * @return True if a frame was due
+ */
+bool SendTelemetryFrame(uint32_t period) {
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+
+    TelemetryHeader header;
+    header.type = TELEMETRY_CHANNELS;
+    header.seq = telemetry_seq;
+    header.t_us = micros();
+    memcpy(frame, &header, sizeof(header));
+
+    uint32_t mask = 0;
+    size_t len = sizeof(header) + sizeof(mask);
+    int i = 0;
+    #define X(name, expr, scale) \
+        if (telemetry_decimation[i] != 0 && period % telemetry_decimation[i] == 0) { \
+            int16_t q = TelemetryQuantize((float)(expr), scale); \
+            memcpy(frame + len, &q, sizeof(q)); \
+            len += sizeof(q); \
+            mask |= 1UL << i; \
+        } \
+        i++;
+    TELEMETRY_CHANNELS(X)
+    #undef X
+    if (mask == 0) {
+        return false;
+    }
+    memcpy(frame + sizeof(header), &mask, sizeof(mask));
+
+    SendTelemetry(frame, len);
+    return true;
+}
+
+/**
+ * Add the CRC to a frame, COBS encode it and send it, or drop it if the
+ * transmit buffer is full. Advances the sequence number either way so the
+ * host sees the gap.
+ * @param frame Header and payload, with 2 spare bytes at the end for the CRC
+ * @param len   Header and payload length
+ */
+static void SendTelemetry(uint8_t* frame, size_t len) {
+    telemetry_seq++;
+
+    uint16_t crc = TelemetryCrc16(frame, len);
+    memcpy(frame + len, &crc, sizeof(crc));
+    len += sizeof(crc);
+
+    uint8_t wire[TELEMETRY_WIRE_SIZE(TELEMETRY_MAX_FRAME)];
+    size_t wire_len = TelemetryCobsEncode(frame, len, wire);
+    if (Serial.availableForWrite() < (int)wire_len) {
+        telemetry_dropped_frames++;
+        return;
+    }
+    Serial.write(wire, wire_len);
+}
+
+/**
+ * Answer a binary host command.
+ * @param command Command type
+ * @param seq     Sequence number the host sent with the command
+ * @param status  CommandStatus
+ */
+void SendTelemetryAck(uint8_t command, uint8_t seq, uint8_t status) {
+    uint8_t frame[sizeof(TelemetryHeader) + sizeof(TelemetryAckPayload) + 2];
+
+    TelemetryHeader header;
+    header.type = TELEMETRY_ACK;
+    header.seq = telemetry_seq;
+    header.t_us = micros();
+    memcpy(frame, &header, sizeof(header));
+
+    TelemetryAckPayload ack;
+    ack.command = command;
+    ack.seq = seq;
+    ack.status = status;
+    memcpy(frame + sizeof(header), &ack, sizeof(ack));
+
+    SendTelemetry(frame, sizeof(header) + sizeof(ack));
+}
+
+/**
+ * Answer a trajectory point with the state of the trajectory buffer.
+ * @param seq    Sequence number the host sent with the point
+ * @param status CommandStatus
+ */
+void SendTelemetryTrajectoryAck(uint8_t seq, uint8_t status) {
+    uint8_t frame[sizeof(TelemetryHeader) + sizeof(TelemetryTrajectoryAckPayload) + 2];
+
+    TelemetryHeader header;
+    header.type = TELEMETRY_TRAJECTORY_ACK;
+    header.seq = telemetry_seq;
+    header.t_us = micros();
+    memcpy(frame, &header, sizeof(header));
+
+    TelemetryTrajectoryAckPayload ack;
+    ack.seq = seq;
+    ack.status = status;
+    ack.free = TrajectoryFree();
+    ack.play_t_ms = trajectory_play_t_ms;
+    ack.underruns = trajectory_underruns;
+    memcpy(frame + sizeof(header), &ack, sizeof(ack));
+
+    SendTelemetry(frame, sizeof(header) + sizeof(ack));
+}
+
+/**
+ * Set the decimation of every channel matching pattern. A pattern ending in
+ * '*' matches all channels starting with the text before it.
+ * @param pattern    Channel name or prefix*
+ * @param decimation Send every Nth frame period, 0 to unsubscribe
+ * @return Number of channels matched
+ */
+int TelemetrySubscribe(const char* pattern, uint8_t decimation) {
+    size_t len = strlen(pattern);
+    bool prefix = len > 0 && pattern[len - 1] == '*';
+    if (prefix) {
+        len--;
+    }
+
+    int matched = 0;
+    for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+        bool match = prefix ? strncmp(channel_names[i], pattern, len) == 0
+                            : strcmp(channel_names[i], pattern) == 0;
+        if (match) {
+            telemetry_decimation[i] = decimation;
+            matched++;
+        }
+    }
+    return matched;
+}
+
+/**
+ * Subscribe the default channels every TELEMETRY_DEFAULT_DECIMATION periods
+ * if nothing is subscribed, so the 'D' toggle on its own still streams the
+ * leg and pitch values.
+ */
+void TelemetrySubscribeDefaults() {
+    for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+        if (telemetry_decimation[i] != 0) {
+            return;
+        }
+    }
+    for (int i = 0; i < TELEMETRY_DEFAULT_CHANNELS; i++) {
+        telemetry_decimation[i] = TELEMETRY_DEFAULT_DECIMATION;
+    }
+}
+
+/**
+ * Print every channel with its current rate, and the link bandwidth the
+ * current subscription needs.
+ */
+void PrintTelemetryChannels() {
+    // One console message per line of six channels
+    for (int line = 0; line < TELEMETRY_CHANNEL_COUNT; line += 6) {
+        ConsoleMessage msg;
+        for (int i = line; i < line + 6 && i < TELEMETRY_CHANNEL_COUNT; i++) {
+            msg << channel_names[i];
+            if (telemetry_decimation[i] != 0) {
+                msg << " " << (float)TELEMETRY_FREQ / telemetry_decimation[i] << "Hz";
+            }
+            msg << "\t";
+        }
+        msg << "\n";
+    }
+
+    // Walk one second of frame periods to count what would be sent
+    // Header, mask, CRC, COBS overhead and delimiters per frame
+    const int FRAME_OVERHEAD = sizeof(TelemetryHeader) + sizeof(uint32_t) + 2 + 3;
+    uint32_t bytes_per_s = 0;
+    for (int period = 0; period < TELEMETRY_FREQ; period++) {
+        uint32_t frame_bytes = 0;
+        for (int i = 0; i < TELEMETRY_CHANNEL_COUNT; i++) {
+            if (telemetry_decimation[i] != 0 && period % telemetry_decimation[i] == 0) {
+                frame_bytes += sizeof(int16_t);
+            }
+        }
+        if (frame_bytes > 0) {
+            bytes_per_s += frame_bytes + FRAME_OVERHEAD;
+        }
+    }
+    ConsoleMessage() << "Telemetry uses " << bytes_per_s << " of " << SERIAL_BAUD / 10 << " bytes/s\n";
 }
@@ -1,12 +1,19 @@
 #ifndef DEBUG_H
 #define DEBUG_H
 
-#include "ChRT.h"
+#include "ChRt.h"
 #include "globals.h"
 
 extern THD_WORKING_AREA(waPrintDebugThread, 1024);
 extern THD_FUNCTION(PrintDebugThread, arg);
 
-void PrintODriveDebugInfo(struct ODrive odrv);
+bool SendTelemetryFrame(uint32_t period);
+void SendTelemetryAck(uint8_t command, uint8_t seq, uint8_t status);
+void SendTelemetryTrajectoryAck(uint8_t seq, uint8_t status);
+int TelemetrySubscribe(const char* pattern, uint8_t decimation);
+void TelemetrySubscribeDefaults();
+void PrintTelemetryChannels();
+
+extern volatile uint32_t telemetry_dropped_frames;
 
 #endif
@@ -0,0 +1,225 @@
+#include "flight_recorder.h"
+#include "Arduino.h"
+#include "ChRt.h"
+#include "config.h"
+#include "globals.h"
+#include "cycle_counter.h"
+#include "position_control.h"
+#include "imu.h"
+
+//------------------------------------------------------------------------------
+// Flight recorder: keeps the last FLIGHT_RECORDER_RECORDS control ticks and IMU
+// samples in RAM. A trigger (jump, flip, stop command, ODrive link fault)
+// records FLIGHT_RECORDER_POST_MS more data and then freezes the ring. The
+// flight recorder thread dumps the frozen window over serial and re-arms.
+// Recording is a handful of stores, so it can run on every tick.
+
+enum FlightRecorderState {
+    FR_ARMED,
+    FR_TRIGGERED,
+    FR_FROZEN
+};
+
+static FlightRecord fr_ring[FLIGHT_RECORDER_RECORDS];
+static volatile uint32_t fr_count = 0; // Total entries ever recorded
+static volatile FlightRecorderState fr_state = FR_ARMED;
+static volatile FlightRecorderReason fr_reason = FR_REASON_JUMP;
+static volatile uint32_t fr_trigger_us = 0;
+static bool fr_link_up = false;
+static uint32_t fr_prev_tick_us = 0;
+
+volatile uint32_t flight_recorder_max_cycles = 0;
+
+static const char* const fr_reason_names[] = {"JUMP", "FLIP", "ESTOP", "LINK_FAULT", "SCRIPT"};
+
+/**
+ * Claim the next slot in the ring, or NULL once the ring is frozen. Also
+ * freezes the ring once the post-trigger window has been recorded.
+ */
+static FlightRecord* FlightRecorderNext(uint32_t t_us) {
+    if (fr_state == FR_FROZEN) {
+        return NULL;
+    }
+    if (fr_state == FR_TRIGGERED &&
+        (int32_t)(t_us - fr_trigger_us) > (int32_t)(FLIGHT_RECORDER_POST_MS * 1000L)) {
+        fr_state = FR_FROZEN;
+        return NULL;
+    }
+    FlightRecord* r = &fr_ring[fr_count % FLIGHT_RECORDER_RECORDS];
+    fr_count++;
+    r->t_us = t_us;
+    return r;
+}
+
+static inline void FlightRecorderCycles(uint32_t start) {
+    uint32_t cycles = CycleCount() - start;
+    if (cycles > flight_recorder_max_cycles) {
+        flight_recorder_max_cycles = cycles;
+    }
+}
+
+/**
+ * Record the outcome of a control tick. Called by the control thread after
+ * every tick. Also watches for ODrive replies stopping (link fault).
+ * @param tick_start_us micros() at the start of the control tick
+ * @param tick_us       Time spent in the control tick (us)
+ */
+void FlightRecorderRecordTick(uint32_t tick_start_us, uint32_t tick_us) {
+    if (!ENABLE_FLIGHT_RECORDER) {
+        return;
+    }
+    uint32_t start = CycleCount();
+
+    // The ODrives reply to every command, so replies stopping while ticks keep
+    // coming is a link fault. Long blocking ticks (hop, reset) send nothing
+    // while they sleep, so the check is skipped right after one.
+    const uint32_t link_timeout_us = FLIGHT_RECORDER_LINK_TIMEOUT_MS * 1000UL;
+    if (tick_start_us - fr_prev_tick_us < link_timeout_us) {
+        bool link_up = tick_start_us - (uint32_t)latest_receive_timestamp < link_timeout_us;
+        if (fr_link_up && !link_up) {
+            FlightRecorderTrigger(FR_REASON_LINK_FAULT);
+        }
+        fr_link_up = link_up;
+    }
+    fr_prev_tick_us = tick_start_us;
+
+    FlightRecord* r = FlightRecorderNext(tick_start_us);
+    if (r == NULL) {
+        return;
+    }
+    r->type = FR_CONTROL_TICK;
+    r->state = state;
+    r->tick_us = tick_us > 0xFFFF ? 0xFFFF : tick_us;
+    const struct ODrive* legs[4] = {&global_debug_values.odrv0, &global_debug_values.odrv1,
+                                    &global_debug_values.odrv2, &global_debug_values.odrv3};
+    for (int i = 0; i < 4; i++) {
+        r->tick.sp_theta[i] = legs[i]->sp_theta * 1000.0f;
+        r->tick.sp_gamma[i] = legs[i]->sp_gamma * 1000.0f;
+        r->tick.est_theta[i] = legs[i]->est_theta * 1000.0f;
+        r->tick.est_gamma[i] = legs[i]->est_gamma * 1000.0f;
+    }
+    struct Attitude attitude;
+    uint32_t imu_age_us = IMUPredictAttitude(tick_start_us, attitude);
+    r->tick.pitch = attitude.pitch;
+    r->tick.imu_age_us = imu_age_us > 0xFFFF ? 0xFFFF : imu_age_us;
+    FlightRecorderCycles(start);
+}
+
+/**
+ * Record one IMU sample. Called by the IMU thread for every sample it uses.
+ */
+void FlightRecorderRecordIMU(uint32_t t_us, float pitch, float gyro_y, float accel_x, float accel_z) {
+    if (!ENABLE_FLIGHT_RECORDER) {
+        return;
+    }
+    uint32_t start = CycleCount();
+    FlightRecord* r = FlightRecorderNext(t_us);
+    if (r == NULL) {
+        return;
+    }
+    r->type = FR_IMU_SAMPLE;
+    r->state = state;
+    r->tick_us = 0;
+    r->imu.pitch = pitch;
+    r->imu.gyro_y = gyro_y;
+    r->imu.accel_x = accel_x;
+    r->imu.accel_z = accel_z;
+    FlightRecorderCycles(start);
+}
+
+/**
+ * Mark an event of interest. The ring keeps recording for
+ * FLIGHT_RECORDER_POST_MS and is then dumped. Triggers that arrive while a
+ * previous event is still being recorded or dumped are ignored.
+ */
+void FlightRecorderTrigger(FlightRecorderReason reason) {
+    if (!ENABLE_FLIGHT_RECORDER || fr_state != FR_ARMED) {
+        return;
+    }
+    fr_reason = reason;
+    fr_trigger_us = micros();
+    fr_state = FR_TRIGGERED;
+}
+
+/**
+ * @return True while the frozen ring is being dumped
+ */
+bool FlightRecorderDumping() {
+    return fr_state == FR_FROZEN;
+}
+
+/**
+ * Write a whole line to the serial port once its transmit buffer has room for
+ * it, like the console and telemetry writers, so their output lands between
+ * lines rather than inside one. Sleeps this thread while waiting so the others
+ * keep running. Needs a transmit buffer longer than a line, which
+ * XBEE_TX_BUFFER_SIZE gives.
+ */
+static void FlightRecorderWrite(const char* line) {
+    int len = strlen(line);
+    while (Serial.availableForWrite() < len) {
+        chThdSleepMilliseconds(1);
+    }
+    Serial.write((const uint8_t*)line, len);
+}
+
+/**
+ * Dump the frozen window as text lines:
+ *   FR,BEGIN,<reason>,<trigger us>,<entries>,<max record cycles>
+ *   FR,T,<t us>,<state>,<tick us>,{sp_theta,sp_gamma,est_theta,est_gamma}x4 (mrad),<pitch 1e-4 rad>,<imu age us>
+ *   FR,I,<t us>,<state>,<pitch 1e-4 rad>,<gyro_y mrad/s>,<accel_x mm/s^2>,<accel_z mm/s^2>
+ *   FR,END
+ */
+static void FlightRecorderDump() {
+    char line[160];
+    uint32_t count = fr_count;
+    uint32_t first = count > FLIGHT_RECORDER_RECORDS ? count - FLIGHT_RECORDER_RECORDS : 0;
+    uint32_t window_start = fr_trigger_us - FLIGHT_RECORDER_PRE_MS * 1000UL;
+
+    // Skip entries older than the pre-trigger window
+    while (first < count &&
+           (int32_t)(fr_ring[first % FLIGHT_RECORDER_RECORDS].t_us - window_start) < 0) {
+        first++;
+    }
+
+    snprintf(line, sizeof(line), "FR,BEGIN,%s,%lu,%lu,%lu\n", fr_reason_names[fr_reason],
+             (unsigned long)fr_trigger_us, (unsigned long)(count - first),
+             (unsigned long)flight_recorder_max_cycles);
+    FlightRecorderWrite(line);
+
+    for (uint32_t i = first; i < count; i++) {
+        const FlightRecord& r = fr_ring[i % FLIGHT_RECORDER_RECORDS];
+        if (r.type == FR_CONTROL_TICK) {
+            int n = snprintf(line, sizeof(line), "FR,T,%lu,%u,%u", (unsigned long)r.t_us,
+                             r.state, r.tick_us);
+            for (int leg = 0; leg < 4; leg++) {
+                n += snprintf(line + n, sizeof(line) - n, ",%d,%d,%d,%d",
+                              r.tick.sp_theta[leg], r.tick.sp_gamma[leg],
+                              r.tick.est_theta[leg], r.tick.est_gamma[leg]);
+            }
+            snprintf(line + n, sizeof(line) - n, ",%ld,%u\n", lroundf(r.tick.pitch * 10000.0f),
+                     r.tick.imu_age_us);
+        } else {
+            snprintf(line, sizeof(line), "FR,I,%lu,%u,%ld,%ld,%ld,%ld\n", (unsigned long)r.t_us,
+                     r.state, lroundf(r.imu.pitch * 10000.0f), lroundf(r.imu.gyro_y * 1000.0f),
+                     lroundf(r.imu.accel_x * 1000.0f), lroundf(r.imu.accel_z * 1000.0f));
+        }
+        FlightRecorderWrite(line);
+    }
+    FlightRecorderWrite("FR,END\n");
+}
+
+THD_WORKING_AREA(waFlightRecorderThread, 1024);
+
+THD_FUNCTION(FlightRecorderThread, arg) {
+    (void)arg;
+
+    while(true) {
+        if (fr_state == FR_FROZEN) {
+            FlightRecorderDump();
+            fr_count = 0;
+            fr_state = FR_ARMED;
+        }
+        chThdSleepMilliseconds(FLIGHT_RECORDER_POLL_MS);
+    }
+}
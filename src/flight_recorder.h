@@ -0,0 +1,54 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include "ChRt.h"
+
+extern THD_WORKING_AREA(waFlightRecorderThread, 1024);
+extern THD_FUNCTION(FlightRecorderThread, arg);
+
+// Why the flight recorder froze its buffer
+enum FlightRecorderReason {
+    FR_REASON_JUMP = 0,
+    FR_REASON_FLIP = 1,
+    FR_REASON_ESTOP = 2,
+    FR_REASON_LINK_FAULT = 3,
+    FR_REASON_SCRIPT = 4
+};
+
+enum FlightRecordType {
+    FR_CONTROL_TICK = 0,
+    FR_IMU_SAMPLE = 1
+};
+
+// One entry in the flight recorder ring. Leg angles are stored in mrad, the
+// same resolution the ODrives use, to keep the ring small.
+struct FlightRecord {
+    uint32_t t_us;
+    uint8_t type; // FlightRecordType
+    uint8_t state;
+    uint16_t tick_us;
+    union {
+        struct {
+            int16_t sp_theta[4], sp_gamma[4];
+            int16_t est_theta[4], est_gamma[4];
+            float pitch;         // Extrapolated to the start of the tick
+            uint16_t imu_age_us; // Age of the IMU sample it was extrapolated from
+        } tick;
+        struct {
+            float pitch;
+            float gyro_y;
+            float accel_x;
+            float accel_z;
+        } imu;
+    };
+};
+
+void FlightRecorderRecordTick(uint32_t tick_start_us, uint32_t tick_us);
+void FlightRecorderRecordIMU(uint32_t t_us, float pitch, float gyro_y, float accel_x, float accel_z);
+void FlightRecorderTrigger(FlightRecorderReason reason);
+bool FlightRecorderDumping();
+
+// Most cycles spent recording a single entry
+extern volatile uint32_t flight_recorder_max_cycles;
+
+#endif
@@ -0,0 +1,83 @@
+#include "foot_forces.h"
+#include <math.h>
+#include "config.h"
+#include "globals.h"
+#include "imu.h"
+#include "impedance.h"
+#include "kinematics.h"
+#include "state_estimator.h"
+#include "stance_forces.h"
+#include "cycle_counter.h"
+
+struct FootForce foot_forces[4];
+volatile uint32_t stance_solver_cycles = 0;
+volatile uint32_t stance_solver_max_cycles = 0;
+volatile uint32_t stance_solver_overruns = 0;
+
+static const float GRAVITY = 9.81f;
+
+static struct StanceForceSolver<4> solver;
+static const struct StanceForceParams solver_params = {
+    STANCE_FRICTION, STANCE_MIN_FORCE, STANCE_FORCE_WEIGHT, STANCE_TORQUE_WEIGHT,
+    STANCE_REGULARIZATION, STANCE_SOLVER_ITERATIONS
+};
+
+/**
+ * Estimate the foot forces and set the stance feedforward. Called by the
+ * control thread every tick, after StateEstimatorUpdate has found the stance
+ * feet.
+ * @param t_us Start of the control tick
+ */
+void FootForcesUpdate(uint32_t t_us) {
+    if (!ENABLE_IMPEDANCE_CONTROL) {
+        return;
+    }
+    const struct ODrive* legs[4] = {&global_debug_values.odrv0, &global_debug_values.odrv1,
+                                    &global_debug_values.odrv2, &global_debug_values.odrv3};
+    struct Attitude attitude;
+    IMUPredictAttitude(t_us, attitude);
+    float c = cosf(attitude.pitch), s = sinf(attitude.pitch);
+
+    // Carry the weight and push pitch back to level
+    struct BodyWrench desired;
+    desired.fx = 0;
+    desired.fz = ROBOT_MASS * GRAVITY;
+    desired.torque = -STANCE_PITCH_KP * attitude.pitch - STANCE_PITCH_KD * attitude.pitch_rate;
+
+    for (int i = 0; i < 4; i++) {
+        float theta = legs[i]->est_theta;
+        float gamma = legs[i]->est_gamma;
+
+        float current0, current1;
+        ImpedanceReadCurrents(i, current0, current1);
+        LegCurrentsToFootForce(theta, gamma, LEG_DIRECTION[i], current0, current1,
+                               foot_forces[i].fx, foot_forces[i].fy);
+
+        // Foot relative to the body centre, turned into the world frame
+        LegFootInWorld(i, theta, gamma, c, s, solver.foot_x[i], solver.foot_z[i]);
+        solver.max_vertical[i] = 0;
+        if (body_state.stance & (1 << i)) {
+            solver.max_vertical[i] = StanceForceMaxVertical(theta, gamma, LEG_DIRECTION[i], attitude.pitch,
+                                                            STANCE_FRICTION, STANCE_CURRENT_LIM);
+        }
+    }
+
+    uint32_t start = CycleCount();
+    StanceForceSolve(solver, desired, solver_params);
+    uint32_t cycles = CycleCount() - start;
+    stance_solver_cycles = cycles;
+    if (cycles > stance_solver_max_cycles) {
+        stance_solver_max_cycles = cycles;
+    }
+    if (cycles > STANCE_SOLVER_BUDGET_CYCLES) {
+        stance_solver_overruns++;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        float fx, fy, ff_theta, ff_gamma;
+        GroundReactionToFootForce(solver.rx[i], solver.rz[i], attitude.pitch, fx, fy);
+        LegFootForceToCurrents(legs[i]->est_theta, legs[i]->est_gamma, LEG_DIRECTION[i], fx, fy,
+                               ff_theta, ff_gamma);
+        ImpedanceSetFeedforward(i, ff_theta, ff_gamma);
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef FOOT_FORCES_H
+#define FOOT_FORCES_H
+
+#include <stdint.h>
+
+// Foot forces from the leg Jacobians (src/kinematics.h), updated by the
+// control thread every tick after the state estimator. With the impedance
+// controller on, the force each foot pushes with is estimated from the
+// currents it commanded. The stance feet get feedforward current for the
+// ground forces that carry the robot's weight and hold its pitch level,
+// shared out by the solver in src/stance_forces.h. The ODrives don't report
+// their currents, so without it the estimates stay 0.
+
+// Force the foot applies to the ground, leg frame (N), see kinematics.h
+struct FootForce {
+    float fx, fy;
+};
+
+void FootForcesUpdate(uint32_t t_us);
+
+extern struct FootForce foot_forces[4];
+
+// Cycles taken by the latest stance force solve, the most taken by any and
+// the number over STANCE_SOLVER_BUDGET_CYCLES
+extern volatile uint32_t stance_solver_cycles;
+extern volatile uint32_t stance_solver_max_cycles;
+extern volatile uint32_t stance_solver_overruns;
+
+#endif
@@ -0,0 +1,131 @@
+#include "gait_kernels.h"
+#include "Arduino.h"
+#include "config.h"
+#include "console.h"
+#include "cycle_counter.h"
+#include "gait_params.h"
+#include "gait_patterns.h"
+
+/**
+ * Setpoints of all four legs for any gait: the computation the kernels are
+ * specialized from. Used for gaits defined at runtime and while switching
+ * gaits, and to benchmark the kernels against.
+ * @param offset Where each leg is in the gait cycle, usually g.offset
+ * @param t Time (s), millis()/1000
+ */
+void GaitSetpointsGeneric(const struct GaitDescriptor& g, const float offset[4], const struct GaitParams& params,
+                          float t, float theta[4], float gamma[4]) {
+    float p = GaitPhaseAdvance(t, params.freq);
+    float flight_percent = g.duty > 0 ? 1.0f - g.duty : params.flight_percent;
+    for (int i = 0; i < 4; i++) {
+        float step_length = i < 2 ? params.step_length + params.step_diff : params.step_length - params.step_diff;
+        float gp = fmod((p + offset[i]), 1.0);
+        float x, y;
+        GaitFootAt(gp, params, step_length, flight_percent, g.swing, g.stance, x, y);
+        CartesianToThetaGamma(x, y, LEG_DIRECTION[i], theta[i], gamma[i]);
+    }
+}
+
+// SinTrajectory as the gaits used it before descriptors, for GaitSetpointsPerLeg
+static void SinTrajectoryPerLeg(float t, struct GaitParams params, float gaitOffset, float& x, float& y) {
+    float stanceHeight = params.stance_height;
+    float downAMP = params.down_amp;
+    float upAMP = params.up_amp;
+    float flightPercent = params.flight_percent;
+    float stepLength = params.step_length;
+    float FREQ = params.freq;
+
+    float p = GaitPhaseAdvance(t, FREQ);
+
+    float gp = fmod((p+gaitOffset),1.0); // mod(a,m) returns remainder division of a by m
+    if (gp <= flightPercent) {
+        x = (gp/flightPercent)*stepLength - stepLength/2.0;
+        y = -upAMP*sin(PI*gp/flightPercent) + stanceHeight;
+    }
+    else {
+        float percentBack = (gp-flightPercent)/(1.0-flightPercent);
+        x = -percentBack*stepLength + stepLength/2.0;
+        y = downAMP*sin(PI*percentBack) + stanceHeight;
+    }
+}
+
+// CoupledMoveLeg without the sending
+static void MoveLegPerLeg(float t, struct GaitParams params, float gait_offset, float leg_direction,
+                          float& theta, float& gamma) {
+    float x;
+    float y;
+    SinTrajectoryPerLeg(t, params, gait_offset, x, y);
+    CartesianToThetaGamma(x, y, leg_direction, theta, gamma);
+}
+
+/**
+ * The per-leg computation the gaits ran before they were descriptors (gait(),
+ * CoupledMoveLeg and SinTrajectory), kept as the baseline GaitBenchmark
+ * measures against: each leg copies the parameters, asks for the gait cycle
+ * and solves its own trajectory and inverse kinematics. Only the sending is
+ * left out, as no path being timed sends. It only knows the sine swing and
+ * stance with the flight proportion from params, ie the built-in gaits.
+ * @param t Time (s), millis()/1000
+ */
+void GaitSetpointsPerLeg(const struct GaitDescriptor& g, struct GaitParams params, float t,
+                         float theta[4], float gamma[4]) {
+    struct GaitParams paramsR = params;
+    struct GaitParams paramsL = params;
+    paramsR.step_length -= params.step_diff;
+    paramsL.step_length += params.step_diff;
+
+    MoveLegPerLeg(t, paramsL, g.offset[0], LEG_DIRECTION[0], theta[0], gamma[0]);
+    MoveLegPerLeg(t, paramsL, g.offset[1], LEG_DIRECTION[1], theta[1], gamma[1]);
+    MoveLegPerLeg(t, paramsR, g.offset[2], LEG_DIRECTION[2], theta[2], gamma[2]);
+    MoveLegPerLeg(t, paramsR, g.offset[3], LEG_DIRECTION[3], theta[3], gamma[3]);
+}
+
+/**
+ * Time the old per-leg code (GaitSetpointsPerLeg), GaitSetpointsGeneric and
+ * every gait kernel over GAIT_BENCHMARK_TICKS simulated control ticks, with
+ * each gait's published parameters, and check that all three compute the same
+ * setpoints. Only computes,
+ * nothing is sent to the ODrives, but it holds up the control thread for the
+ * whole run, so only call it in STOP.
+ */
+void GaitBenchmark() {
+    float start_t = millis()/1000.0;
+    for (int k = 0; k < num_gait_patterns; k++) {
+        const struct GaitPattern& e = gait_patterns[k];
+        if (e.kernel == NULL) {
+            continue;
+        }
+        struct GaitParams params;
+        struct LegGain gains;
+        GaitParamsRead(e.state, params, gains);
+
+        uint32_t per_leg_cycles = 0, generic_cycles = 0, kernel_cycles = 0;
+        int mismatches = 0;
+        for (int i = 0; i < GAIT_BENCHMARK_TICKS; i++) {
+            float t = start_t + (float)i / POSITION_CONTROL_FREQ;
+            float theta0[4], gamma0[4], theta1[4], gamma1[4], theta2[4], gamma2[4];
+            // The per-leg path moves the gait cycle to t, so all three
+            // compute the same point in it
+            uint32_t c0 = CycleCount();
+            GaitSetpointsPerLeg(e.gait, params, t, theta0, gamma0);
+            uint32_t c1 = CycleCount();
+            GaitSetpointsGeneric(e.gait, e.gait.offset, params, t, theta1, gamma1);
+            uint32_t c2 = CycleCount();
+            e.kernel(params, t, theta2, gamma2);
+            uint32_t c3 = CycleCount();
+            per_leg_cycles += c1 - c0;
+            generic_cycles += c2 - c1;
+            kernel_cycles += c3 - c2;
+            for (int j = 0; j < 4; j++) {
+                mismatches += theta0[j] != theta1[j] || gamma0[j] != gamma1[j];
+                mismatches += theta0[j] != theta2[j] || gamma0[j] != gamma2[j];
+            }
+        }
+        ConsoleMessage() << e.name << ": per-leg " << per_leg_cycles / GAIT_BENCHMARK_TICKS
+                         << " cycles, generic " << generic_cycles / GAIT_BENCHMARK_TICKS
+                         << " cycles, kernel " << kernel_cycles / GAIT_BENCHMARK_TICKS << " cycles per tick"
+                         << (mismatches > 0 ? ", SETPOINTS DIFFER" : "") << "\n";
+    }
+    // Let the next tick carry on from now instead of the simulated time
+    GaitPhaseAdvance(millis()/1000.0, 0);
+}
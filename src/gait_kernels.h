@@ -0,0 +1,104 @@
+#ifndef GAIT_KERNELS_H
+#define GAIT_KERNELS_H
+
+#include <math.h>
+#include "Arduino.h"
+#include "ODriveArduino.h"
+#include "kinematics.h"
+#include "position_control.h"
+
+// Gaits described at compile time, and the leg kernels specialized for them.
+//
+// A GaitDescriptor is everything that sets one gait apart: where each leg is
+// in the cycle, the gains the gait starts with, and the
+// duty factor and foot path profiles. GaitSetpointsGeneric computes the
+// setpoints for any descriptor. GaitSetpoints<descriptor> runs the same
+// computation for one gait, and the only thing it specializes is which legs
+// move identically (same offset and side, GaitSameLeg): those
+// share one trajectory and inverse kinematics. The foot path and inverse
+// kinematics (GaitFootAt, CartesianToThetaGamma) are out of line in
+// position_control.cpp, so the profiles, duty factor and leg directions
+// (LEG_DIRECTION) are still passed to them at run time. Of the built-in gaits only PRONK has legs
+// to share, and only its kernel is measurably faster than the generic code.
+// The result is bit for bit that of GaitSetpointsGeneric. The 'C' command (GaitBenchmark) times both against
+// GaitSetpointsPerLeg, the per-leg code the gaits ran before descriptors.
+// src/gait_patterns.h picks which gait runs.
+
+struct GaitDescriptor {
+    float offset[4];       // Where each leg is in the gait cycle, odrv0 to odrv3
+    struct LegGain gains;  // Gains the gait starts with
+    float duty;            // Part of the cycle in stance, 0 to use 1 - flight_percent
+    GaitSwingProfile swing;
+    GaitStanceProfile stance;
+};
+
+constexpr struct GaitDescriptor trot_gait =
+    {{0.0, 0.5, 0.0, 0.5}, {80, 0.5, 50, 0.5}, 0.0f, SWING_SINE, STANCE_SINE};
+constexpr struct GaitDescriptor turn_trot_gait =
+    {{0.0, 0.5, 0.0, 0.5}, {80, 0.5, 80, 0.5}, 0.0f, SWING_SINE, STANCE_SINE};
+constexpr struct GaitDescriptor bound_gait =
+    {{0.0, 0.5, 0.5, 0.0}, {80, 0.5, 50, 0.5}, 0.0f, SWING_SINE, STANCE_SINE};
+constexpr struct GaitDescriptor walk_gait =
+    {{0.0, 0.25, 0.75, 0.5}, {80, 0.5, 50, 0.5}, 0.0f, SWING_SINE, STANCE_SINE};
+constexpr struct GaitDescriptor pronk_gait =
+    {{0.0, 0.0, 0.0, 0.0}, {80, 0.5, 50, 0.5}, 0.0f, SWING_SINE, STANCE_SINE};
+constexpr struct GaitDescriptor dance_gait =
+    {{0.0, 0.5, 0.0, 0.5}, {50, 0.5, 30, 0.5}, 0.0f, SWING_SINE, STANCE_SINE};
+
+// Setpoints of all four legs at time t (s, millis()/1000)
+typedef void (*GaitSetpointsFunction)(const struct GaitParams& params, float t, float theta[4], float gamma[4]);
+
+void GaitSetpointsGeneric(const struct GaitDescriptor& g, const float offset[4], const struct GaitParams& params,
+                          float t, float theta[4], float gamma[4]);
+void GaitSetpointsPerLeg(const struct GaitDescriptor& g, struct GaitParams params, float t,
+                         float theta[4], float gamma[4]);
+
+/**
+ * Earlier leg whose setpoint a leg can reuse: same offset and side (odrv0
+ * and odrv1 take the left step length, odrv2 and odrv3 the right, and each
+ * side has one LEG_DIRECTION).
+ * @return Its index, or -1 if there is none
+ */
+constexpr int GaitSameLeg(const struct GaitDescriptor& g, int leg) {
+    for (int j = 0; j < leg; j++) {
+        if (g.offset[j] == g.offset[leg] && (j < 2) == (leg < 2)) {
+            return j;
+        }
+    }
+    return -1;
+}
+
+template <const struct GaitDescriptor& G, int Leg>
+inline void GaitLegSetpoint(float p, const struct GaitParams& params, float step_length,
+                            float theta[4], float gamma[4]) {
+    constexpr int same = GaitSameLeg(G, Leg);
+    if (same >= 0) {
+        theta[Leg] = theta[same];
+        gamma[Leg] = gamma[same];
+        return;
+    }
+    float gp = fmod((p + G.offset[Leg]), 1.0);
+    float x, y;
+    GaitFootAt(gp, params, step_length, G.duty > 0 ? 1.0f - G.duty : params.flight_percent,
+               G.swing, G.stance, x, y);
+    CartesianToThetaGamma(x, y, LEG_DIRECTION[Leg], theta[Leg], gamma[Leg]);
+}
+
+/**
+ * Setpoints of all four legs for gait G.
+ * @param t Time (s), millis()/1000
+ */
+template <const struct GaitDescriptor& G>
+void GaitSetpoints(const struct GaitParams& params, float t, float theta[4], float gamma[4]) {
+    float p = GaitPhaseAdvance(t, params.freq);
+    float step_left = params.step_length + params.step_diff;
+    float step_right = params.step_length - params.step_diff;
+    GaitLegSetpoint<G, 0>(p, params, step_left, theta, gamma);
+    GaitLegSetpoint<G, 1>(p, params, step_left, theta, gamma);
+    GaitLegSetpoint<G, 2>(p, params, step_right, theta, gamma);
+    GaitLegSetpoint<G, 3>(p, params, step_right, theta, gamma);
+}
+
+void GaitBenchmark();
+
+#endif
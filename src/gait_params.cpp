@@ -0,0 +1,81 @@
+#include "gait_params.h"
+#include "Arduino.h"
+#include "console.h"
+
+// Everything the control loop reads, published as one unit
+struct GaitParamsSnapshot {
+    struct GaitParams params[sizeof(state_gait_params) / sizeof(state_gait_params[0])];
+    struct LegGain gains;
+};
+
+// Double buffer: commits fill the buffer that isn't active and then switch to
+// it, so readers copying the active buffer never see a partial update.
+static GaitParamsSnapshot published[2];
+static volatile uint8_t active = 0;
+volatile uint32_t gait_params_generation = 0;
+
+/**
+ * Check one state's staged parameters the way the gaits use them: the left and
+ * right legs' step lengths differ by step_diff. States without a gait (NAN
+ * stance height) are not checked.
+ */
+static bool IsValidStateParams(const struct GaitParams& params) {
+    if (isnan(params.stance_height)) {
+        return true;
+    }
+    struct GaitParams paramsR = params;
+    struct GaitParams paramsL = params;
+    paramsR.step_length -= params.step_diff;
+    paramsL.step_length += params.step_diff;
+    return IsValidGaitParams(paramsR) && IsValidGaitParams(paramsL);
+}
+
+/**
+ * Validate the staged gait parameters and gains and publish them. If anything
+ * is invalid nothing is published and the staged values are rolled back to
+ * the published ones, so a bad edit doesn't linger in the staging area.
+ * @return True if the staged values were published
+ */
+bool GaitParamsCommit() {
+    bool valid = IsValidLegGain(gait_gains);
+    for (size_t i = 0; valid && i < sizeof(state_gait_params) / sizeof(state_gait_params[0]); i++) {
+        valid = IsValidStateParams(state_gait_params[i]);
+    }
+
+    if (!valid && gait_params_generation > 0) {
+        const GaitParamsSnapshot& current = published[active];
+        memcpy(state_gait_params, current.params, sizeof(state_gait_params));
+        gait_gains = current.gains;
+        ConsoleMessage().println("Rejected, keeping previous gait parameters");
+        return false;
+    }
+
+    GaitParamsSnapshot& next = published[active ^ 1];
+    memcpy(next.params, state_gait_params, sizeof(state_gait_params));
+    next.gains = gait_gains;
+    gait_params_generation++;
+    active ^= 1;
+    return valid;
+}
+
+/**
+ * Copy the published parameters for one state and the published gains.
+ * @return Generation of the copied parameter set
+ */
+uint32_t GaitParamsRead(States s, struct GaitParams& params, struct LegGain& gains) {
+    uint32_t generation;
+    do {
+        generation = gait_params_generation;
+        const GaitParamsSnapshot& current = published[active];
+        params = current.params[s];
+        gains = current.gains;
+    } while (generation != gait_params_generation);
+    return generation;
+}
+
+/**
+ * Published gains, for readers that only need a quick look (telemetry, logs).
+ */
+const struct LegGain& GaitParamsPublishedGains() {
+    return published[active].gains;
+}
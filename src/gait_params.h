@@ -0,0 +1,23 @@
+#ifndef GAIT_PARAMS_H
+#define GAIT_PARAMS_H
+
+#include "ODriveArduino.h"
+#include "position_control.h"
+
+// Gait parameter store.
+//
+// state_gait_params and gait_gains are the staging area: commands and state
+// transitions edit them freely. GaitParamsCommit() validates the staged values
+// once and, if they are valid, publishes a copy for the control loop. The
+// control loop only reads published values through GaitParamsRead(), so it
+// never sees a half-edited or unvalidated parameter set and doesn't need to
+// validate them every tick.
+
+bool GaitParamsCommit();
+uint32_t GaitParamsRead(States s, struct GaitParams& params, struct LegGain& gains);
+const struct LegGain& GaitParamsPublishedGains();
+
+// Incremented every time a parameter set is published
+extern volatile uint32_t gait_params_generation;
+
+#endif
@@ -0,0 +1,168 @@
+#include "gait_patterns.h"
+#include <math.h>
+#include "Arduino.h"
+#include "config.h"
+#include "console.h"
+#include "gait_params.h"
+
+// Built-in gaits, ahead of the runtime patterns in gait_patterns
+static const int num_builtin_patterns = 6;
+
+struct GaitPattern gait_patterns[num_builtin_patterns + GAIT_PATTERN_SLOTS] = {
+    {"TROT", TROT, trot_gait, GaitSetpoints<trot_gait>, true},
+    {"TURN_TROT", TURN_TROT, turn_trot_gait, GaitSetpoints<turn_trot_gait>, true},
+    {"BOUND", BOUND, bound_gait, GaitSetpoints<bound_gait>, true},
+    {"WALK", WALK, walk_gait, GaitSetpoints<walk_gait>, true},
+    {"PRONK", PRONK, pronk_gait, GaitSetpoints<pronk_gait>, true},
+    {"DANCE", DANCE, dance_gait, GaitSetpoints<dance_gait>, true},
+};
+const int num_gait_patterns = sizeof(gait_patterns) / sizeof(gait_patterns[0]);
+
+// Pattern the engine runs, -1 before the first gait
+static int active = -1;
+// Leg offsets the last tick used, where a switch starts from
+static float leg_offset[4];
+// Set while the legs move to the active pattern's offsets
+static bool switching = false;
+static float switch_from[4];
+static float switch_phase;  // Gait cycle the switch started at
+static float last_phase;    // Gait cycle of the last tick
+
+/**
+ * Index of the built-in pattern that runs in state s.
+ * @return Its index, or -1 if s isn't a built-in gait
+ */
+int GaitPatternFind(States s) {
+    for (int i = 0; i < num_builtin_patterns; i++) {
+        if (gait_patterns[i].state == s) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Define runtime pattern index, replacing what was there. If it is running,
+ * the legs move over to the new definition like they would to another gait.
+ * @return False if index isn't a runtime pattern or g isn't valid
+ */
+bool GaitPatternDefine(int index, const struct GaitDescriptor& g) {
+    if (index < num_builtin_patterns || index >= num_gait_patterns) {
+        return false;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (!(g.offset[i] >= 0 && g.offset[i] < 1)) {
+            return false;
+        }
+    }
+    if (!(g.duty == 0 || (g.duty > 0 && g.duty < 1)) || !IsValidLegGain(g.gains)) {
+        return false;
+    }
+
+    struct GaitPattern& pattern = gait_patterns[index];
+    pattern.state = PATTERN;
+    pattern.gait = g;
+    pattern.kernel = NULL;
+    pattern.defined = true;
+    if (index == active && state == PATTERN) {
+        GaitPatternSelect(index);
+    }
+    return true;
+}
+
+/**
+ * Switch to a gait pattern: its state, its gains and the gait parameters
+ * staged in STOP. If a pattern is running, its legs move over to the new
+ * one's offsets from where they are.
+ * @return False if there is no such pattern
+ */
+bool GaitPatternSelect(int index) {
+    if (index < 0 || index >= num_gait_patterns || !gait_patterns[index].defined) {
+        return false;
+    }
+    const struct GaitPattern& pattern = gait_patterns[index];
+
+    bool running = active >= 0 && state == gait_patterns[active].state;
+    switching = false;
+    if (running && GAIT_SWITCH_CYCLES > 0) {
+        for (int i = 0; i < 4; i++) {
+            switch_from[i] = leg_offset[i];
+            switching = switching || leg_offset[i] != pattern.gait.offset[i];
+        }
+        switch_phase = last_phase;
+    }
+    active = index;
+
+    state = pattern.state;
+    // TROT should always go straight, whatever step difference was staged,
+    // however it was selected ('T', 'G' or a binary state frame)
+    if (state == TROT) {
+        state_gait_params[STOP].step_diff = NAN;
+        state_gait_params[TROT].step_diff = 0.0;
+    }
+    if (pattern.name != NULL) {
+        ConsoleMessage().println(pattern.name);
+    } else {
+        ConsoleMessage() << "PATTERN " << index << "\n";
+    }
+    UpdateStateGaitParams(state);
+    gait_gains = pattern.gait.gains;
+    GaitParamsCommit();
+    PrintGaitParams();
+    return true;
+}
+
+/**
+ * One control tick of the active pattern: compute and send the setpoints.
+ */
+void GaitPatternTick(const struct GaitParams& params, const struct LegGain& gains) {
+    if (active < 0) {
+        return;
+    }
+    const struct GaitPattern& pattern = gait_patterns[active];
+    float t = millis()/1000.0;
+    float p = GaitPhaseAdvance(t, params.freq);
+    last_phase = p;
+
+    if (switching) {
+        float progress = (p - switch_phase) / GAIT_SWITCH_CYCLES;
+        switching = progress < 1;
+        for (int i = 0; i < 4 && switching; i++) {
+            // Shortest way round the cycle, -0.5 to 0.5
+            float d = pattern.gait.offset[i] - switch_from[i];
+            d -= roundf(d);
+            float offset = switch_from[i] + progress * d;
+            leg_offset[i] = offset < 0 ? offset + 1 : (offset >= 1 ? offset - 1 : offset);
+        }
+    }
+    if (!switching) {
+        for (int i = 0; i < 4; i++) {
+            leg_offset[i] = pattern.gait.offset[i];
+        }
+    }
+
+    float theta[4], gamma[4];
+    if (pattern.kernel != NULL && !switching) {
+        pattern.kernel(params, t, theta, gamma);
+    } else {
+        GaitSetpointsGeneric(pattern.gait, leg_offset, params, t, theta, gamma);
+    }
+    CommandLegSetpoints(theta, gamma, gains);
+}
+
+/**
+ * Print the defined gait patterns, marking the active one.
+ */
+void PrintGaitPatterns() {
+    for (int i = 0; i < num_gait_patterns; i++) {
+        const struct GaitPattern& pattern = gait_patterns[i];
+        if (!pattern.defined) {
+            continue;
+        }
+        const struct GaitDescriptor& g = pattern.gait;
+        ConsoleMessage() << (i == active ? "*" : " ") << i << " " << (pattern.name != NULL ? pattern.name : "PATTERN")
+                         << ": offsets " << g.offset[0] << " " << g.offset[1] << " " << g.offset[2] << " " << g.offset[3]
+                         << ", duty " << g.duty << ", swing " << (int)g.swing << ", stance " << (int)g.stance << "\n";
+    }
+    ConsoleMessage() << "Runtime patterns: " << num_builtin_patterns << " to " << num_gait_patterns - 1 << "\n";
+}
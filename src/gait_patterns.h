@@ -0,0 +1,40 @@
+#ifndef GAIT_PATTERNS_H
+#define GAIT_PATTERNS_H
+
+#include "ODriveArduino.h"
+#include "gait_kernels.h"
+#include "position_control.h"
+
+// Gait pattern table: the gaits the gait engine can run.
+//
+// The built-in gaits come first, each with its compile-time kernel, then
+// GAIT_PATTERN_SLOTS entries defined at runtime with a COMMAND_GAIT_PATTERN
+// frame, which run in the PATTERN state with the generic setpoint code.
+// Switching gaits (GaitPatternSelect) just points the engine at another
+// entry, so a new gait needs a table entry rather than a new state, case in
+// PositionControlTick or TransitionTo* function.
+//
+// Switching is phase continuous. All gaits share one gait cycle
+// (GaitPhaseAdvance), and rather than jumping to the new gait's offsets, each
+// leg moves from where it is in the cycle to where the new gait puts it, the
+// short way round, over GAIT_SWITCH_CYCLES cycles. The generic code computes
+// the setpoints until then and the new gait's kernel afterwards.
+
+struct GaitPattern {
+    const char* name;              // NULL for runtime patterns
+    States state;                  // State it runs in
+    struct GaitDescriptor gait;
+    GaitSetpointsFunction kernel;  // NULL for runtime patterns
+    bool defined;
+};
+
+extern struct GaitPattern gait_patterns[];
+extern const int num_gait_patterns;
+
+int GaitPatternFind(States s);
+bool GaitPatternDefine(int index, const struct GaitDescriptor& g);
+bool GaitPatternSelect(int index);
+void GaitPatternTick(const struct GaitParams& params, const struct LegGain& gains);
+void PrintGaitPatterns();
+
+#endif
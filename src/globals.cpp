@@ -34,11 +34,14 @@ ODriveArduino odrv3Interface(odrv3Serial);
 volatile uint32_t count = 0;
 // Maximum time between idle cycles
 volatile uint32_t maxDelay = 0;
+// Time spent in the most recent position control tick (us)
+volatile uint32_t control_tick_us = 0;
 
 // The last time (in microseconds) that the Teensy sent a message to an ODrive
 volatile long latest_send_timestamp = 0;
 // The last time (in microseconds) that the Teensy received a message from an ODrive
 volatile long latest_receive_timestamp = 0;
+volatile long odrive_receive_timestamp[4] = {0, 0, 0, 0};
 
 // Struct to hold information helpful for debugging/printing to serial monitor
 struct DebugValues global_debug_values;
@@ -34,11 +34,15 @@ extern ODriveArduino odrv0Interface, odrv1Interface, odrv2Interface, odrv3Interf
 extern volatile uint32_t count;
 // Maximum time between idle cycles
 extern volatile uint32_t maxDelay;
+// Time spent in the most recent position control tick (us)
+extern volatile uint32_t control_tick_us;
 
 // The last time (in microseconds) that the Teensy sent a message to an ODrive
 extern volatile long latest_send_timestamp;
 // The last time (in microseconds) that the Teensy received a message from an ODrive
 extern volatile long latest_receive_timestamp;
+// The last time (in microseconds) that each ODrive's position reply arrived
+extern volatile long odrive_receive_timestamp[4];
 
 // Make structs to hold motor readings and setpoints
 struct ODrive {
@@ -0,0 +1,199 @@
+#include "impedance.h"
+#include "Arduino.h"
+#include "ODriveArduino.h"
+#include "config.h"
+#include "globals.h"
+#include "console.h"
+#include "kinematics.h"
+
+//------------------------------------------------------------------------------
+// ImpedanceThread: tracks the captured leg commands with current frames at
+// IMPEDANCE_FREQ. Does nothing unless ENABLE_IMPEDANCE_CONTROL is set.
+
+THD_WORKING_AREA(waImpedanceThread, 512);
+
+volatile uint32_t impedance_compute_us = 0;
+volatile uint32_t impedance_max_compute_us = 0;
+volatile uint32_t impedance_io_us = 0;
+volatile uint32_t impedance_max_io_us = 0;
+volatile uint32_t impedance_max_period_us = 0;
+volatile uint32_t impedance_overruns = 0;
+volatile uint32_t impedance_tx_skips = 0;
+
+// Start byte, length, 'C', two int16 currents and the checksum
+static const int CURRENT_FRAME_BYTES = 8;
+
+// Written by the control thread inside SetCoupledPosition. Threads are
+// cooperative, so this thread never sees a command half written.
+static struct CoupledPositionCommand commands[4];
+static float feedforward_theta[4], feedforward_gamma[4];
+// Motor currents last sent to each leg
+static float sent_current0[4], sent_current1[4];
+
+/**
+ * Add constant currents to a leg's theta and gamma, eg gravity compensation.
+ * Holds until changed.
+ * @param leg ODrive number, 0 to 3
+ */
+void ImpedanceSetFeedforward(int leg, float ff_theta, float ff_gamma) {
+    if (leg < 0 || leg >= 4) {
+        return;
+    }
+    feedforward_theta[leg] = ff_theta;
+    feedforward_gamma[leg] = ff_gamma;
+}
+
+/**
+ * Motor currents last sent to a leg (A), 0 before the first
+ * @param leg ODrive number, 0 to 3
+ */
+void ImpedanceReadCurrents(int leg, float& current0, float& current1) {
+    if (leg < 0 || leg >= 4) {
+        current0 = current1 = 0;
+        return;
+    }
+    current0 = sent_current0[leg];
+    current1 = sent_current1[leg];
+}
+
+THD_FUNCTION(ImpedanceThread, arg) {
+    (void)arg;
+
+    if (!ENABLE_IMPEDANCE_CONTROL) {
+        return;
+    }
+
+    ODriveArduino* odrives[4] = {&odrv0Interface, &odrv1Interface, &odrv2Interface, &odrv3Interface};
+    HardwareSerial* serials[4] = {&odrv0Serial, &odrv1Serial, &odrv2Serial, &odrv3Serial};
+    const struct ODrive* legs[4] = {&global_debug_values.odrv0, &global_debug_values.odrv1,
+                                    &global_debug_values.odrv2, &global_debug_values.odrv3};
+    for (int i = 0; i < 4; i++) {
+        odrives[i]->CaptureCoupledPosition(&commands[i]);
+    }
+
+    // Position and arrival time of the last reply from each ODrive. Replies
+    // come slower than this thread runs, so velocities are only updated when
+    // a new one arrives and held in between.
+    float prev_theta[4], prev_gamma[4];
+    uint32_t prev_receive_us[4];
+    float vel_theta[4] = {0, 0, 0, 0}, vel_gamma[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+        prev_theta[i] = legs[i]->est_theta;
+        prev_gamma[i] = legs[i]->est_gamma;
+        prev_receive_us[i] = odrive_receive_timestamp[i];
+    }
+
+    uint32_t prev_tick_us = micros();
+    uint32_t report_start_ms = millis();
+    uint32_t report_compute_us = 0, report_io_us = 0, report_period_us = 0;
+    uint32_t report_overruns = 0, report_skips = 0;
+
+    while (true) {
+        uint32_t tick_us = micros();
+        uint32_t period_us = tick_us - prev_tick_us;
+        prev_tick_us = tick_us;
+        if (period_us > impedance_max_period_us) {
+            impedance_max_period_us = period_us;
+        }
+        if (period_us > report_period_us) {
+            report_period_us = period_us;
+        }
+
+        float current0[4], current1[4];
+        for (int i = 0; i < 4; i++) {
+            float theta = legs[i]->est_theta;
+            float gamma = legs[i]->est_gamma;
+            uint32_t receive_us = odrive_receive_timestamp[i];
+            if (receive_us != prev_receive_us[i]) {
+                uint32_t reply_us = receive_us - prev_receive_us[i];
+                if (reply_us < IMPEDANCE_FEEDBACK_TIMEOUT_US) {
+                    float dt = reply_us * 1e-6f;
+                    vel_theta[i] += IMPEDANCE_VELOCITY_FILTER * ((theta - prev_theta[i]) / dt - vel_theta[i]);
+                    vel_gamma[i] += IMPEDANCE_VELOCITY_FILTER * ((gamma - prev_gamma[i]) / dt - vel_gamma[i]);
+                } else {
+                    // First reply after a gap, nothing recent to difference
+                    vel_theta[i] = 0;
+                    vel_gamma[i] = 0;
+                }
+                prev_theta[i] = theta;
+                prev_gamma[i] = gamma;
+                prev_receive_us[i] = receive_us;
+            }
+
+            // Without recent positions the PD terms would act on stale errors
+            bool feedback_ok = (uint32_t)(tick_us - receive_us) < IMPEDANCE_FEEDBACK_TIMEOUT_US;
+            const struct CoupledPositionCommand& c = commands[i];
+            if (!feedback_ok) {
+                current0[i] = 0;
+                current1[i] = 0;
+                continue;
+            }
+            float i_theta = c.gains.kp_theta * (c.sp_theta - theta) - c.gains.kd_theta * vel_theta[i]
+                            + feedforward_theta[i];
+            float i_gamma = c.gains.kp_gamma * (c.sp_gamma - gamma) - c.gains.kd_gamma * vel_gamma[i]
+                            + feedforward_gamma[i];
+            CoupledToMotorCurrents(i_theta, i_gamma, current0[i], current1[i]);
+            current0[i] = constrain(current0[i], -CURRENT_LIM, CURRENT_LIM);
+            current1[i] = constrain(current1[i], -CURRENT_LIM, CURRENT_LIM);
+        }
+
+        uint32_t io_start_us = micros();
+        bool sent = false;
+        for (int i = 0; i < 4; i++) {
+            // The ODrive keeps its own loop until the first command arrives
+            if (commands[i].count == 0) {
+                continue;
+            }
+            if (serials[i]->availableForWrite() < CURRENT_FRAME_BYTES) {
+                impedance_tx_skips++;
+                report_skips++;
+                continue;
+            }
+            odrives[i]->SetDualCurrent(current0[i], current1[i]);
+            sent_current0[i] = current0[i];
+            sent_current1[i] = current1[i];
+            sent = true;
+        }
+        uint32_t io_done_us = micros();
+        // The reply_us channel measures from here, so only a tick that sent
+        // something counts
+        if (sent) {
+            latest_send_timestamp = io_done_us;
+        }
+
+        uint32_t compute_us = io_start_us - tick_us;
+        uint32_t io_us = io_done_us - io_start_us;
+        impedance_compute_us = compute_us;
+        impedance_io_us = io_us;
+        if (compute_us > impedance_max_compute_us) {
+            impedance_max_compute_us = compute_us;
+        }
+        if (io_us > impedance_max_io_us) {
+            impedance_max_io_us = io_us;
+        }
+        if (compute_us > IMPEDANCE_COMPUTE_BUDGET_US || io_us > IMPEDANCE_IO_BUDGET_US) {
+            impedance_overruns++;
+            report_overruns++;
+        }
+        if (compute_us > report_compute_us) {
+            report_compute_us = compute_us;
+        }
+        if (io_us > report_io_us) {
+            report_io_us = io_us;
+        }
+
+        if (millis() - report_start_ms >= IMPEDANCE_REPORT_MS) {
+            ConsoleMessage() << "Impedance max us: compute " << report_compute_us << ", io " << report_io_us
+                             << ", period " << report_period_us << "; over budget " << report_overruns
+                             << ", skipped frames " << report_skips << "\n";
+            report_start_ms = millis();
+            report_compute_us = report_io_us = report_period_us = 0;
+            report_overruns = report_skips = 0;
+        }
+
+        // Sleep out the rest of the period
+        uint32_t busy_us = micros() - tick_us;
+        const uint32_t target_us = 1000000/IMPEDANCE_FREQ;
+        chThdSleepMicroseconds(busy_us < target_us ? target_us - busy_us : 1);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef IMPEDANCE_H
+#define IMPEDANCE_H
+
+#include "ChRt.h"
+#include <stdint.h>
+
+// Leg impedance controller on the Teensy. With ENABLE_IMPEDANCE_CONTROL set,
+// the coupled position commands of the control thread are captured instead of
+// sent (see ODriveArduino::CaptureCoupledPosition), and this thread tracks
+// them at IMPEDANCE_FREQ with 'C' current frames:
+//   i_theta = kp_theta (sp_theta - theta) - kd_theta d(theta)/dt + ff_theta
+// and the same for gamma, the law the ODrive firmware runs for 'S' frames, so
+// the gait gains keep their meaning. Feedforward currents can be added per leg.
+//
+// Compute time and the time spent handing frames to the UARTs are measured
+// every tick against IMPEDANCE_COMPUTE_BUDGET_US and IMPEDANCE_IO_BUDGET_US.
+// A frame that doesn't fit in its UART's transmit buffer is skipped rather
+// than waited for.
+
+extern THD_WORKING_AREA(waImpedanceThread, 512);
+extern THD_FUNCTION(ImpedanceThread, arg);
+
+void ImpedanceSetFeedforward(int leg, float ff_theta, float ff_gamma);
+void ImpedanceReadCurrents(int leg, float& current0, float& current1);
+
+// Latest and worst times, us, and the number of ticks over budget
+extern volatile uint32_t impedance_compute_us;
+extern volatile uint32_t impedance_max_compute_us;
+extern volatile uint32_t impedance_io_us;
+extern volatile uint32_t impedance_max_io_us;
+extern volatile uint32_t impedance_max_period_us;
+extern volatile uint32_t impedance_overruns;
+// Frames not sent because the UART was still busy with earlier ones
+extern volatile uint32_t impedance_tx_skips;
+
+#endif
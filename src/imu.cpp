@@ -1,13 +1,118 @@
-#include "arduino.h"
+#include "Arduino.h"
+#include "imu.h"
 #include "datalog.h"
 #include "ChRt.h"
 #include "SdFat.h"
 #include "SparkFun_BNO080_Arduino_Library.h"
 #include "config.h"
 #include "globals.h"
+#include "flight_recorder.h"
+#include "console.h"
+#include "attitude.h"
+#include "imu_trigger.h"
 
 BNO080 bno080_imu;
-float raw_integrated_gyro_y = 0;
+
+static_assert(IMU_REPORT_ACCELEROMETER == SENSOR_REPORTID_ACCELEROMETER &&
+              IMU_REPORT_GYROSCOPE == SENSOR_REPORTID_GYROSCOPE, "IMU report IDs don't match the BNO080 library");
+
+// Ring of decoded samples. The IMU thread is the only writer: it fills
+// imu_samples[imu_samples_written % IMU_SAMPLE_RING] and then bumps the count,
+// so readers never see a half written sample and never block the writer.
+static struct IMUSample imu_samples[IMU_SAMPLE_RING];
+static volatile uint32_t imu_samples_written = 0;
+
+// micros() at the last falling edge of the BNO080 INT line, which it pulls
+// low when a report is ready to be read
+static volatile uint32_t imu_int_us = 0;
+static BSEMAPHORE_DECL(imu_data_ready, true);
+
+volatile uint32_t imu_read_latency_us = 0;
+volatile uint32_t imu_max_read_latency_us = 0;
+volatile uint32_t imu_cpu_us = 0;
+volatile uint32_t imu_int_timeouts = 0;
+
+static struct AttitudeEstimator estimator;
+
+// Double buffer: the IMU thread fills the buffer that isn't active and then
+// switches to it, so readers never see angles and rates from different
+// samples.
+static struct Attitude published_attitude[2];
+static volatile uint8_t attitude_active = 0;
+static volatile uint32_t attitude_generation = 0;
+
+// Set by IMUTarePitch, handled by the IMU thread so the tare can't race an
+// update
+static volatile bool tare_requested = false;
+
+static void IMUDataReadyISR() {
+    CH_IRQ_PROLOGUE();
+    imu_int_us = micros();
+    chSysLockFromISR();
+    chBSemSignalI(&imu_data_ready);
+    chSysUnlockFromISR();
+    CH_IRQ_EPILOGUE();
+}
+
+/**
+ * Copy the samples written since cursor into out, oldest first.
+ * @param cursor Number of samples already read, advanced past the ones
+ *               returned. Start at 0. If the reader fell more than
+ *               IMU_SAMPLE_RING samples behind, the oldest are skipped.
+ * @return Number of samples copied
+ */
+int IMUReadSamples(uint32_t& cursor, struct IMUSample* out, int max) {
+    uint32_t written = imu_samples_written;
+    if (written - cursor > IMU_SAMPLE_RING) {
+        cursor = written - IMU_SAMPLE_RING;
+    }
+    int n = 0;
+    while (cursor != written && n < max) {
+        out[n++] = imu_samples[cursor % IMU_SAMPLE_RING];
+        cursor++;
+    }
+    return n;
+}
+
+/**
+ * Copy the latest attitude estimate.
+ * @return Number of estimates published so far, 0 before the first sample
+ */
+uint32_t IMUReadAttitude(struct Attitude& attitude) {
+    uint32_t generation;
+    do {
+        generation = attitude_generation;
+        attitude = published_attitude[attitude_active];
+    } while (generation != attitude_generation);
+    return generation;
+}
+
+/**
+ * The latest attitude extrapolated to t_us, see AttitudePredict. Use this
+ * rather than global_debug_values.imu to act on the attitude at a given time:
+ * the latest sample can be an IMU period and the read latency old. Reads zero
+ * pitch from IMUTarePitch until the IMU thread applies the tare.
+ * @return Age of the latest attitude at t_us, in us
+ */
+uint32_t IMUPredictAttitude(uint32_t t_us, struct Attitude& attitude) {
+    struct Attitude latest;
+    IMUReadAttitude(latest);
+    if (tare_requested) {
+        latest.pitch = 0;
+        latest.pitch_rate = 0;
+    }
+    return AttitudePredict(latest, t_us, IMU_MAX_PREDICT_US, attitude);
+}
+
+static void PublishAttitude(const struct Attitude& attitude) {
+    published_attitude[attitude_active ^ 1] = attitude;
+    attitude_generation++;
+    attitude_active ^= 1;
+
+    global_debug_values.imu.yaw = attitude.yaw;
+    global_debug_values.imu.pitch = attitude.pitch;
+    global_debug_values.imu.roll = attitude.roll;
+}
 
 THD_WORKING_AREA(waIMUThread, 4096);
 
@@ -20,121 +125,116 @@ THD_FUNCTION(IMUThread, arg) {
     //Initialize IMU
     int polling_period = 1000.0/IMU_SEND_FREQ;
     if(!bno080_imu.beginSPI(SPI_CS_PIN, SPI_WAK_PIN, SPI_INTPIN, SPI_RSTPIN)) {
-        Serial.println("IMU beginSPI failed (non-fatal)...");
+        ConsoleMessage().println("IMU beginSPI failed (non-fatal)...");
         // return;
     }
     bno080_imu.enableGyro(polling_period);
+    bno080_imu.enableAccelerometer(polling_period);
 
-    // Enable accelerometer according to config
-    int sensor_count = 1;
-    if (IMU_ENABLE_COMPLEMENTARY_FILTER) {
-        bno080_imu.enableAccelerometer(polling_period);
-        sensor_count = 2;
-    }
+    // beginSPI set the INT pin up as an input with pullup
+    attachInterrupt(digitalPinToInterrupt(SPI_INTPIN), IMUDataReadyISR, FALLING);
 
     if (IMU_VERBOSE > 0) {
-        Serial << "Initialized BNO080...\n";
-        Serial << "Rotation vector enabled at " << IMU_SEND_FREQ << "Hz\n";
+        ConsoleMessage() << "Initialized BNO080...\n";
+        ConsoleMessage() << "Gyro and accelerometer enabled at " << IMU_SEND_FREQ << "Hz\n";
     }
 
-    float pitch_estimate = 0;
-    float pitch_acc = 0;
-    float prev_pitch_acc = 0;
+    AttitudeInit(estimator, IMU_ATTITUDE_KP, IMU_ATTITUDE_KI, IMU_ACCEL_GATE);
+    const float dt = 1.0f / IMU_SEND_FREQ;
+    float accelX = 0, accelY = 0, accelZ = 0;
+    // Pitch is unwrapped across flips and offset by the tare
+    float prev_pitch = 0;
     float rotations = 0;
+    float pitch_offset = 0;
 
-    float velocity_x = 0;
+    while(true) {
+        // Sleep until the IMU raises INT. The timeout only matters if an edge
+        // was missed, eg while the BNO080 was resetting.
+        if (chBSemWaitTimeout(&imu_data_ready, TIME_MS2I(IMU_INT_TIMEOUT_MS)) != MSG_OK) {
+            imu_int_timeouts++;
+        }
 
-    // The BNO080 will be sending both gyro and accel readings every poll period.
-    // if we enable the complementary filter.
-    // dataAvailable doesn't tell us which sensor was just read so we keep a
-    // counter telling us how many readings we got since the last full read.
-    int sensors_read = 0;
+        uint32_t busy_us = 0;
+        while (true) {
+            // Reports that were already queued when the last one was read
+            // don't get a new edge and share its timestamp
+            uint32_t arrival_us = imu_int_us;
+            uint32_t read_begin_us = micros();
+            // Does the SPI transfer when INT is low, else returns straight away
+            if (!bno080_imu.dataAvailable()) {
+                break;
+            }
+            uint32_t read_done_us = micros();
+            imu_read_latency_us = read_done_us - arrival_us;
+            if (imu_read_latency_us > imu_max_read_latency_us) {
+                imu_max_read_latency_us = imu_read_latency_us;
+            }
 
-    while(true) {
-        long read_begin_ts = micros(); // Time stamp for before we started reading
-        while (bno080_imu.dataAvailable() == true)
-        {
-            // This block is triggered at a rate of 2*IMU_SEND_FREQ
-            sensors_read++;
-            if (sensors_read >= sensor_count) {
-                sensors_read = 0;
-                // This block will execute at the rate of IMU_SEND_FREQ
-
-                long read_finished_ts = micros();
-
-                if (IMU_ENABLE_COMPLEMENTARY_FILTER) {
-                    // Grab readings from the IMU object
-                    float gyroY = bno080_imu.getGyroY();
-                    float accelX = bno080_imu.getAccelX();
-                    float accelZ = bno080_imu.getAccelZ();
-
-                    // Calculate pitch from acceleration data
-                    pitch_acc = atan2(accelX, accelZ);
-
-                    // Handle multi rotations
-                    if (pitch_acc - prev_pitch_acc > 0.5*M_PI) {
-                        rotations -= 1;
-                    }
-                    if (pitch_acc - prev_pitch_acc < -0.5*M_PI) {
-                        rotations += 1;
-                    }
-                    float multi_rot_pitch_acc = 2*M_PI*rotations + pitch_acc;
-
-                    // Integrate pitch angular rates
-                    pitch_estimate -= gyroY / (float)IMU_SEND_FREQ;
-                    raw_integrated_gyro_y -= gyroY*cos(pitch_estimate) / (float)IMU_SEND_FREQ;
-
-                    velocity_x += (accelX + 9.81*sin(pitch_estimate)) / (float)IMU_SEND_FREQ;
-
-                    // Apply complementary filter
-                    float tau = IMU_COMPLEMENTARY_FILTER_TAU;
-                    pitch_estimate = tau * pitch_estimate + (1-tau) * multi_rot_pitch_acc;
-
-                    prev_pitch_acc = pitch_acc;
-
-                    long imu_calc_done_ts = micros();
-                    if (IMU_VERBOSE > 0) {
-                        Serial << pitch_acc << "\t" << raw_integrated_gyro_y << "\t" << pitch_estimate << "\t" << rotations << "\t" << velocity_x << "\n";
-
-                    }
-                    if (IMU_VERBOSE > 1) {
-                        Serial << "uS spent reading IMU: " << read_finished_ts - read_begin_ts << "\n";
-                        Serial << "uS total time for IMU: " << imu_calc_done_ts - read_begin_ts << "\n";
-                    }
-
-                    // Store euler angles to global variable
-                    global_debug_values.imu.pitch = pitch_estimate;
-                } else {
-                    float gyroY = bno080_imu.getGyroY();
-                    raw_integrated_gyro_y -= gyroY / (float)IMU_SEND_FREQ;
-                    long imu_calc_done_ts = micros();
-
-                    if (IMU_VERBOSE > 0) {
-                        Serial << raw_integrated_gyro_y << "\n";
-
-                    }
-                    if (IMU_VERBOSE > 1) {
-                        Serial << "uS spent reading IMU: " << read_finished_ts - read_begin_ts << "\n";
-                        Serial << "uS total time for IMU: " << imu_calc_done_ts - read_begin_ts << "\n";
-                    }
-
-                    // Store euler angles to global variable
-                    global_debug_values.imu.pitch = raw_integrated_gyro_y;
+            struct IMUSample& sample = imu_samples[imu_samples_written % IMU_SAMPLE_RING];
+            sample.t_us = arrival_us;
+            // Report ID of the packet just parsed, see BNO080::parseInputReport
+            sample.report = bno080_imu.shtpData[5];
+            if (sample.report == IMU_REPORT_GYROSCOPE) {
+                sample.x = bno080_imu.getGyroX();
+                sample.y = bno080_imu.getGyroY();
+                sample.z = bno080_imu.getGyroZ();
+            } else if (sample.report == IMU_REPORT_ACCELEROMETER) {
+                sample.x = bno080_imu.getAccelX();
+                sample.y = bno080_imu.getAccelY();
+                sample.z = bno080_imu.getAccelZ();
+                accelX = sample.x;
+                accelY = sample.y;
+                accelZ = sample.z;
+            } else {
+                busy_us += micros() - read_begin_us;
+                continue;
+            }
+            imu_samples_written++;
+
+            // The estimate runs once per gyro sample, with the latest
+            // accelerometer sample
+            if (sample.report == IMU_REPORT_GYROSCOPE) {
+                AttitudeUpdate(estimator, sample.x, sample.y, sample.z, accelX, accelY, accelZ, dt);
+
+                struct Attitude attitude;
+                attitude.t_us = arrival_us;
+                float pitch;
+                AttitudeEuler(estimator, attitude.yaw, pitch, attitude.roll);
+                // Handle multi rotations
+                if (pitch - prev_pitch > M_PI) {
+                    rotations -= 1;
                 }
-
-                // TODO: dataAvailable:
-                // TODO: Read gyro and accel:
+                if (pitch - prev_pitch < -M_PI) {
+                    rotations += 1;
+                }
+                prev_pitch = pitch;
+                if (tare_requested) {
+                    pitch_offset = 2*M_PI*rotations + pitch;
+                    tare_requested = false;
+                }
+                attitude.pitch = 2*M_PI*rotations + pitch - pitch_offset;
+                attitude.rate_x = sample.x - estimator.bias_x;
+                attitude.rate_y = sample.y - estimator.bias_y;
+                attitude.rate_z = sample.z - estimator.bias_z;
+                AttitudeSetEulerRates(attitude, pitch);
+                PublishAttitude(attitude);
+                IMUCheckTriggers(attitude);
+
+                FlightRecorderRecordIMU(arrival_us, attitude.pitch, sample.y, accelX, accelZ);
             }
+            busy_us += micros() - read_begin_us;
         }
-
-        chThdSleepMicroseconds(1000000/IMU_FREQ);
+        imu_cpu_us = busy_us;
     }
 }
 
+/**
+ * Make the current pitch read zero. Takes effect from the next gyro sample.
+ */
 void IMUTarePitch() {
-    raw_integrated_gyro_y = 0;
+    tare_requested = true;
     global_debug_values.imu.pitch = 0;
     if (IMU_VERBOSE > 0) {
-        Serial << "Zero-ed body pitch\n";
+        ConsoleMessage() << "Zero-ed body pitch\n";
     }
 }
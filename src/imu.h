@@ -2,11 +2,40 @@
 #define IMU_H
 
 #include "ChRt.h"
+#include "attitude.h"
+#include <stdint.h>
+
+// IMUSample report values, the BNO080 report IDs, so readers don't need the
+// BNO080 library
+const uint8_t IMU_REPORT_ACCELEROMETER = 0x01;
+const uint8_t IMU_REPORT_GYROSCOPE = 0x02;
+
+/**
+ * One gyro (rad/s) or accelerometer (m/s^2) sample from the BNO080
+ */
+struct IMUSample {
+    uint32_t t_us;  // micros() at the INT edge that announced the report
+    uint8_t report; // IMU_REPORT_GYROSCOPE or IMU_REPORT_ACCELEROMETER
+    float x, y, z;
+};
+
+// Time from the INT edge to the end of the SPI read of the latest report
+extern volatile uint32_t imu_read_latency_us;
+extern volatile uint32_t imu_max_read_latency_us;
+// Time the IMU thread spent reading and processing after the last INT edge
+extern volatile uint32_t imu_cpu_us;
+// Waits for INT that timed out
+extern volatile uint32_t imu_int_timeouts;
 
 extern THD_WORKING_AREA(waIMUThread, 4096);
 
 extern THD_FUNCTION(IMUThread, arg);
 
+int IMUReadSamples(uint32_t& cursor, struct IMUSample* out, int max);
+
+uint32_t IMUReadAttitude(struct Attitude& attitude);
+uint32_t IMUPredictAttitude(uint32_t t_us, struct Attitude& attitude);
+
 void IMUTarePitch();
 
 #endif
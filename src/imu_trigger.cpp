@@ -0,0 +1,109 @@
+#include "imu_trigger.h"
+#include "Arduino.h"
+#include "config.h"
+#include "position_control.h"
+
+enum IMUTriggerState {
+    TRIGGER_FREE = 0,
+    TRIGGER_ARMED,
+    TRIGGER_FIRED
+};
+
+struct IMUTrigger {
+    volatile uint8_t state; // IMUTriggerState
+    uint8_t condition;      // IMUTriggerCondition
+    float threshold;        // rad or rad/s
+    uint32_t fired_us;      // t_us of the sample that fired it
+};
+
+static struct IMUTrigger triggers[IMU_MAX_TRIGGERS];
+
+volatile uint32_t imu_trigger_latency_us = 0;
+volatile uint32_t imu_trigger_max_latency_us = 0;
+
+/**
+ * Start watching for a condition on the tared pitch or its rate.
+ * @return Trigger id, or -1 if all IMU_MAX_TRIGGERS are in use
+ */
+int IMUArmTrigger(IMUTriggerCondition condition, float threshold) {
+    for (int i = 0; i < IMU_MAX_TRIGGERS; i++) {
+        if (triggers[i].state == TRIGGER_FREE) {
+            triggers[i].condition = condition;
+            triggers[i].threshold = threshold;
+            // Armed last, once the IMU thread can read a complete trigger
+            triggers[i].state = TRIGGER_ARMED;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @return true once the trigger's condition has been met
+ */
+bool IMUTriggerFired(int id) {
+    return id >= 0 && id < IMU_MAX_TRIGGERS && triggers[id].state == TRIGGER_FIRED;
+}
+
+/**
+ * Release a fired trigger once the control thread has acted on it, and record
+ * how long that took from the sample that fired it.
+ */
+void IMUTriggerHandled(int id) {
+    if (!IMUTriggerFired(id)) {
+        return;
+    }
+    uint32_t latency = micros() - triggers[id].fired_us;
+    imu_trigger_latency_us = latency;
+    if (latency > imu_trigger_max_latency_us) {
+        imu_trigger_max_latency_us = latency;
+    }
+    triggers[id].state = TRIGGER_FREE;
+}
+
+/**
+ * Release a trigger whether or not it fired.
+ */
+void IMUDisarmTrigger(int id) {
+    if (id >= 0 && id < IMU_MAX_TRIGGERS) {
+        triggers[id].state = TRIGGER_FREE;
+    }
+}
+
+/**
+ * Fire the armed triggers whose condition the new attitude meets and wake the
+ * control thread if any did. Called by the IMU thread after publishing each
+ * attitude.
+ */
+void IMUCheckTriggers(const struct Attitude& attitude) {
+    bool fired = false;
+    for (int i = 0; i < IMU_MAX_TRIGGERS; i++) {
+        struct IMUTrigger& trigger = triggers[i];
+        if (trigger.state != TRIGGER_ARMED) {
+            continue;
+        }
+        bool met = false;
+        switch (trigger.condition) {
+            case IMU_PITCH_ABOVE:
+                met = attitude.pitch > trigger.threshold;
+                break;
+            case IMU_PITCH_BELOW:
+                met = attitude.pitch < trigger.threshold;
+                break;
+            case IMU_PITCH_RATE_ABOVE:
+                met = attitude.pitch_rate > trigger.threshold;
+                break;
+            case IMU_PITCH_RATE_BELOW:
+                met = attitude.pitch_rate < trigger.threshold;
+                break;
+        }
+        if (met) {
+            trigger.fired_us = attitude.t_us;
+            trigger.state = TRIGGER_FIRED;
+            fired = true;
+        }
+    }
+    if (fired) {
+        PositionControlWake();
+    }
+}
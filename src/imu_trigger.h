@@ -0,0 +1,33 @@
+#ifndef IMU_TRIGGER_H
+#define IMU_TRIGGER_H
+
+#include <stdint.h>
+#include "attitude.h"
+
+// Conditions on the attitude that the IMU thread checks after every gyro
+// sample. When an armed trigger's condition is met it fires and wakes the
+// control thread, so a state machine waiting on it (eg the flip's phase
+// changes) acts within one scheduling delay instead of at the next tick.
+//
+// Triggers are armed, polled and released from the control thread. The IMU
+// thread only moves an armed trigger to fired.
+
+enum IMUTriggerCondition {
+    IMU_PITCH_ABOVE = 0,
+    IMU_PITCH_BELOW = 1,
+    IMU_PITCH_RATE_ABOVE = 2,
+    IMU_PITCH_RATE_BELOW = 3
+};
+
+int IMUArmTrigger(IMUTriggerCondition condition, float threshold);
+bool IMUTriggerFired(int id);
+void IMUTriggerHandled(int id);
+void IMUDisarmTrigger(int id);
+void IMUCheckTriggers(const struct Attitude& attitude);
+
+// Time from the INT edge of the sample that fired a trigger to the control
+// thread having acted on it (IMUTriggerHandled), latest and worst
+extern volatile uint32_t imu_trigger_latency_us;
+extern volatile uint32_t imu_trigger_max_latency_us;
+
+#endif
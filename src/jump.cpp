@@ -2,17 +2,36 @@
 #include "ODriveArduino.h"
 #include "globals.h"
 #include "position_control.h"
+#include "flight_recorder.h"
+#include "console.h"
+#include "phase_sequencer.h"
+#include "contact.h"
 
 // Privates
-float start_time_ = 0.0f;
+enum JumpPhase {
+    JUMP_PREP,   // Crouch before jumping
+    JUMP_LAUNCH, // Extend the legs, until they retract
+    JUMP_FALL,   // Land, until going back to normal behavior
+    JUMP_PHASES
+};
+static const uint32_t jump_phase_us[JUMP_PHASES] = {500000, 800000, 1000000};
+static struct PhaseSequencer jump_sequence_;
+// Set once the last foot has lifted off during the launch
+static bool jump_airborne_ = false;
+// Contact detection latency of the touchdown that ended the launch, 0 if the
+// launch timed out. Printed when the jump completes.
+static uint32_t jump_touchdown_latency_us_ = 0;
 
 /**
  * Tell the position control thread to do the jump
- * @param start_time_s The timestamp of when the jump command was sent
+ * @param start_us The Micros64() time of when the jump command was sent
  */
-void StartJump(float start_time_s) {
-    start_time_ = start_time_s;
+void StartJump(uint64_t start_us) {
+    PhaseSequencerStart(jump_sequence_, "Jump", jump_phase_us, JUMP_PHASES, start_us);
+    jump_airborne_ = false;
+    jump_touchdown_latency_us_ = 0;
     state = JUMP;
+    FlightRecorderTrigger(FR_REASON_JUMP);
 }
 
 /**
@@ -33,17 +52,25 @@ void TrajectoryJump(float t, float launchTime, float stanceHeight,
 void ExecuteJump() {
     // min radius = 0.8
     // max radius = 0.25
-    const float prep_time = 0.5f; // Duration before jumping [s]
-    const float launch_time = 0.8f ; // Duration before retracting the leg [s]
-    const float fall_time = 1.0f; //Duration after retracting leg to go back to normal behavior [s]
-
     const float stance_height = 0.081f; // Desired leg extension before the jump [m]
     const float jump_extension = 0.249f; // Maximum leg extension in [m]
     const float fall_extension = 0.13f; // Desired leg extension during fall [m]
 
-    float t = millis()/1000.0f - start_time_; // Seconds since jump was commanded
+    uint64_t now = Micros64();
+    int phase = PhaseSequencerUpdate(jump_sequence_, now);
+
+    // Land with the soft gains as soon as a foot strikes rather than when the
+    // launch phase times out
+    if (phase == JUMP_LAUNCH) {
+        if (contact_liftoffs != 0 && contact_legs == 0) {
+            jump_airborne_ = true;
+        } else if (jump_airborne_ && contact_touchdowns != 0) {
+            jump_touchdown_latency_us_ = contact_latency_us;
+            phase = PhaseSequencerEndPhase(jump_sequence_, now);
+        }
+    }
 
-    if (t < prep_time) {
+    if (phase == JUMP_PREP) {
         float x = 0;
         float y = stance_height;
         float theta,gamma;
@@ -53,7 +80,7 @@ void ExecuteJump() {
         struct LegGain gains = {50, 1.0, 50, 1.0};
         CommandAllLegs(theta,gamma,gains);
         // Serial << "Prep: +" << t << "s, y: " << y;
-    } else if (t >= prep_time && t < prep_time + launch_time) {
+    } else if (phase == JUMP_LAUNCH) {
         float x = 0;
         float y = jump_extension;
         float theta, gamma;
@@ -63,7 +90,7 @@ void ExecuteJump() {
         struct LegGain gains = {240, 0.5, 240, 0.2};
         CommandAllLegs(theta, gamma, gains);
         // Serial << "Jump: +" << t << "s, y: " << y;
-    } else if (t >= prep_time + launch_time && t < prep_time + launch_time + fall_time) {
+    } else if (phase == JUMP_FALL) {
         float x = 0;
         float y = fall_extension;
         float theta,gamma;
@@ -76,7 +103,11 @@ void ExecuteJump() {
         // Serial << "Retract: +" << t << "s, y: " << y;
     } else {
         state = STOP;
-        Serial.println("Jump Complete.");
+        ConsoleMessage().println("Jump Complete.");
+        PhaseSequencerReport(jump_sequence_);
+        if (jump_touchdown_latency_us_ > 0) {
+            ConsoleMessage() << "Jump touchdown, detection latency " << jump_touchdown_latency_us_ << "us\n";
+        }
     }
     // Serial << '\n';
 }
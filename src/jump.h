@@ -1,10 +1,11 @@
 #ifndef JUMP_H
 #define JUMP_H
 
+#include <stdint.h>
 #include "ODriveArduino.h"
 void TrajectoryJump(float t, float launchTime, float stanceHeight,
                     float downAMP, float& x, float& y);
-void StartJump(float start_time_s);
+void StartJump(uint64_t start_us);
 void ExecuteJump();
 void CommandAllLegs(float theta, float gamma, LegGain gains);
 
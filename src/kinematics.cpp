@@ -0,0 +1,131 @@
+#include "kinematics.h"
+#include <math.h>
+
+/**
+ * Hip to foot distance of a leg with upper links gamma either side of the
+ * virtual leg. Inverse of GetGamma.
+ */
+float LegLength(float gamma) {
+    float c = cosf(gamma), s = sinf(gamma);
+    return LEG_L1 * c + sqrtf(LEG_L2 * LEG_L2 - LEG_L1 * LEG_L1 * s * s);
+}
+
+/**
+ * Foot position for the given leg angles. Inverse of CartesianToThetaGamma.
+ */
+void LegForwardKinematics(float theta, float gamma, float leg_direction, float& x, float& y) {
+    float L = LegLength(gamma);
+    x = leg_direction * L * sinf(theta);
+    y = L * cosf(theta);
+}
+
+/**
+ * Foot of one leg relative to the body centre, turned into the world frame:
+ * x forwards and z up, for a body pitched by the angle given.
+ * @param leg Leg index, odrv0 to odrv3
+ */
+void LegFootInWorld(int leg, float theta, float gamma, float cos_pitch, float sin_pitch, float& x, float& z) {
+    float fx, fy;
+    LegForwardKinematics(theta, gamma, LEG_DIRECTION[leg], fx, fy);
+    float bx = LEG_HIP_X[leg] + fx;
+    float bz = -fy;
+    x = cos_pitch * bx - sin_pitch * bz;
+    z = sin_pitch * bx + cos_pitch * bz;
+}
+
+/**
+ * Jacobian of LegForwardKinematics, J[row][col] = d(x, y)[row] / d(theta, gamma)[col].
+ */
+void LegJacobian(float theta, float gamma, float leg_direction, float J[2][2]) {
+    float c = cosf(gamma), s = sinf(gamma);
+    float root = sqrtf(LEG_L2 * LEG_L2 - LEG_L1 * LEG_L1 * s * s);
+    float L = LEG_L1 * c + root;
+    float dL = -LEG_L1 * s - LEG_L1 * LEG_L1 * s * c / root;
+    float ct = cosf(theta), st = sinf(theta);
+    J[0][0] = leg_direction * L * ct;
+    J[0][1] = leg_direction * dL * st;
+    J[1][0] = -L * st;
+    J[1][1] = dL * ct;
+}
+
+/**
+ * Foot force that balances the given torques along theta and gamma (Nm),
+ * f = J^-T tau.
+ * @return false if the leg is fully stretched or folded, where gamma can't
+ *         push the foot and the force is undefined; fx, fy are then 0
+ */
+bool LegTorqueToFootForce(float theta, float gamma, float leg_direction,
+                          float tau_theta, float tau_gamma, float& fx, float& fy) {
+    float J[2][2];
+    LegJacobian(theta, gamma, leg_direction, J);
+    float det = J[0][0] * J[1][1] - J[0][1] * J[1][0];
+    if (fabsf(det) < 1e-5f) {
+        fx = 0;
+        fy = 0;
+        return false;
+    }
+    // Solve J^T f = tau
+    fx = (J[1][1] * tau_theta - J[1][0] * tau_gamma) / det;
+    fy = (J[0][0] * tau_gamma - J[0][1] * tau_theta) / det;
+    return true;
+}
+
+/**
+ * Torques along theta and gamma (Nm) for the foot to push with the given
+ * force, tau = J^T f.
+ */
+void LegFootForceToTorque(float theta, float gamma, float leg_direction,
+                          float fx, float fy, float& tau_theta, float& tau_gamma) {
+    float J[2][2];
+    LegJacobian(theta, gamma, leg_direction, J);
+    tau_theta = J[0][0] * fx + J[1][0] * fy;
+    tau_gamma = J[0][1] * fx + J[1][1] * fy;
+}
+
+/**
+ * Motor currents that produce the given currents along theta and gamma. Must
+ * match the ODrive firmware's coupled coordinates, theta = (alpha + beta)/2
+ * and gamma = (beta - alpha)/2 with alpha = -motor 0 and beta = motor 1, so
+ * by virtual work alpha and beta each take half of theta -/+ gamma.
+ */
+void CoupledToMotorCurrents(float i_theta, float i_gamma, float& current0, float& current1) {
+    float i_alpha = 0.5f * (i_theta - i_gamma);
+    float i_beta = 0.5f * (i_theta + i_gamma);
+    current0 = -i_alpha;
+    current1 = i_beta;
+}
+
+/**
+ * Inverse of CoupledToMotorCurrents.
+ */
+void MotorToCoupledCurrents(float current0, float current1, float& i_theta, float& i_gamma) {
+    float i_alpha = -current0;
+    float i_beta = current1;
+    i_theta = i_alpha + i_beta;
+    i_gamma = i_beta - i_alpha;
+}
+
+/**
+ * Foot force from the two motor currents of a leg (A), eg the currents the
+ * impedance controller commanded. Ignores friction and the legs' own inertia.
+ * @return false where LegTorqueToFootForce does
+ */
+bool LegCurrentsToFootForce(float theta, float gamma, float leg_direction,
+                            float current0, float current1, float& fx, float& fy) {
+    float i_theta, i_gamma;
+    MotorToCoupledCurrents(current0, current1, i_theta, i_gamma);
+    return LegTorqueToFootForce(theta, gamma, leg_direction,
+                                i_theta * LEG_TORQUE_PER_AMP, i_gamma * LEG_TORQUE_PER_AMP, fx, fy);
+}
+
+/**
+ * Currents along theta and gamma (A) for the foot to push with the given
+ * force, as feedforward for the impedance controller.
+ */
+void LegFootForceToCurrents(float theta, float gamma, float leg_direction,
+                            float fx, float fy, float& i_theta, float& i_gamma) {
+    float tau_theta, tau_gamma;
+    LegFootForceToTorque(theta, gamma, leg_direction, fx, fy, tau_theta, tau_gamma);
+    i_theta = tau_theta / LEG_TORQUE_PER_AMP;
+    i_gamma = tau_gamma / LEG_TORQUE_PER_AMP;
+}
@@ -0,0 +1,48 @@
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+// Kinematics of one five-bar leg. theta is the angle of the virtual leg (hip
+// to foot) from straight down, positive CCW, and gamma is half the angle
+// between the two upper links, the coupled coordinates the ODrives use. Foot
+// positions are relative to the hip in m, x along the direction of travel
+// (as GaitFootAt uses it, after leg_direction) and y downwards.
+//
+// Foot forces are the force the foot applies to the ground, in the same
+// x, y axes, so a leg holding the body up pushes with positive fy. Torques
+// along theta and gamma relate to them through the Jacobian, tau = J^T f.
+// No Arduino dependencies, so tools/kinematics can build it on the host.
+
+#include "config.h"
+
+const float LEG_L1 = 0.09f; // upper leg length (m)
+const float LEG_L2 = 0.162f; // lower leg length (m)
+// Upper link torque per amp of motor current: 0.028Nm/A motor constant
+// through the 3:1 belt reduction
+const float LEG_TORQUE_PER_AMP = 0.084f;
+
+// leg_direction of each leg, odrv0 to odrv3. The gaits, scripts and
+// estimators all use these
+const float LEG_DIRECTION[4] = {-1.0f, -1.0f, 1.0f, 1.0f};
+// Fore-aft position of each hip from the body centre (m). odrv0 and odrv3
+// are the front legs (see CommandLegsThetaY)
+const float LEG_HIP_X[4] = {BODY_HIP_X, -BODY_HIP_X, -BODY_HIP_X, BODY_HIP_X};
+
+float LegLength(float gamma);
+void LegForwardKinematics(float theta, float gamma, float leg_direction, float& x, float& y);
+void LegJacobian(float theta, float gamma, float leg_direction, float J[2][2]);
+void LegFootInWorld(int leg, float theta, float gamma, float cos_pitch, float sin_pitch, float& x, float& z);
+
+bool LegTorqueToFootForce(float theta, float gamma, float leg_direction,
+                          float tau_theta, float tau_gamma, float& fx, float& fy);
+void LegFootForceToTorque(float theta, float gamma, float leg_direction,
+                          float fx, float fy, float& tau_theta, float& tau_gamma);
+
+void CoupledToMotorCurrents(float i_theta, float i_gamma, float& current0, float& current1);
+void MotorToCoupledCurrents(float current0, float current1, float& i_theta, float& i_gamma);
+
+bool LegCurrentsToFootForce(float theta, float gamma, float leg_direction,
+                            float current0, float current1, float& fx, float& fy);
+void LegFootForceToCurrents(float theta, float gamma, float leg_direction,
+                            float fx, float fy, float& i_theta, float& i_gamma);
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef LOG_FORMAT_H
+#define LOG_FORMAT_H
+
+#include <stdint.h>
+#include <math.h>
+
+// Self-describing binary log format shared by the SD datalogger and the host
+// decoder (tools/logdecode). Only depends on stdint/math so it builds on both.
+//
+// File layout, in 512 byte blocks:
+//   header blocks: LogFileHeader, then field_count x {name\0, encoding, scale}
+//   data blocks:   LogBlockHeader, then back-to-back encoded records
+//
+// Each record is one value per schema field, in schema order. Values are
+// quantized as round(value * scale) and written as a zigzag varint, either
+// as-is or as the difference from the previous record. Delta state resets at
+// the start of every data block so each block decodes on its own.
+
+const uint32_t LOG_FILE_MAGIC = 0x474C4744; // "DGLG"
+const uint32_t LOG_BLOCK_MAGIC = 0x474F4444; // "DDOG"
+const uint16_t LOG_FORMAT_VERSION = 2;
+const int LOG_BLOCK_SIZE = 512;
+
+enum LogEncoding {
+    LOG_ENC_VARINT = 0, // Absolute value
+    LOG_ENC_DELTA = 1, // Signed difference from the previous record
+    LOG_ENC_COUNTER = 2 // Unsigned wrapping counter (eg micros()), readers unwrap it
+};
+
+// Written to quantized fields whose value was NaN
+const int32_t LOG_NAN = INT32_MIN;
+
+#pragma pack(push, 1)
+struct LogFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t field_count;
+    uint16_t header_blocks; // Number of blocks before the first data block
+    uint16_t record_max_bytes;
+};
+
+struct LogBlockHeader {
+    uint32_t magic;
+    uint32_t seq; // Data block sequence number, readers stop at the first gap
+    uint16_t bytes; // Encoded record bytes that follow
+    uint16_t dropped; // Records dropped since the previous block
+};
+#pragma pack(pop)
+
+const int LOG_BLOCK_PAYLOAD = LOG_BLOCK_SIZE - sizeof(LogBlockHeader);
+
+inline int32_t LogQuantize(float value, float scale) {
+    if (isnan(value)) return LOG_NAN;
+    float q = value * scale;
+    if (q > 2147483520.0f) return INT32_MAX;
+    if (q < -2147483520.0f) return INT32_MIN + 1;
+    return (int32_t)lroundf(q);
+}
+
+// Integer fields are logged exactly, whatever their scale
+inline int32_t LogQuantize(uint32_t value, float) { return (int32_t)value; }
+inline int32_t LogQuantize(int32_t value, float) { return value; }
+inline int32_t LogQuantize(uint16_t value, float) { return value; }
+inline int32_t LogQuantize(uint8_t value, float) { return value; }
+
+inline uint32_t LogZigZag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t LogUnZigZag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// Writes v as a little endian base-128 varint, returns bytes written (1-5)
+inline int LogPutVarint(uint8_t* out, uint32_t v) {
+    int n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+// Reads a varint from [p, end), returns bytes consumed or 0 if truncated
+inline int LogGetVarint(const uint8_t* p, const uint8_t* end, uint32_t& v) {
+    v = 0;
+    for (int n = 0; n < 5 && p + n < end; n++) {
+        v |= (uint32_t)(p[n] & 0x7F) << (7 * n);
+        if ((p[n] & 0x80) == 0) return n + 1;
+    }
+    return 0;
+}
+
+inline int LogEncodeValue(uint8_t* out, int32_t q, int32_t prev, uint8_t encoding) {
+    switch (encoding) {
+        case LOG_ENC_DELTA:
+            return LogPutVarint(out, LogZigZag((int32_t)((uint32_t)q - (uint32_t)prev)));
+        case LOG_ENC_COUNTER:
+            return LogPutVarint(out, (uint32_t)q - (uint32_t)prev);
+        default:
+            return LogPutVarint(out, LogZigZag(q));
+    }
+}
+
+#endif
@@ -27,12 +27,10 @@
 #include "jump.h"
 #include "datalog.h"
 #include "imu.h"
-
-//------------------------------------------------------------------------------
-// E-STOP function
-void ESTOP() {
-    while(true) {}
-}
+#include "flight_recorder.h"
+#include "cycle_counter.h"
+#include "console.h"
+#include "impedance.h"
 
 //------------------------------------------------------------------------------
 // IdleThread: Increments a counter so we know how many idle cycles we had
@@ -107,10 +105,14 @@ void chSetup() {
     chThdCreateStatic(waUSBSerialThread, sizeof(waUSBSerialThread), NORMALPRIO,
         USBSerialThread, NULL);
 
-    // Debug thread: prints out helpful debugging information to serial monitor
+    // Debug thread: streams binary telemetry to the host
     chThdCreateStatic(waPrintDebugThread, sizeof(waPrintDebugThread),
         NORMALPRIO, PrintDebugThread, NULL);
 
+    // Console thread: writes queued console messages to serial
+    chThdCreateStatic(waConsoleThread, sizeof(waConsoleThread),
+        NORMALPRIO, ConsoleThread, NULL);
+
     // Blink thread: blinks the onboard LED
     chThdCreateStatic(waBlinkThread, sizeof(waBlinkThread),
         NORMALPRIO, BlinkThread, NULL);
@@ -122,6 +124,14 @@ void chSetup() {
     // IMU Thread: Queries IMU and stores data
     chThdCreateStatic(waIMUThread, sizeof(waIMUThread),
         NORMALPRIO, IMUThread, NULL);
+
+    // Impedance thread: closes the leg loops with current commands if enabled
+    chThdCreateStatic(waImpedanceThread, sizeof(waImpedanceThread),
+        NORMALPRIO, ImpedanceThread, NULL);
+
+    // Flight recorder thread: dumps the flight recorder after a trigger
+    chThdCreateStatic(waFlightRecorderThread, sizeof(waFlightRecorderThread),
+        NORMALPRIO, FlightRecorderThread, NULL);
 }
 //------------------------------------------------------------------------------
 // Setup thread.
@@ -132,14 +142,21 @@ void setup() {
     while(true){}
     #endif
 
-    // Begin at 115200 BAUD
-    Serial.begin(115200);
+    // Begin at SERIAL_BAUD
+    Serial.begin(SERIAL_BAUD);
     // Wait for USB Serial.
     while (!Serial) {}
 
+    #ifdef USE_XBEE
+    static uint8_t xbee_tx_buffer[XBEE_TX_BUFFER_SIZE];
+    Serial.addMemoryForWrite(xbee_tx_buffer, sizeof(xbee_tx_buffer));
+    #endif
+
     PrintStates();
     PrintGaitCommands();
 
+    CycleCounterInit();
+
     // Make sure the custom firmware is loaded because the default BAUD is 115200
     odrv0Serial.begin(500000);
     odrv1Serial.begin(500000);
@@ -0,0 +1,108 @@
+#include "phase_sequencer.h"
+#include "Arduino.h"
+#include "position_control.h"
+#include "console.h"
+
+/**
+ * micros() extended to 64 bits, so it doesn't wrap after 71 minutes. Only
+ * called from the control thread, which calls it every tick (see
+ * PositionControlSleepUs), so no wrap is ever missed.
+ */
+uint64_t Micros64() {
+    static uint32_t last_us = 0;
+    static uint32_t wraps = 0;
+    uint32_t now = micros();
+    if (now < last_us) {
+        wraps++;
+    }
+    last_us = now;
+    return ((uint64_t)wraps << 32) | now;
+}
+
+/**
+ * Begin a sequence. Phase 0 starts at start_us, each later phase where the
+ * one before it ends.
+ * @param durations_us Length of each phase. Not copied, so it must outlive
+ *                     the sequence.
+ */
+void PhaseSequencerStart(struct PhaseSequencer& s, const char* name,
+                         const uint32_t* durations_us, int num_phases, uint64_t start_us) {
+    s.name = name;
+    s.durations_us = durations_us;
+    s.num_phases = num_phases;
+    s.start_us = start_us;
+    s.phase_start_us = start_us;
+    s.phase = 0;
+    s.early = 0;
+    s.reported = 0;
+    PositionControlWakeAt(start_us + durations_us[0]);
+}
+
+/**
+ * Keep the planned and actual time of the transition into s.phase for the
+ * report.
+ */
+static void RecordTransition(struct PhaseSequencer& s, uint32_t planned, uint32_t actual, bool early) {
+    int k = s.phase - 1;
+    if (k >= PHASE_SEQUENCER_MAX_PHASES) {
+        return;
+    }
+    s.planned_us[k] = planned;
+    s.actual_us[k] = actual;
+    if (early) {
+        s.early |= 1 << k;
+    }
+}
+
+/**
+ * Advance past the phases that have ended by now_us and ask for a wake up at
+ * the end of the current one. Call once per control tick.
+ * @return Current phase, num_phases once the sequence has finished
+ */
+int PhaseSequencerUpdate(struct PhaseSequencer& s, uint64_t now_us) {
+    while (s.phase < s.num_phases && now_us >= s.phase_start_us + s.durations_us[s.phase]) {
+        s.phase_start_us += s.durations_us[s.phase];
+        s.phase++;
+        RecordTransition(s, s.phase_start_us - s.start_us, now_us - s.start_us, false);
+    }
+    if (s.phase < s.num_phases) {
+        PositionControlWakeAt(s.phase_start_us + s.durations_us[s.phase]);
+    }
+    return s.phase;
+}
+
+/**
+ * End the current phase now instead of at its planned time, eg on touchdown.
+ * The phases after it keep their lengths and start from now.
+ * @return The new current phase
+ */
+int PhaseSequencerEndPhase(struct PhaseSequencer& s, uint64_t now_us) {
+    if (s.phase >= s.num_phases) {
+        return s.phase;
+    }
+    uint32_t planned = s.phase_start_us + s.durations_us[s.phase] - s.start_us;
+    uint32_t actual = now_us - s.start_us;
+    s.phase_start_us = now_us;
+    s.phase++;
+    RecordTransition(s, planned, actual, true);
+    if (s.phase < s.num_phases) {
+        PositionControlWakeAt(s.phase_start_us + s.durations_us[s.phase]);
+    }
+    return s.phase;
+}
+
+/**
+ * Print the planned and actual time of every transition not yet printed, eg
+ *   Jump phase 1: planned +500000us, actual +500000us
+ * Call once the maneuver is over; calling it again only prints what happened
+ * since.
+ */
+void PhaseSequencerReport(struct PhaseSequencer& s) {
+    int recorded = s.phase < PHASE_SEQUENCER_MAX_PHASES ? s.phase : PHASE_SEQUENCER_MAX_PHASES;
+    for (; s.reported < recorded; s.reported++) {
+        int k = s.reported;
+        ConsoleMessage() << s.name << " phase " << k + 1 << ": planned +" << s.planned_us[k]
+                         << "us, actual +" << s.actual_us[k] << "us" << ((s.early >> k) & 1 ? " (early)" : "")
+                         << "\n";
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef PHASE_SEQUENCER_H
+#define PHASE_SEQUENCER_H
+
+#include <stdint.h>
+
+// Runs a timed sequence of phases, eg jump prep, launch and fall, on a 64 bit
+// microsecond clock. Phase boundaries are fixed when the sequence starts, so
+// each phase begins exactly where the last one ended however late the control
+// tick that noticed it ran, and the sequencer asks the control thread to wake
+// at the next boundary instead of up to a control period after it. Every
+// transition's planned and actual time is kept, and PhaseSequencerReport
+// prints them once the maneuver is over, so the control thread doesn't
+// format console messages in the middle of it.
+
+// Most phases a sequence keeps transition times for
+const int PHASE_SEQUENCER_MAX_PHASES = 4;
+
+struct PhaseSequencer {
+    const char* name;             // Prefix of the console report, eg "Jump"
+    const uint32_t* durations_us; // Length of each phase
+    int num_phases;
+    uint64_t start_us;            // Planned start of phase 0
+    uint64_t phase_start_us;      // Planned start of the current phase
+    int phase;                    // Current phase, num_phases once finished
+    // Planned and actual start of phases 1 on, us since start_us
+    uint32_t planned_us[PHASE_SEQUENCER_MAX_PHASES];
+    uint32_t actual_us[PHASE_SEQUENCER_MAX_PHASES];
+    uint8_t early;                // Bit k set if phase k+1 started early
+    int reported;                 // Transitions already printed
+};
+
+uint64_t Micros64();
+
+void PhaseSequencerStart(struct PhaseSequencer& s, const char* name,
+                         const uint32_t* durations_us, int num_phases, uint64_t start_us);
+int PhaseSequencerUpdate(struct PhaseSequencer& s, uint64_t now_us);
+int PhaseSequencerEndPhase(struct PhaseSequencer& s, uint64_t now_us);
+void PhaseSequencerReport(struct PhaseSequencer& s);
+
+#endif
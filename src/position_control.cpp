@@ -6,6 +6,20 @@
 #include "jump.h"
 #include <math.h>
 #include "backflip.h"
+#include "datalog.h"
+#include "flight_recorder.h"
+#include "console.h"
+#include "gait_params.h"
+#include "usb_serial.h"
+#include "script.h"
+#include "trajectory.h"
+#include "kinematics.h"
+#include "state_estimator.h"
+#include "foot_forces.h"
+#include "contact.h"
+#include "phase_sequencer.h"
+#include "gait_kernels.h"
+#include "gait_patterns.h"
 
 //------------------------------------------------------------------------------
 // PositionControlThread: Motor position control thread
@@ -18,7 +32,19 @@
 //
 //   odrv.SetCoupledPosition(theta,gamma);
 // }
-THD_WORKING_AREA(waPositionControlThread, 512);
+// Commands are interpreted on this thread (see ProcessCommandMailbox), so the
+// stack also has to fit the command handlers and their console messages: 'G'
+// listing the patterns or 'C' running the gait benchmark nest about 1kB of
+// frames under InterpretCommand before any float formatting and the FPU
+// exception frame. Same size as the USB thread these handlers came from.
+THD_WORKING_AREA(waPositionControlThread, 2048);
+
+// Signaled to run the next tick early, eg for a STOP
+static BSEMAPHORE_DECL(control_wakeup, true);
+
+// Micros64() time the next tick should run by, 0 if the tick period will do.
+// Set with PositionControlWakeAt.
+static uint64_t control_wake_at_us = 0;
 
 THD_FUNCTION(PositionControlThread, arg) {
     (void)arg;
@@ -27,73 +53,164 @@ THD_FUNCTION(PositionControlThread, arg) {
     chThdSleepMilliseconds(100);
     SetODriveCurrentLimits(CURRENT_LIM);
 
+    // Publish the default gait parameters
+    GaitParamsCommit();
+
     while(true) {
+        uint32_t tick_start = micros();
+        ProcessCommandMailbox();
+        StateEstimatorUpdate(tick_start);
+        FootForcesUpdate(tick_start);
+        ContactUpdate(tick_start);
+        PositionControlTick();
+        uint32_t tick_us = micros() - tick_start;
+        RecordCommandLatency(tick_start + tick_us);
+        control_tick_us = tick_us;
+        DatalogRecordTick(tick_start, tick_us);
+        FlightRecorderRecordTick(tick_start, tick_us);
+        uint32_t sleep_us = PositionControlSleepUs(Micros64());
+        chBSemWaitTimeout(&control_wakeup, sleep_us == 0 ? TIME_IMMEDIATE : TIME_US2I(sleep_us));
+    }
+}
+
+/**
+ * Make the control thread run a tick at t_us (a Micros64() time) if that is
+ * before its next periodic tick. Holds for one sleep only, so call it again
+ * every tick until the time is reached. The tick can still run up to a
+ * ChibiOS system tick late.
+ */
+void PositionControlWakeAt(uint64_t t_us) {
+    if (control_wake_at_us == 0 || t_us < control_wake_at_us) {
+        control_wake_at_us = t_us;
+    }
+}
+
+/**
+ * How long the control thread sleeps after a tick: one period, or less to
+ * meet a PositionControlWakeAt time, which this clears.
+ * @param now_us Micros64() after the tick
+ */
+uint32_t PositionControlSleepUs(uint64_t now_us) {
+    uint32_t sleep_us = 1000000/POSITION_CONTROL_FREQ;
+    if (control_wake_at_us != 0) {
+        if (control_wake_at_us <= now_us) {
+            sleep_us = 0;
+        } else if (control_wake_at_us - now_us < sleep_us) {
+            sleep_us = control_wake_at_us - now_us;
+        }
+        control_wake_at_us = 0;
+    }
+    return sleep_us;
+}
+
+/**
+ * Make the control thread run its next tick as soon as it is scheduled
+ * instead of at the end of its sleep.
+ */
+void PositionControlWake() {
+    chBSemSignal(&control_wakeup);
+}
+
+/**
+ * Software e-stop: put the robot in STOP, which moves the legs to the neutral
+ * position, and have the flight recorder dump the moments before it. Returns
+ * straight away so the flight recorder thread gets to run the dump. The USB
+ * thread calls it as soon as a STOP arrives; behaviors that block the control
+ * thread wait with TickSleep so they give up at once.
+ */
+void ESTOP() {
+    state = STOP;
+    FlightRecorderTrigger(FR_REASON_ESTOP);
+}
 
-        struct GaitParams gait_params = state_gait_params[state];
-
-        switch(state) {
-            case STOP:
-                {
-                    LegGain stop_gain = {50, 0.5, 50, 0.5};
-                    float y1 = 0.15;
-                    float y2 = 0.15;
-                    float theta1, gamma1, theta2, gamma2;
-                    CartesianToThetaGamma(0.0, y1, 1, theta1, gamma1);
-                    CartesianToThetaGamma(0.0, y2, 1, theta2, gamma2);
-
-                    odrv0Interface.SetCoupledPosition(theta2, gamma2, stop_gain);
-                    odrv1Interface.SetCoupledPosition(theta1, gamma1, stop_gain);
-                    odrv2Interface.SetCoupledPosition(theta1, gamma1, stop_gain);
-                    odrv3Interface.SetCoupledPosition(theta2, gamma2, stop_gain);
-                }
-                break;
-            case DANCE:
-                gait(gait_params, 0.0, 0.5, 0.0, 0.5, gait_gains);
-                break;
-            case BOUND:
-                gait(gait_params, 0.0, 0.5, 0.5, 0.0, gait_gains);
-                break;
-            case TROT:
-                gait(gait_params, 0.0, 0.5, 0.0, 0.5, gait_gains);
-                break;
-            case TURN_TROT:
-                gait(gait_params, 0.0, 0.5, 0.0, 0.5, gait_gains);
-                break;
-            case WALK:
-                gait(gait_params, 0.0, 0.25, 0.75, 0.5, gait_gains);
-                break;
-            case PRONK:
-                gait(gait_params, 0.0, 0.0, 0.0, 0.0, gait_gains);
-                break;
-            case JUMP:
-                ExecuteJump();
-                break;
-            case ROTATE:
-                {
-                float theta,gamma;
-                CartesianToThetaGamma(0, 0.24, 1.0, theta, gamma);
-                float freq = 0.1;
-                float phase = freq * (millis() - rotate_start)/1000.0f;
-                theta = (-cos(2*PI * phase) + 1.0f) * 0.5 * 2 * PI;
-                CommandAllLegs(theta, gamma, gait_gains);
-                }
-            case HOP:
-                hop(gait_params);
-                break;
-            case FLIP:
-                ExecuteFlip(gait_params);
-                break;
-            case RESET:
-                reset();
-                break;
-            case TEST:
-                test();
-                break;
+/**
+ * Sleep in the middle of a control tick, eg between the phases of a hop,
+ * unless the robot is stopped. A STOP wakes it up early, and the next tick
+ * then runs straight away.
+ * @return False if the robot was stopped
+ */
+static bool TickSleep(uint32_t us) {
+    uint32_t start = micros();
+    while (state != STOP) {
+        uint32_t elapsed = micros() - start;
+        if (elapsed >= us) {
+            return true;
         }
+        chBSemWaitTimeout(&control_wakeup, TIME_US2I(us - elapsed));
+    }
+    chBSemSignal(&control_wakeup);
+    return false;
+}
 
-        chThdSleepMicroseconds(1000000/POSITION_CONTROL_FREQ);
+/**
+ * Run one iteration of the control loop: compute the setpoints for the current
+ * state and send them to the ODrives. Kept separate from the thread body so
+ * the host replay harness (tools/replay) can step the controller directly.
+ */
+void PositionControlTick() {
+    // Parameters were validated when they were committed
+    struct GaitParams gait_params;
+    struct LegGain gains;
+    GaitParamsRead(state, gait_params, gains);
+    // A flip cut short, eg by a STOP, leaves its IMU trigger armed
+    if (state != FLIP) {
+        EndFlip();
+    }
+
+    switch(state) {
+        case STOP:
+            {
+                LegGain stop_gain = {50, 0.5, 50, 0.5};
+                float theta, gamma;
+                CartesianToThetaGamma(0.0, 0.15, 1, theta, gamma);
+                // Recorded as the setpoints too, so whatever starts from the
+                // current setpoints (eg a script's first ramp) starts here
+                CommandAllLegs(theta, gamma, stop_gain);
+            }
+            break;
+        case DANCE:
+        case BOUND:
+        case TROT:
+        case TURN_TROT:
+        case WALK:
+        case PRONK:
+        case PATTERN:
+            GaitPatternTick(gait_params, gains);
+            break;
+        case JUMP:
+            ExecuteJump();
+            break;
+        case ROTATE:
+            {
+            float theta,gamma;
+            CartesianToThetaGamma(0, 0.24, 1.0, theta, gamma);
+            float freq = 0.1;
+            float phase = freq * (millis() - rotate_start)/1000.0f;
+            theta = (-cos(2*PI * phase) + 1.0f) * 0.5 * 2 * PI;
+            CommandAllLegs(theta, gamma, gains);
+            }
+            break;
+        case HOP:
+            hop(gait_params);
+            break;
+        case FLIP:
+            ExecuteFlip(gait_params, gains);
+            break;
+        case RESET:
+            reset();
+            break;
+        case TEST:
+            test();
+            break;
+        case SCRIPT:
+            ExecuteScript();
+            break;
+        case TRAJECTORY:
+            ExecuteTrajectory(gains);
+            break;
     }
 }
+
 long rotate_start = 0; // milliseconds when rotate was commanded
 States state = STOP;
 
@@ -112,7 +229,10 @@ struct GaitParams state_gait_params[] = {
     {NAN, NAN, NAN, NAN, NAN, NAN, NAN}, // ROTATE
     {0.15, 0.07, 0.06, 0.2, 0.0, 1.0, 0.0}, // FLIP
     {0.17, 0.04, 0.06, 0.35, 0.1, 2.0, 0.06}, // TURN_TROT
-    {NAN, NAN, NAN, NAN, NAN, NAN, NAN} // RESET
+    {NAN, NAN, NAN, NAN, NAN, NAN, NAN}, // RESET
+    {NAN, NAN, NAN, NAN, NAN, NAN, NAN}, // SCRIPT
+    {NAN, NAN, NAN, NAN, NAN, NAN, NAN}, // TRAJECTORY
+    {0.17, 0.04, 0.06, 0.35, 0.0, 2.0, 0.0} // PATTERN
 };
 struct LegGain gait_gains = {80, 0.5, 50, 0.5};
 
@@ -138,18 +258,18 @@ void SetODriveCurrentLimits(float limit) {
 * Takes the leg parameters and returns the gamma angle (rad) of the legs
 */
 void GetGamma(float L, float theta, float& gamma) {
-    float L1 = 0.09; // upper leg length (m)
-    float L2 = 0.162; // lower leg length (m)
+    float L1 = LEG_L1;
+    float L2 = LEG_L2;
     float cos_param = (pow(L1,2.0) + pow(L,2.0) - pow(L2,2.0)) / (2.0*L1*L);
     if (cos_param < -1.0) {
         gamma = PI;
         #ifdef DEBUG_HIGH
-        Serial.println("ERROR: L is too small to find valid alpha and beta!");
+        ConsoleMessage().println("ERROR: L is too small to find valid alpha and beta!");
         #endif
       } else if (cos_param > 1.0) {
         gamma = 0;
         #ifdef DEBUG_HIGH
-        Serial.println("ERROR: L is too large to find valid alpha and beta!");
+        ConsoleMessage().println("ERROR: L is too large to find valid alpha and beta!");
         #endif
       } else {
         gamma = acos(cos_param);
@@ -174,31 +294,47 @@ void CartesianToLegParams(float x, float y, float leg_direction, float& L, float
 }
 
 /**
-* Sinusoidal trajectory generator function with flexibility from parameters described below. Can do 4-beat, 2-beat, trotting, etc with this.
-*/
-void SinTrajectory (float t, struct GaitParams params, float gaitOffset, float& x, float& y) {
+ * Advance the gait cycle to t and return it, in cycles. All legs share one
+ * cycle, so only the first call of a tick moves it.
+ * @param t Time (s), millis()/1000
+ */
+float GaitPhaseAdvance(float t, float freq) {
     static float p = 0;
     static float prev_t = 0;
 
+    p += freq * (t - prev_t < 0.5 ? t - prev_t : 0); // should reduce the lurching when starting a new gait
+    prev_t = t;
+    return p;
+}
+
+/**
+ * Foot position at a point in the gait cycle, swinging forward for the first
+ * flightPercent of the cycle and pushing back for the rest.
+ * @param gp Point in the cycle, 0 to 1
+ * @param stepLength Step length of this leg, params.step_length -/+ step_diff
+ * @param swing GaitSwingProfile
+ * @param stance GaitStanceProfile
+ */
+void GaitFootAt(float gp, const struct GaitParams& params, float stepLength, float flightPercent,
+                int swing, int stance, float& x, float& y) {
     float stanceHeight = params.stance_height;
     float downAMP = params.down_amp;
     float upAMP = params.up_amp;
-    float flightPercent = params.flight_percent;
-    float stepLength = params.step_length;
-    float FREQ = params.freq;
 
-    p += FREQ * (t - prev_t < 0.5 ? t - prev_t : 0); // should reduce the lurching when starting a new gait
-    prev_t = t;
-
-    float gp = fmod((p+gaitOffset),1.0); // mod(a,m) returns remainder division of a by m
     if (gp <= flightPercent) {
-        x = (gp/flightPercent)*stepLength - stepLength/2.0;
-        y = -upAMP*sin(PI*gp/flightPercent) + stanceHeight;
+        float percentFront = gp/flightPercent;
+        if (swing == SWING_CYCLOID) {
+            x = (percentFront - sin(2*PI*percentFront)/(2*PI))*stepLength - stepLength/2.0;
+            y = -upAMP*0.5*(1.0 - cos(2*PI*percentFront)) + stanceHeight;
+        } else {
+            x = (gp/flightPercent)*stepLength - stepLength/2.0;
+            y = -upAMP*sin(PI*gp/flightPercent) + stanceHeight;
+        }
     }
     else {
         float percentBack = (gp-flightPercent)/(1.0-flightPercent);
         x = -percentBack*stepLength + stepLength/2.0;
-        y = downAMP*sin(PI*percentBack) + stanceHeight;
+        y = stance == STANCE_FLAT ? stanceHeight : downAMP*sin(PI*percentBack) + stanceHeight;
     }
 }
 
@@ -220,21 +356,21 @@ bool IsValidLegGain(struct LegGain gains) {
     bool bad =  gains.kp_theta < 0 || gains.kd_theta < 0 ||
                 gains.kp_gamma < 0 || gains.kd_gamma < 0;
     if (bad) {
-        Serial.println("Invalid gains: <0");
+        ConsoleMessage().println("Invalid gains: <0");
         return false;
     }
     // check for instability / sensor noise amplification
     bad = bad || gains.kp_theta > 320 || gains.kd_theta > 10 ||
                  gains.kp_gamma > 320 || gains.kd_gamma > 10;
     if (bad) {
-        Serial.println("Invalid gains: too high.");
+        ConsoleMessage().println("Invalid gains: too high.");
         return false;
     }
     // check for underdamping -> instability
     bad = bad || (gains.kp_theta > 200 && gains.kd_theta < 0.1);
     bad = bad || (gains.kp_gamma > 200 && gains.kd_gamma < 0.1);
     if (bad) {
-        Serial.println("Invalid gains: underdamped");
+        ConsoleMessage().println("Invalid gains: underdamped");
         return false;
     }
     return true;
@@ -252,26 +388,26 @@ bool IsValidGaitParams(struct GaitParams params) {
     float FREQ = params.freq;
 
     if (stanceHeight + downAMP > maxL || sqrt(pow(stanceHeight, 2) + pow(stepLength / 2.0, 2)) > maxL) {
-        Serial.println("Gait overextends leg");
+        ConsoleMessage().println("Gait overextends leg");
         return false;
     }
     if (stanceHeight - upAMP < minL) {
-        Serial.println("Gait underextends leg");
+        ConsoleMessage().println("Gait underextends leg");
         return false;
     }
 
     if (flightPercent <= 0 || flightPercent > 1.0) {
-        Serial.println("Flight percent is invalid");
+        ConsoleMessage().println("Flight percent is invalid");
         return false;
     }
 
     if (FREQ < 0) {
-        Serial.println("Frequency cannot be negative");
+        ConsoleMessage().println("Frequency cannot be negative");
         return false;
     }
 
     if (FREQ > 10.0) {
-        Serial.println("Frequency is too high (>10)");
+        ConsoleMessage().println("Frequency is too high (>10)");
         return false;
     }
 
@@ -279,58 +415,22 @@ bool IsValidGaitParams(struct GaitParams params) {
 }
 
 /**
- * Command the given odrive along a sinusoidal trajectry.
- * TODO finish documentation
- * @param odrive        [description]
- * @param t             [description]
- * @param params        [description]
- * @param gait_offset   [description]
- * @param leg_direction [description]
- * @param gains         [description]
- * @param theta         [description]
- * @param gamma         [description]
+ * Send each leg its own setpoint, odrv0 to odrv3, and record them for
+ * telemetry.
  */
-void CoupledMoveLeg(ODriveArduino& odrive, float t, struct GaitParams params,
-                    float gait_offset, float leg_direction, struct LegGain gains,
-                    float& theta, float& gamma) {
-    float x; // float x for leg 0 to be set by the sin trajectory
-    float y;
-    SinTrajectory(t, params, gait_offset, x, y);
-    CartesianToThetaGamma(x, y, leg_direction, theta, gamma);
-    odrive.SetCoupledPosition(theta, gamma, gains);
-}
-
-void gait(struct GaitParams params,
-                float leg0_offset, float leg1_offset,
-                float leg2_offset, float leg3_offset,
-                struct LegGain gains) {
-
-    struct GaitParams paramsR = params;
-    struct GaitParams paramsL = params;
-    paramsR.step_length -= params.step_diff;
-    paramsL.step_length += params.step_diff;
-
-    if (!IsValidGaitParams(paramsR) || !IsValidGaitParams(paramsL) || !IsValidLegGain(gains)) {
-        return;
-    }
-
-    float t = millis()/1000.0;
-
-    const float leg0_direction = -1.0;
-    CoupledMoveLeg(odrv0Interface, t, paramsL, leg0_offset, leg0_direction, gains,
-        global_debug_values.odrv0.sp_theta, global_debug_values.odrv0.sp_gamma);
-
-    const float leg1_direction = -1.0;
-    CoupledMoveLeg(odrv1Interface, t, paramsL, leg1_offset, leg1_direction, gains,
-        global_debug_values.odrv1.sp_theta, global_debug_values.odrv1.sp_gamma);
-
-    const float leg2_direction = 1.0;
-    CoupledMoveLeg(odrv2Interface, t, paramsR, leg2_offset, leg2_direction, gains,
-        global_debug_values.odrv2.sp_theta, global_debug_values.odrv2.sp_gamma);
-
-    const float leg3_direction = 1.0;
-    CoupledMoveLeg(odrv3Interface, t, paramsR, leg3_offset, leg3_direction, gains,
-        global_debug_values.odrv3.sp_theta, global_debug_values.odrv3.sp_gamma);
+void CommandLegSetpoints(const float theta[4], const float gamma[4], struct LegGain gains) {
+    odrv0Interface.SetCoupledPosition(theta[0], gamma[0], gains);
+    odrv1Interface.SetCoupledPosition(theta[1], gamma[1], gains);
+    odrv2Interface.SetCoupledPosition(theta[2], gamma[2], gains);
+    odrv3Interface.SetCoupledPosition(theta[3], gamma[3], gains);
+    global_debug_values.odrv0.sp_theta = theta[0];
+    global_debug_values.odrv0.sp_gamma = gamma[0];
+    global_debug_values.odrv1.sp_theta = theta[1];
+    global_debug_values.odrv1.sp_gamma = gamma[1];
+    global_debug_values.odrv2.sp_theta = theta[2];
+    global_debug_values.odrv2.sp_gamma = gamma[2];
+    global_debug_values.odrv3.sp_theta = theta[3];
+    global_debug_values.odrv3.sp_gamma = gamma[3];
 }
 
 void CommandAllLegs(float theta, float gamma, LegGain gains) {
@@ -379,96 +479,45 @@ void UpdateStateGaitParams(States curr_state) {
     }
 }
 
-/**
- * Dance gait parameters
- */
+// The built-in gaits. Their offsets and gains are in src/gait_kernels.h.
 void TransitionToDance() {
-    state = DANCE;
-    Serial.println("DANCE");
-    //            {s.h, d.a., u.a., f.p., s.l., fr.}
-    //gait_params = {0.15, 0.05, 0.05, 0.35, 0.0, 1.5};
-    UpdateStateGaitParams(DANCE);
-    gait_gains = {50, 0.5, 30, 0.5};
-    PrintGaitParams();
+    GaitPatternSelect(GaitPatternFind(DANCE));
 }
-/**
-* Pronk gait parameters
-*/
+
 void TransitionToPronk() {
-    state = PRONK;
-    Serial.println("PRONK");
-    //            {s.h, d.a., u.a., f.p., s.l., fr.}
-    //gait_params = {0.12, 0.05, 0.0, 0.75, 0.0, 1.0};
-    UpdateStateGaitParams(PRONK);
-    gait_gains = {80, 0.50, 50, 0.50};
-    PrintGaitParams();
+    GaitPatternSelect(GaitPatternFind(PRONK));
 }
 
-/**
-* Bound gait parameters
-*/
 void TransitionToBound() {
-    state = BOUND;
-    Serial.println("BOUND");
-    //            {s.h, d.a., u.a., f.p., s.l., fr.}
-    //gait_params = {0.17, 0.04, 0.06, 0.35, 0.0, 2.0};
-    UpdateStateGaitParams(BOUND);
-    gait_gains = {80, 0.5, 50, 0.5};
-    PrintGaitParams();
+    GaitPatternSelect(GaitPatternFind(BOUND));
 }
 
-/**
- * Walk gait parameters
- */
 void TransitionToWalk() {
-    state = WALK;
-    Serial.println("WALK");
-    //            {s.h, d.a., u.a., f.p., s.l., fr.}
-    //gait_params = {0.15, 0.00, 0.06, 0.25, 0.0, 1.5};
-    UpdateStateGaitParams(WALK);
-    gait_gains = {80, 0.5, 50, 0.5};
-    PrintGaitParams();
+    GaitPatternSelect(GaitPatternFind(WALK));
 }
 
-/**
-* Trot gait parameters
-*/
 void TransitionToTrot() {
-    state = TROT;
-    Serial.println("TROT");
-    //            {s.h, d.a., u.a., f.p., s.l., fr.}
-    //gait_params = {0.17, 0.04, 0.06, 0.35, 0.15, 2.0};
-    UpdateStateGaitParams(TROT);
-    state_gait_params[TROT].step_diff = 0.0; // TROT should always go straight
-    gait_gains = {80, 0.5, 50, 0.5};
-    PrintGaitParams();
+    GaitPatternSelect(GaitPatternFind(TROT));
 }
 
-/**
-* Turn Trot gait parameters
-*/
 void TransitionToTurnTrot() {
-    state = TURN_TROT;
-    Serial.println("TURN_TROT");
-    //            {s.h, d.a., u.a., f.p., s.l., fr., sd.}
-    //gait_params = {0.17, 0.04, 0.06, 0.35, 0.1, 2.0, 0.06};
-    UpdateStateGaitParams(TURN_TROT);
-    gait_gains = {80, 0.5, 80, 0.5};
-    PrintGaitParams();
+    GaitPatternSelect(GaitPatternFind(TURN_TROT));
 }
 
 void TransitionToRotate() {
     state = ROTATE;
     rotate_start = millis();
-    Serial.println("ROTATE");
+    ConsoleMessage().println("ROTATE");
     gait_gains = {30,0.5,30,0.5};
+    GaitParamsCommit();
 }
 void TransitionToHop() {
     state = HOP;
-    Serial.println("HOP");
+    ConsoleMessage().println("HOP");
     //            {s.h, d.a., u.a., f.p., s.l., fr.}
     //gait_params = {0.15, 0.05, 0.05, 0.2, 0, 1.0};
     UpdateStateGaitParams(HOP);
+    GaitParamsCommit();
     PrintGaitParams();
 }
 
@@ -533,7 +582,34 @@ void test() {
     float amp = 1.0;
     float current = amp * sin(phase);
     odrv0Interface.SetCurrent(0, 1.0);
-    Serial.println(current);
+    ConsoleMessage().println(current);
+}
+
+/**
+ * Hold a command for all legs for up to max_us, resending it every control
+ * period so the ODrives reply with fresh positions for the contact detector.
+ * Returns early once the last foot lifts off and one comes back down, or on a
+ * STOP.
+ * @return true if a touchdown ended the wait
+ */
+static bool HoldUntilTouchdown(float theta, float gamma, struct LegGain gains, uint32_t max_us) {
+    const uint32_t period_us = 1000000/POSITION_CONTROL_FREQ;
+    uint32_t start = micros();
+    bool airborne = false;
+    while (micros() - start < max_us) {
+        uint32_t left = max_us - (micros() - start);
+        if (!TickSleep(left < period_us ? left : period_us)) {
+            return false;
+        }
+        ContactUpdate(micros());
+        if (contact_liftoffs != 0 && contact_legs == 0) {
+            airborne = true;
+        } else if (airborne && contact_touchdowns != 0) {
+            return true;
+        }
+        CommandAllLegs(theta, gamma, gains);
+    }
+    return false;
 }
 
 void hop(struct GaitParams params) {
@@ -544,58 +620,69 @@ void hop(struct GaitParams params) {
 
     CartesianToThetaGamma(0, params.stance_height - params.up_amp, 1, theta, gamma);
     CommandAllLegs(theta, gamma, land_gains);
-    chThdSleepMicroseconds(1000000*0.2/freq);
+    if (!TickSleep(1000000*0.2/freq)) {
+        return;
+    }
 
+    // Push off and fly, landing early if a foot strikes
     CartesianToThetaGamma(0, params.stance_height + params.down_amp, 1, theta, gamma);
     CommandAllLegs(theta, gamma, hop_gains);
-    chThdSleepMicroseconds(1000000*params.flight_percent/freq);
+    HoldUntilTouchdown(theta, gamma, hop_gains, 1000000*params.flight_percent/freq);
+    if (state == STOP) {
+        return;
+    }
 
     CartesianToThetaGamma(0, params.stance_height, 1, theta, gamma);
     CommandAllLegs(theta, gamma, land_gains);
-    chThdSleepMicroseconds(1000000*(0.8-params.flight_percent)/freq);
+    TickSleep(1000000*(0.8-params.flight_percent)/freq);
 
 
 }
 
 void reset() {
     gait_gains = {80, 0.5, 50, 0.5};
+    GaitParamsCommit();
 
     struct LegGain retract_gains = {0, 0.5, 6, 0.1};
     float theta, gamma;
     CartesianToThetaGamma(0, 0.08, 1, theta, gamma);
 
     CommandAllLegs(theta, gamma, retract_gains);
-    chThdSleepMilliseconds(4000);
+    if (!TickSleep(4000000)) {
+        return;
+    }
 
     struct LegGain rotate_gains = {6, 0.1, 2, 1};
     CommandAllLegs(theta, gamma, rotate_gains);
-    chThdSleepMilliseconds(4000);
+    if (!TickSleep(4000000)) {
+        return;
+    }
 
     CartesianToThetaGamma(0, 0.17, 1, theta, gamma);
     struct LegGain extend_gains = {6, 0.1, 6, 0.1};
     CommandAllLegs(theta, gamma, extend_gains);
-    chThdSleepMilliseconds(4000);
+    if (!TickSleep(4000000)) {
+        return;
+    }
 
-    Serial.println("4");
-    chThdSleepMilliseconds(1000);
-    Serial.println("3");
-    chThdSleepMilliseconds(1000);
-    Serial.println("2");
-    chThdSleepMilliseconds(1000);
-    Serial.println("1");
-    chThdSleepMilliseconds(1000);
+    for (int i = 4; i >= 1; i--) {
+        ConsoleMessage().println(i);
+        if (!TickSleep(1000000)) {
+            return;
+        }
+    }
 
     state = STOP;
 }
 
 void PrintGaitParams() {
-    Serial << ("(f)req: ") << state_gait_params[state].freq << '\n';
-    Serial << ("step (l)ength: ") << state_gait_params[state].step_length << '\n';
-    Serial << ("stance (h)eight: ") << state_gait_params[state].stance_height << '\n';
-    Serial << ("(d)own amplitude: ") << state_gait_params[state].down_amp << '\n';
-    Serial << "(u)p amplitude: " << state_gait_params[state].up_amp << '\n';
-    Serial << ("flight (p)roportion: ") << state_gait_params[state].flight_percent << '\n';
-    Serial << ("(s)tep difference: ") << state_gait_params[state].step_diff << '\n';
-    Serial << "Theta: " << gait_gains.kp_theta << " " << gait_gains.kd_theta << '\n';
-    Serial << "Gamma: " << gait_gains.kp_gamma << " " << gait_gains.kd_gamma << '\n';
+    ConsoleMessage() << ("(f)req: ") << state_gait_params[state].freq << '\n';
+    ConsoleMessage() << ("step (l)ength: ") << state_gait_params[state].step_length << '\n';
+    ConsoleMessage() << ("stance (h)eight: ") << state_gait_params[state].stance_height << '\n';
+    ConsoleMessage() << ("(d)own amplitude: ") << state_gait_params[state].down_amp << '\n';
+    ConsoleMessage() << "(u)p amplitude: " << state_gait_params[state].up_amp << '\n';
+    ConsoleMessage() << ("flight (p)roportion: ") << state_gait_params[state].flight_percent << '\n';
+    ConsoleMessage() << ("(s)tep difference: ") << state_gait_params[state].step_diff << '\n';
+    ConsoleMessage() << "Theta: " << gait_gains.kp_theta << " " << gait_gains.kd_theta << '\n';
+    ConsoleMessage() << "Gamma: " << gait_gains.kp_gamma << " " << gait_gains.kd_gamma << '\n';
 }
@@ -4,19 +4,25 @@
 #include "ChRt.h"
 #include "ODriveArduino.h"
 
-extern THD_WORKING_AREA(waPositionControlThread, 512);
+extern THD_WORKING_AREA(waPositionControlThread, 2048);
 extern THD_FUNCTION(PositionControlThread, arg);
 
+void PositionControlTick();
+void PositionControlWake();
+void ESTOP();
+void PositionControlWakeAt(uint64_t t_us);
+uint32_t PositionControlSleepUs(uint64_t now_us);
+
 void GetGamma(float L, float theta, float& gamma);
 void LegParamsToCartesian(float L, float theta, float& x, float& y);
 void CartesianToLegParams(float x, float y, float leg_direction, float& L, float& theta);
 void CartesianToThetaGamma(float x, float y, float leg_direction, float& theta, float& gamma);
-void SinTrajectory (float t, struct GaitParams params, float gaitOffset, float& x, float& y);
-void CoupledMoveLeg(ODriveArduino& odrive, float t, struct GaitParams params, float gait_offset, float leg_direction, struct LegGain gains);
+float GaitPhaseAdvance(float t, float freq);
+void GaitFootAt(float gp, const struct GaitParams& params, float stepLength, float flightPercent,
+                int swing, int stance, float& x, float& y);
 bool IsValidGaitParams(struct GaitParams params);
 bool IsValidLegGain(struct LegGain gain);
 void SinTrajectoryPosControl();
-void gait(struct GaitParams params, float leg0_offset, float leg1_offset, float leg2_offset, float leg3_offset, struct LegGain gains);
 void TransitionToDance();
 void TransitionToWalk();
 void TransitionToTrot();
@@ -31,6 +37,7 @@ void test();
 void hop(struct GaitParams params);
 void reset();
 void CommandAllLegs(float theta, float gamma, struct LegGain gains);
+void CommandLegSetpoints(const float theta[4], const float gamma[4], struct LegGain gains);
 
 enum States {
     STOP = 0,
@@ -45,7 +52,21 @@ enum States {
     ROTATE = 9,
     FLIP = 10,
     TURN_TROT = 11,
-    RESET = 12
+    RESET = 12,
+    SCRIPT = 13,
+    TRAJECTORY = 14,
+    PATTERN = 15
+};
+
+// How the foot moves during the swing (foot in the air) and stance parts of
+// a gait cycle
+enum GaitSwingProfile {
+    SWING_SINE = 0,    // Straight forward, lifted along half a sine
+    SWING_CYCLOID = 1  // Cycloid: leaves and meets the ground with no velocity
+};
+enum GaitStanceProfile {
+    STANCE_SINE = 0,   // Straight back, pushed down_amp down along half a sine
+    STANCE_FLAT = 1    // Straight back at stance height
 };
 
 void UpdateStateGaitParams(States curr_state);
@@ -62,7 +83,7 @@ struct GaitParams {
     float step_diff = 0.0; //difference between left and right leg step length
 };
 
-extern struct GaitParams state_gait_params[13];
+extern struct GaitParams state_gait_params[16];
 extern struct LegGain gait_gains;
 extern long rotate_start; // milliseconds when rotate was commanded
 
@@ -0,0 +1,205 @@
+#include "script.h"
+#include "Arduino.h"
+#include "ODriveArduino.h"
+#include "config.h"
+#include "globals.h"
+#include "position_control.h"
+#include "kinematics.h"
+#include "flight_recorder.h"
+#include "console.h"
+#include "imu.h"
+
+// Uploaded script. Zeroed memory is a single SCRIPT_END, ie an empty script.
+static struct ScriptKeyframe script[SCRIPT_MAX_KEYFRAMES];
+
+// Target of one leg, set by the last keyframe that moved it
+struct ScriptLeg {
+    float from_theta, from_gamma; // Previous target, where a ramp starts
+    float to_theta, to_gamma;
+    struct LegGain gains;
+    uint8_t flags;
+    uint32_t start_us; // When the keyframe that set this target started
+    uint32_t ramp_us;
+};
+
+static struct ScriptLeg script_legs[4];
+static int keyframe_ = 0;
+static uint32_t keyframe_start_us_ = 0;
+
+// Theta sign of each leg, as in CommandLegsThetaY, so a symmetric pose is one
+// theta for all four legs
+static const float theta_sign[4] = {1.0, 1.0, -1.0, -1.0};
+
+/**
+ * Store one keyframe of the script. The script can't change while it runs.
+ * @return false if the script is running or index is out of range
+ */
+bool ScriptSetKeyframe(int index, const struct ScriptKeyframe& keyframe) {
+    if (state == SCRIPT || index < 0 || index >= SCRIPT_MAX_KEYFRAMES) {
+        return false;
+    }
+    script[index] = keyframe;
+    return true;
+}
+
+static struct LegGain KeyframeGains(const struct ScriptKeyframe& k) {
+    struct LegGain gains = {k.kp_theta / 100.0f, k.kd_theta / 100.0f,
+                            k.kp_gamma / 100.0f, k.kd_gamma / 100.0f};
+    return gains;
+}
+
+/**
+ * Check the whole script once before it starts, so nothing needs checking
+ * inside the control tick.
+ * @return true if the script can run
+ */
+static bool IsValidScript() {
+    for (int i = 0; i < SCRIPT_MAX_KEYFRAMES; i++) {
+        const struct ScriptKeyframe& k = script[i];
+        if (k.op == SCRIPT_END) {
+            if (i == 0) {
+                ConsoleMessage().println("Script is empty");
+                return false;
+            }
+            return true;
+        }
+        if (k.op > SCRIPT_UNTIL_PITCH_BELOW) {
+            ConsoleMessage() << "Script keyframe " << i << ": unknown op " << k.op << "\n";
+            return false;
+        }
+        if (k.op != SCRIPT_UNTIL_TIME && k.duration_ms == 0) {
+            ConsoleMessage() << "Script keyframe " << i << ": pitch guard needs a timeout\n";
+            return false;
+        }
+        if ((k.legs & ~SCRIPT_ALL_LEGS) || (i == 0 && k.legs != SCRIPT_ALL_LEGS)) {
+            ConsoleMessage() << "Script keyframe " << i << ": bad legs, the first keyframe must set all four\n";
+            return false;
+        }
+        if ((k.flags & SCRIPT_FLAG_CARTESIAN) && k.b <= 0) {
+            ConsoleMessage() << "Script keyframe " << i << ": foot y must be positive\n";
+            return false;
+        }
+        if (!IsValidLegGain(KeyframeGains(k))) {
+            ConsoleMessage() << "Script keyframe " << i << ": invalid gains\n";
+            return false;
+        }
+    }
+    ConsoleMessage().println("Script has no end");
+    return false;
+}
+
+/**
+ * Make keyframe index current and update the targets of the legs it moves.
+ * @param start_us When the keyframe started
+ */
+static void EnterKeyframe(int index, uint32_t start_us) {
+    keyframe_ = index;
+    keyframe_start_us_ = start_us;
+    const struct ScriptKeyframe& k = script[index];
+    if (k.op == SCRIPT_END) {
+        return;
+    }
+
+    struct LegGain gains = KeyframeGains(k);
+    for (int i = 0; i < 4; i++) {
+        if ((k.legs & (1 << i)) == 0) {
+            continue;
+        }
+        struct ScriptLeg& leg = script_legs[i];
+        leg.from_theta = leg.to_theta;
+        leg.from_gamma = leg.to_gamma;
+        if (k.flags & SCRIPT_FLAG_CARTESIAN) {
+            CartesianToThetaGamma(k.a / 10000.0f, k.b / 10000.0f, LEG_DIRECTION[i],
+                                  leg.to_theta, leg.to_gamma);
+        } else {
+            leg.to_theta = theta_sign[i] * k.a / 1000.0f;
+            leg.to_gamma = k.b / 1000.0f;
+        }
+        leg.gains = gains;
+        leg.flags = k.flags;
+        leg.start_us = start_us;
+        leg.ramp_us = k.duration_ms * 1000UL;
+    }
+}
+
+/**
+ * Validate the uploaded script and switch to the SCRIPT state to run it.
+ * Ramps in the first keyframe start from the current leg setpoints.
+ * @return false if the script was rejected
+ */
+bool StartScript() {
+    if (!IsValidScript()) {
+        ConsoleMessage().println("Script rejected");
+        return false;
+    }
+    const struct ODrive* sp[4] = {&global_debug_values.odrv0, &global_debug_values.odrv1,
+                                  &global_debug_values.odrv2, &global_debug_values.odrv3};
+    for (int i = 0; i < 4; i++) {
+        script_legs[i].to_theta = sp[i]->sp_theta;
+        script_legs[i].to_gamma = sp[i]->sp_gamma;
+    }
+    EnterKeyframe(0, micros());
+    state = SCRIPT;
+    FlightRecorderTrigger(FR_REASON_SCRIPT);
+    ConsoleMessage().println("SCRIPT");
+    return true;
+}
+
+/**
+ * Run one control tick of the script: advance past finished keyframes, then
+ * send every leg its target. Timed keyframes start exactly where the previous
+ * one ended rather than at the tick that noticed, so a script's timing
+ * doesn't depend on the control rate.
+ */
+void ExecuteScript() {
+    uint32_t now = micros();
+    struct Attitude attitude;
+    IMUPredictAttitude(now, attitude);
+    float pitch = attitude.pitch;
+
+    while (true) {
+        const struct ScriptKeyframe& k = script[keyframe_];
+        uint32_t elapsed_us = now - keyframe_start_us_;
+        uint32_t duration_us = k.duration_ms * 1000UL;
+        if (k.op == SCRIPT_END) {
+            state = STOP;
+            ConsoleMessage().println("Script Complete.");
+            return;
+        } else if (k.op == SCRIPT_UNTIL_TIME) {
+            if (elapsed_us < duration_us) break;
+            EnterKeyframe(keyframe_ + 1, keyframe_start_us_ + duration_us);
+        } else {
+            float guard = k.guard / 1000.0f;
+            bool met = k.op == SCRIPT_UNTIL_PITCH_ABOVE ? pitch > guard : pitch < guard;
+            if (met) {
+                EnterKeyframe(keyframe_ + 1, now);
+            } else if (elapsed_us >= duration_us) {
+                state = STOP;
+                ConsoleMessage() << "Script keyframe " << keyframe_ << " timed out waiting for pitch, stopping\n";
+                return;
+            } else {
+                break;
+            }
+        }
+    }
+
+    ODriveArduino* odrives[4] = {&odrv0Interface, &odrv1Interface, &odrv2Interface, &odrv3Interface};
+    struct ODrive* sp[4] = {&global_debug_values.odrv0, &global_debug_values.odrv1,
+                            &global_debug_values.odrv2, &global_debug_values.odrv3};
+    for (int i = 0; i < 4; i++) {
+        const struct ScriptLeg& leg = script_legs[i];
+        float theta = leg.to_theta;
+        float gamma = leg.to_gamma;
+        uint32_t t = now - leg.start_us;
+        if ((leg.flags & SCRIPT_FLAG_RAMP) && t < leg.ramp_us) {
+            float frac = (float)t / leg.ramp_us;
+            theta = leg.from_theta + (leg.to_theta - leg.from_theta) * frac;
+            gamma = leg.from_gamma + (leg.to_gamma - leg.from_gamma) * frac;
+        }
+        if (leg.flags & SCRIPT_FLAG_PITCH) theta += theta_sign[i] * pitch;
+        if (leg.flags & SCRIPT_FLAG_NEG_PITCH) theta -= theta_sign[i] * pitch;
+        odrives[i]->SetCoupledPosition(theta, gamma, leg.gains);
+        sp[i]->sp_theta = theta;
+        sp[i]->sp_gamma = gamma;
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include "script_format.h"
+
+bool ScriptSetKeyframe(int index, const struct ScriptKeyframe& keyframe);
+bool StartScript();
+void ExecuteScript();
+
+#endif
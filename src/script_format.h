@@ -0,0 +1,47 @@
+#ifndef SCRIPT_FORMAT_H
+#define SCRIPT_FORMAT_H
+
+#include <stdint.h>
+
+// Keyframe format for motion scripts run by the SCRIPT state (see script.cpp).
+// Only depends on stdint so host tools (tools/scriptc) can include it.
+//
+// A script is a list of keyframes ending with SCRIPT_END. Each keyframe sets
+// targets and gains for some legs and holds them until its end condition:
+// a fixed time, or a body pitch threshold with duration_ms as the timeout.
+// Legs not in a keyframe keep their previous targets, so the first keyframe
+// has to set all four. Keyframes are uploaded one at a time in
+// COMMAND_KEYFRAME frames (see command_format.h).
+
+enum ScriptOp {
+    SCRIPT_END = 0, // Script done, go to STOP
+    SCRIPT_UNTIL_TIME = 1, // Next keyframe after duration_ms
+    SCRIPT_UNTIL_PITCH_ABOVE = 2, // Next keyframe once pitch > guard, STOP after duration_ms
+    SCRIPT_UNTIL_PITCH_BELOW = 3 // Next keyframe once pitch < guard, STOP after duration_ms
+};
+
+enum ScriptFlags {
+    SCRIPT_FLAG_CARTESIAN = 1, // a, b are foot x, y instead of theta, gamma
+    SCRIPT_FLAG_RAMP = 2, // Move linearly from the previous target over duration_ms
+    SCRIPT_FLAG_PITCH = 4, // Add the body pitch to theta
+    SCRIPT_FLAG_NEG_PITCH = 8 // Subtract the body pitch from theta
+};
+
+// Leg n is bit n, ie legs driven by odrvn
+const uint8_t SCRIPT_ALL_LEGS = 0x0F;
+
+#pragma pack(push, 1)
+struct ScriptKeyframe {
+    uint8_t op; // ScriptOp
+    uint8_t flags; // ScriptFlags
+    uint8_t legs; // Legs this keyframe moves
+    uint8_t reserved;
+    uint16_t duration_ms; // Length, or timeout for pitch guards
+    int16_t guard; // Pitch threshold for the pitch guards (mrad)
+    int16_t a; // Foot x (1/10 mm) or theta (mrad)
+    int16_t b; // Foot y (1/10 mm) or gamma (mrad)
+    int16_t kp_theta, kd_theta, kp_gamma, kd_gamma; // Gains in 1/100 units
+};
+#pragma pack(pop)
+
+#endif
@@ -0,0 +1,83 @@
+#include "stance_forces.h"
+#include <math.h>
+#include "kinematics.h"
+
+/**
+ * Point on the segment from (ax, az) to (bx, bz) closest to (px, pz), and
+ * its squared distance.
+ */
+static float ClosestOnSegment(float px, float pz, float ax, float az, float bx, float bz,
+                              float& cx, float& cz) {
+    float dx = bx - ax, dz = bz - az;
+    float len2 = dx * dx + dz * dz;
+    float t = len2 > 0 ? ((px - ax) * dx + (pz - az) * dz) / len2 : 0;
+    t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    cx = ax + t * dx;
+    cz = az + t * dz;
+    return (px - cx) * (px - cx) + (pz - cz) * (pz - cz);
+}
+
+/**
+ * Move a ground reaction to the nearest point inside its limits: the friction
+ * cone |rx| <= friction * rz cut at min_vertical and max_vertical. A foot
+ * with max_vertical <= 0 is in the air and gets no force.
+ */
+void ProjectFrictionTrapezoid(float& rx, float& rz, float friction, float min_vertical, float max_vertical) {
+    if (max_vertical <= 0) {
+        rx = rz = 0;
+        return;
+    }
+    float lo = min_vertical < max_vertical ? min_vertical : max_vertical;
+    float hi = max_vertical;
+    // The trapezoid is symmetric in rx, so work on its right half
+    float a = fabsf(rx);
+    if (rz >= lo && rz <= hi && a <= friction * rz) {
+        return;
+    }
+    float best_x, best_z, x, z;
+    // Bottom, top and the side of the cone
+    float best = ClosestOnSegment(a, rz, 0, lo, friction * lo, lo, best_x, best_z);
+    float d = ClosestOnSegment(a, rz, 0, hi, friction * hi, hi, x, z);
+    if (d < best) {
+        best = d;
+        best_x = x;
+        best_z = z;
+    }
+    d = ClosestOnSegment(a, rz, friction * lo, lo, friction * hi, hi, x, z);
+    if (d < best) {
+        best_x = x;
+        best_z = z;
+    }
+    rx = rx < 0 ? -best_x : best_x;
+    rz = best_z;
+}
+
+/**
+ * Foot force in the leg frame of src/kinematics.h for a ground reaction in
+ * the world frame. The foot pushes on the ground opposite to the reaction,
+ * and the leg frame is turned by pitch with y down.
+ */
+void GroundReactionToFootForce(float rx, float rz, float pitch, float& fx, float& fy) {
+    float c = cosf(pitch), s = sinf(pitch);
+    fx = -(c * rx + s * rz);
+    fy = c * rz - s * rx;
+}
+
+/**
+ * Largest rz a leg can push with anywhere in its friction cone without
+ * either motor going over current_limit. Conservative: the currents are
+ * linear in the force, so it is enough to check the two edges of the cone.
+ * @return Force limit (N), 0 if the leg can't push at all
+ */
+float StanceForceMaxVertical(float theta, float gamma, float leg_direction, float pitch,
+                             float friction, float current_limit) {
+    float worst = 0;
+    for (int side = -1; side <= 1; side += 2) {
+        float fx, fy, i_theta, i_gamma, current0, current1;
+        GroundReactionToFootForce(side * friction, 1, pitch, fx, fy);
+        LegFootForceToCurrents(theta, gamma, leg_direction, fx, fy, i_theta, i_gamma);
+        CoupledToMotorCurrents(i_theta, i_gamma, current0, current1);
+        worst = fmaxf(worst, fmaxf(fabsf(current0), fabsf(current1)));
+    }
+    return worst > 0 ? current_limit / worst : 0;
+}
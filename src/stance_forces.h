@@ -0,0 +1,184 @@
+#ifndef STANCE_FORCES_H
+#define STANCE_FORCES_H
+
+#include <math.h>
+
+// Distributes a desired force and pitch torque on the body across the feet on
+// the ground. Sagittal plane, world frame: x forward, z up, torque positive
+// nose up, feet relative to the body's centre of mass. The unknowns are the
+// ground reactions on the feet, (rx, rz). Each must stay in its friction
+// cone, |rx| <= friction * rz, with rz between min_vertical and a per-foot
+// maximum that the caller derives from the current limit
+// (StanceForceMaxVertical). Within those limits the solver minimises
+//   1/2 sum_k w_k (wrench_k - desired_k)^2 + 1/2 regularization |P (r - share)|^2
+// where share is the desired force split evenly over the stance feet and P
+// keeps only the part of r - share that doesn't change the wrench. The
+// regularization settles the forces the wrench leaves free without giving up
+// any of it, and keeps the problem well enough conditioned for a few
+// iterations of projected gradient with Nesterov momentum and adaptive
+// restart. The iteration count is fixed, and so is the cost of a solve. Each
+// solve starts from the previous solution. A foot that just touched down
+// starts from its share.
+//
+// Sized by the template parameter and allocation free. One iteration costs
+// about 50 flops per leg. No Arduino dependencies, so tools/stance_forces
+// can build it on the host.
+
+struct BodyWrench {
+    float fx, fz;  // Force on the body, forward and up (N)
+    float torque;  // Pitch torque about the centre of mass, nose up (Nm)
+};
+
+struct StanceForceParams {
+    float friction;       // Ground friction coefficient
+    float min_vertical;   // Least rz a stance foot pushes with (N)
+    float force_weight;   // w_k of the two forces (1/N^2)
+    float torque_weight;  // w_k of the torque (1/(Nm)^2)
+    float regularization; // Pull of the internal forces towards the even share
+    int iterations;
+};
+
+template <int N>
+struct StanceForceSolver {
+    // Inputs: feet relative to the centre of mass (m), and the most rz each
+    // may push with (N), 0 for feet in the air
+    float foot_x[N], foot_z[N];
+    float max_vertical[N];
+    // Ground reactions (N), kept as the starting point of the next solve
+    float rx[N], rz[N];
+    // Wrench the reactions add up to
+    struct BodyWrench achieved;
+};
+
+void ProjectFrictionTrapezoid(float& rx, float& rz, float friction, float min_vertical, float max_vertical);
+float StanceForceMaxVertical(float theta, float gamma, float leg_direction, float pitch,
+                             float friction, float current_limit);
+void GroundReactionToFootForce(float rx, float rz, float pitch, float& fx, float& fy);
+
+/**
+ * Clear the previous solution, eg after the feet were all in the air.
+ */
+template <int N>
+void StanceForceReset(struct StanceForceSolver<N>& s) {
+    for (int i = 0; i < N; i++) {
+        s.rx[i] = 0;
+        s.rz[i] = 0;
+    }
+    s.achieved.fx = s.achieved.fz = s.achieved.torque = 0;
+}
+
+/**
+ * Find the ground reactions that come closest to the desired wrench. Set
+ * foot_x, foot_z and max_vertical first. Leaves the reactions in s.rx, s.rz
+ * and their wrench in s.achieved.
+ */
+template <int N>
+void StanceForceSolve(struct StanceForceSolver<N>& s, const struct BodyWrench& desired,
+                      const struct StanceForceParams& p) {
+    // Sums over the feet that can push, for A A^T and A share, where A maps
+    // the reactions to the wrench
+    float min_vertical[N];
+    float feet = 0, sum_x = 0, sum_z = 0, sum_sq = 0;
+    for (int i = 0; i < N; i++) {
+        min_vertical[i] = s.max_vertical[i] < p.min_vertical ? s.max_vertical[i] : p.min_vertical;
+        if (s.max_vertical[i] > 0) {
+            feet += 1;
+            sum_x += s.foot_x[i];
+            sum_z += s.foot_z[i];
+            sum_sq += s.foot_x[i] * s.foot_x[i] + s.foot_z[i] * s.foot_z[i];
+        }
+    }
+    float share_x = feet > 0 ? desired.fx / feet : 0;
+    float share_z = feet > 0 ? desired.fz / feet : 0;
+    float share_torque = share_z * sum_x - share_x * sum_z;
+
+    // Inverse of A A^T = [n 0 -sz; 0 n sx; -sz sx sq], for projecting onto
+    // the forces A can't see. A single foot makes it singular, so the
+    // diagonal gets a little extra.
+    float g = feet + 1e-6f, h = sum_sq + 1e-6f;
+    float det = g * (g * h - sum_x * sum_x) - sum_z * sum_z * g;
+    float inv_det = det != 0 ? 1.0f / det : 0;
+    float inv[3][3] = {
+        {(g * h - sum_x * sum_x) * inv_det, -sum_z * sum_x * inv_det, sum_z * g * inv_det},
+        {-sum_z * sum_x * inv_det, (g * h - sum_z * sum_z) * inv_det, -sum_x * g * inv_det},
+        {sum_z * g * inv_det, -sum_x * g * inv_det, g * g * inv_det},
+    };
+
+    // Step size 1/L, L the largest eigenvalue of the Hessian: that of
+    // A^T W A, which has the two force rows' eigenvalue a and a 2x2 block
+    // with the torque row, or the regularization's
+    float a = p.force_weight * feet, b = p.torque_weight * sum_sq;
+    float coupling = p.force_weight * p.torque_weight * (sum_x * sum_x + sum_z * sum_z);
+    float lipschitz = 0.5f * (a + b + sqrtf((a - b) * (a - b) + 4 * coupling));
+    if (p.regularization > lipschitz) {
+        lipschitz = p.regularization;
+    }
+    float step = lipschitz > 0 ? 1.0f / lipschitz : 0;
+
+    // Start from the previous solution, moved into the current limits
+    float yx[N], yz[N];
+    for (int i = 0; i < N; i++) {
+        if (s.rz[i] <= 0) {
+            s.rx[i] = share_x;
+            s.rz[i] = share_z;
+        }
+        ProjectFrictionTrapezoid(s.rx[i], s.rz[i], p.friction, min_vertical[i], s.max_vertical[i]);
+        yx[i] = s.rx[i];
+        yz[i] = s.rz[i];
+    }
+
+    int restart = 0;
+    for (int k = 0; k < p.iterations; k++) {
+        // Wrench at the extrapolated point
+        float wx = 0, wz = 0, wt = 0;
+        for (int i = 0; i < N; i++) {
+            wx += yx[i];
+            wz += yz[i];
+            wt += s.foot_x[i] * yz[i] - s.foot_z[i] * yx[i];
+        }
+        // The regularization only pulls on the part of r - share that
+        // doesn't change the wrench, (I - A^T (A A^T)^-1 A)(r - share), so
+        // it never gives up any of the wrench. A (r - share) is u.
+        float u[3] = {wx - desired.fx, wz - desired.fz, wt - share_torque};
+        float c[3];
+        for (int j = 0; j < 3; j++) {
+            c[j] = -p.regularization * (inv[j][0] * u[0] + inv[j][1] * u[1] + inv[j][2] * u[2]);
+        }
+        c[0] += p.force_weight * (wx - desired.fx);
+        c[1] += p.force_weight * (wz - desired.fz);
+        c[2] += p.torque_weight * (wt - desired.torque);
+
+        float rx[N], rz[N];
+        float overshoot = 0;
+        for (int i = 0; i < N; i++) {
+            float gx = c[0] - s.foot_z[i] * c[2] + p.regularization * (yx[i] - share_x);
+            float gz = c[1] + s.foot_x[i] * c[2] + p.regularization * (yz[i] - share_z);
+            rx[i] = yx[i] - step * gx;
+            rz[i] = yz[i] - step * gz;
+            ProjectFrictionTrapezoid(rx[i], rz[i], p.friction, min_vertical[i], s.max_vertical[i]);
+            overshoot += (yx[i] - rx[i]) * (rx[i] - s.rx[i]) + (yz[i] - rz[i]) * (rz[i] - s.rz[i]);
+        }
+        // Momentum builds up until the step turns against it, then starts
+        // again. Without the restart it overshoots and rings for tens of
+        // iterations where the limits bind.
+        if (overshoot > 0) {
+            restart = k;
+        }
+        float momentum = (float)(k - restart) / (k - restart + 3);
+        for (int i = 0; i < N; i++) {
+            yx[i] = rx[i] + momentum * (rx[i] - s.rx[i]);
+            yz[i] = rz[i] + momentum * (rz[i] - s.rz[i]);
+            s.rx[i] = rx[i];
+            s.rz[i] = rz[i];
+        }
+    }
+
+    s.achieved.fx = s.achieved.fz = s.achieved.torque = 0;
+    for (int i = 0; i < N; i++) {
+        s.achieved.fx += s.rx[i];
+        s.achieved.fz += s.rz[i];
+        s.achieved.torque += s.foot_x[i] * s.rz[i] - s.foot_z[i] * s.rx[i];
+    }
+}
+
+#endif
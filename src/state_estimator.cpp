@@ -0,0 +1,142 @@
+#include "state_estimator.h"
+#include <math.h>
+#include "Arduino.h"
+#include "config.h"
+#include "globals.h"
+#include "imu.h"
+#include "kinematics.h"
+#include "cycle_counter.h"
+
+struct BodyState body_state = {0, 0, 0, 0};
+volatile uint32_t state_estimator_cycles = 0;
+volatile uint32_t state_estimator_max_cycles = 0;
+volatile uint32_t state_estimator_overruns = 0;
+
+static const float GRAVITY = 9.81f;
+
+static uint32_t prev_t_us = 0;
+static uint32_t imu_cursor = 0;
+// Mean specific force over the last IMU samples, body frame (m/s^2)
+static float force_x = 0, force_y = 0, force_z = GRAVITY;
+// Feet relative to the body centre in the world frame at the previous update,
+// and which of them were on the ground
+static float prev_foot_x[4], prev_foot_z[4];
+static uint8_t prev_stance = 0;
+
+/**
+ * Average the accelerometer samples that arrived since the last update into
+ * force_x/y/z. Keeps the previous value if there were none.
+ */
+static void ReadSpecificForce() {
+    struct IMUSample samples[8];
+    float sum_x = 0, sum_y = 0, sum_z = 0;
+    int count = 0;
+    int n;
+    while ((n = IMUReadSamples(imu_cursor, samples, 8)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (samples[i].report == IMU_REPORT_ACCELEROMETER) {
+                sum_x += samples[i].x;
+                sum_y += samples[i].y;
+                sum_z += samples[i].z;
+                count++;
+            }
+        }
+    }
+    if (count > 0) {
+        force_x = sum_x / count;
+        force_y = sum_y / count;
+        force_z = sum_z / count;
+    }
+}
+
+/**
+ * Advance the body state estimate to t_us. Called by the control thread at
+ * the start of every tick, before the state machine uses body_state.
+ */
+void StateEstimatorUpdate(uint32_t t_us) {
+    uint32_t start = CycleCount();
+
+    float dt = (t_us - prev_t_us) * 1e-6f;
+    prev_t_us = t_us;
+    if (dt > STATE_EST_MAX_DT) {
+        // First update, or after a blocking state (hop, reset): the leg
+        // positions from before are no use for velocity
+        dt = 0;
+        prev_stance = 0;
+    }
+
+    struct Attitude attitude;
+    IMUPredictAttitude(t_us, attitude);
+    float c = cosf(attitude.pitch), s = sinf(attitude.pitch);
+
+    // Predict with the accelerometer
+    ReadSpecificForce();
+    float acc_x = c * force_x - s * force_z;
+    float acc_z = s * force_x + c * force_z - GRAVITY;
+    body_state.vx += acc_x * dt;
+    body_state.vz += acc_z * dt;
+    body_state.height += body_state.vz * dt;
+
+    // Feet relative to the body centre, turned into the world frame
+    const struct ODrive* legs[4] = {&global_debug_values.odrv0, &global_debug_values.odrv1,
+                                    &global_debug_values.odrv2, &global_debug_values.odrv3};
+    float foot_x[4], foot_z[4];
+    float lowest = 0;
+    for (int i = 0; i < 4; i++) {
+        LegFootInWorld(i, legs[i]->est_theta, legs[i]->est_gamma, c, s, foot_x[i], foot_z[i]);
+        lowest = fminf(lowest, foot_z[i]);
+    }
+
+    // No foot is on the ground while the body falls freely; otherwise the
+    // lowest feet are
+    uint8_t stance = 0;
+    float f2 = force_x * force_x + force_y * force_y + force_z * force_z;
+    const float flight_force = STATE_EST_FLIGHT_ACCEL * GRAVITY;
+    if (f2 > flight_force * flight_force) {
+        for (int i = 0; i < 4; i++) {
+            if (foot_z[i] < lowest + STATE_EST_STANCE_MARGIN) {
+                stance |= 1 << i;
+            }
+        }
+    }
+
+    // Correct with leg odometry. Velocity needs the same foot on the ground
+    // at the previous update too.
+    float leg_vx = 0, leg_vz = 0, leg_height = 0;
+    int velocity_feet = 0, height_feet = 0;
+    for (int i = 0; i < 4; i++) {
+        if ((stance & (1 << i)) == 0) {
+            continue;
+        }
+        leg_height -= foot_z[i];
+        height_feet++;
+        if ((prev_stance & (1 << i)) && dt > 0) {
+            leg_vx -= (foot_x[i] - prev_foot_x[i]) / dt;
+            leg_vz -= (foot_z[i] - prev_foot_z[i]) / dt;
+            velocity_feet++;
+        }
+    }
+    if (velocity_feet > 0) {
+        body_state.vx += STATE_EST_VELOCITY_GAIN * (leg_vx / velocity_feet - body_state.vx);
+        body_state.vz += STATE_EST_VELOCITY_GAIN * (leg_vz / velocity_feet - body_state.vz);
+    }
+    if (height_feet > 0) {
+        body_state.height += STATE_EST_HEIGHT_GAIN * (leg_height / height_feet - body_state.height);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        prev_foot_x[i] = foot_x[i];
+        prev_foot_z[i] = foot_z[i];
+    }
+    prev_stance = stance;
+    body_state.stance = stance;
+
+    uint32_t cycles = CycleCount() - start;
+    state_estimator_cycles = cycles;
+    if (cycles > state_estimator_max_cycles) {
+        state_estimator_max_cycles = cycles;
+    }
+    if (cycles > STATE_EST_BUDGET_CYCLES) {
+        state_estimator_overruns++;
+    }
+}
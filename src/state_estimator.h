@@ -0,0 +1,33 @@
+#ifndef STATE_ESTIMATOR_H
+#define STATE_ESTIMATOR_H
+
+#include <stdint.h>
+
+// Body velocity and height estimate, updated by the control thread at the
+// start of every tick. The IMU's specific force, turned into the world frame
+// by the pitch estimate, is integrated into velocity and height, and both are
+// pulled towards leg odometry: feet on the ground don't move, so the body
+// moves opposite to them (forward kinematics of est_theta/est_gamma, turned
+// by pitch). Sagittal plane only; roll and yaw are ignored.
+//
+// Fixed size and allocation free. One update is four forward kinematics and a
+// handful of multiplies, budgeted at STATE_EST_BUDGET_CYCLES.
+
+struct BodyState {
+    float vx;       // Forward velocity, horizontal (m/s)
+    float vz;       // Vertical velocity, up (m/s)
+    float height;   // Body centre above the stance feet (m)
+    uint8_t stance; // Bit i set if odrv i's foot was taken to be on the ground
+};
+
+void StateEstimatorUpdate(uint32_t t_us);
+
+extern struct BodyState body_state;
+
+// Cycles taken by the latest update, the most taken by any update and the
+// number of updates over budget
+extern volatile uint32_t state_estimator_cycles;
+extern volatile uint32_t state_estimator_max_cycles;
+extern volatile uint32_t state_estimator_overruns;
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef TELEMETRY_CHANNELS_H
+#define TELEMETRY_CHANNELS_H
+
+// Telemetry channel registry: X(name, firmware expression, scale).
+// The channel index is its position in this list, and is the bit used for it
+// in the TELEMETRY_CHANNELS frame mask. The host decoder includes this header
+// for the names and scales only, so both need to be built from the same
+// revision. Append new channels at the end; at most TELEMETRY_MAX_CHANNELS.
+#define TELEMETRY_CHANNELS(X) \
+    X("sp_theta0", global_debug_values.odrv0.sp_theta, 1000) \
+    X("est_theta0", global_debug_values.odrv0.est_theta, 1000) \
+    X("sp_gamma0", global_debug_values.odrv0.sp_gamma, 1000) \
+    X("est_gamma0", global_debug_values.odrv0.est_gamma, 1000) \
+    X("sp_theta1", global_debug_values.odrv1.sp_theta, 1000) \
+    X("est_theta1", global_debug_values.odrv1.est_theta, 1000) \
+    X("sp_gamma1", global_debug_values.odrv1.sp_gamma, 1000) \
+    X("est_gamma1", global_debug_values.odrv1.est_gamma, 1000) \
+    X("sp_theta2", global_debug_values.odrv2.sp_theta, 1000) \
+    X("est_theta2", global_debug_values.odrv2.est_theta, 1000) \
+    X("sp_gamma2", global_debug_values.odrv2.sp_gamma, 1000) \
+    X("est_gamma2", global_debug_values.odrv2.est_gamma, 1000) \
+    X("sp_theta3", global_debug_values.odrv3.sp_theta, 1000) \
+    X("est_theta3", global_debug_values.odrv3.est_theta, 1000) \
+    X("sp_gamma3", global_debug_values.odrv3.sp_gamma, 1000) \
+    X("est_gamma3", global_debug_values.odrv3.est_gamma, 1000) \
+    X("pitch", global_debug_values.imu.pitch, 1000) \
+    X("reply_us", global_debug_values.position_reply_time, 1) \
+    X("state", state, 1) \
+    X("kp_theta", GaitParamsPublishedGains().kp_theta, 100) \
+    X("kd_theta", GaitParamsPublishedGains().kd_theta, 100) \
+    X("kp_gamma", GaitParamsPublishedGains().kp_gamma, 100) \
+    X("kd_gamma", GaitParamsPublishedGains().kd_gamma, 100) \
+    X("tick_us", control_tick_us, 1) \
+    X("max_busy_us", maxDelay, 1) \
+    X("param_gen", gait_params_generation, 1) \
+    X("cmd_latency_us", command_latency_us, 1) \
+    X("cmd_max_latency_us", command_max_latency_us, 1) \
+    X("traj_fill", trajectory_fill, 1) \
+    X("traj_underruns", trajectory_underruns, 1) \
+    X("imu_latency_us", imu_read_latency_us, 1) \
+    X("imu_cpu_us", imu_cpu_us, 1)
+
+// Channels 0-16 are what the 'D' toggle streams when nothing else is
+// subscribed: the leg setpoints and estimates and the body pitch, at the
+// rate and link budget given with TELEMETRY_DEFAULT_DECIMATION in config.h
+const int TELEMETRY_DEFAULT_CHANNELS = 17;
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef TELEMETRY_FORMAT_H
+#define TELEMETRY_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary telemetry framing shared by the firmware (debug.cpp) and the host
+// decoder (tools/teledecode). Only depends on stdint so it builds on both.
+//
+// On the wire every frame is COBS encoded and surrounded by 0x00 bytes, so
+// console text sent on the same port (which never contains 0x00) lands
+// between frames and can be told apart from them. Decoded, a frame is:
+//   uint8_t  type      TelemetryFrameType
+//   uint8_t  seq       Increments per frame, lets readers count lost frames
+//   uint32_t t_us      micros() when the frame was built
+//   ...                Type specific payload
+//   uint16_t crc       CRC-16/CCITT-FALSE over everything before it
+// All multi-byte values are little endian.
+
+enum TelemetryFrameType {
+    // 1 was the fixed layout debug frame, no longer sent
+    TELEMETRY_CHANNELS = 2, // uint32_t channel mask, then one int16_t per set bit
+    TELEMETRY_ACK = 3, // TelemetryAckPayload
+    TELEMETRY_TRAJECTORY_ACK = 4 // TelemetryTrajectoryAckPayload
+};
+
+#pragma pack(push, 1)
+struct TelemetryHeader {
+    uint8_t type;
+    uint8_t seq;
+    uint32_t t_us;
+};
+
+// Answer to a binary host command (see command_format.h)
+struct TelemetryAckPayload {
+    uint8_t command; // Command type, without COMMAND_NO_ACK
+    uint8_t seq; // Host sequence number from the command
+    uint8_t status; // CommandStatus
+};
+
+// Answer to a COMMAND_TRAJECTORY frame, with the buffer state the host needs
+// for flow control
+struct TelemetryTrajectoryAckPayload {
+    uint8_t seq; // Host sequence number from the command
+    uint8_t status; // CommandStatus
+    uint16_t free; // Points the buffer had room for after this one
+    uint32_t play_t_ms; // Trajectory time being played back
+    uint16_t underruns; // Playbacks stopped because the buffer ran dry
+};
+#pragma pack(pop)
+
+// A TELEMETRY_CHANNELS frame carries the channels (see telemetry_channels.h)
+// whose bit is set in the mask, lowest bit first, each as
+// round(value * scale) saturated to int16. NaN is sent as TELEMETRY_NAN.
+const int TELEMETRY_MAX_CHANNELS = 32;
+const int16_t TELEMETRY_NAN = INT16_MIN;
+
+// Largest decoded frame: a TELEMETRY_CHANNELS frame with every channel
+const size_t TELEMETRY_MAX_FRAME = sizeof(TelemetryHeader) + sizeof(uint32_t) + 2 * TELEMETRY_MAX_CHANNELS + 2;
+
+inline int16_t TelemetryQuantize(float value, float scale) {
+    if (value != value) return TELEMETRY_NAN;
+    float q = value * scale;
+    if (q > 32767.0f) return 32767;
+    if (q < -32767.0f) return -32767;
+    return (int16_t)(q < 0 ? q - 0.5f : q + 0.5f);
+}
+
+// Worst case COBS output for n input bytes, plus both delimiters
+#define TELEMETRY_WIRE_SIZE(n) ((n) + (n) / 254 + 1 + 2)
+
+inline uint16_t TelemetryCrc16(const uint8_t* data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/**
+ * COBS encode len bytes and add the leading and trailing 0x00 delimiters.
+ * out must hold TELEMETRY_WIRE_SIZE(len) bytes.
+ * @return Number of bytes written to out
+ */
+inline size_t TelemetryCobsEncode(const uint8_t* in, size_t len, uint8_t* out) {
+    size_t o = 0;
+    out[o++] = 0;
+    size_t code_idx = o++;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] == 0) {
+            out[code_idx] = code;
+            code_idx = o++;
+            code = 1;
+        } else {
+            out[o++] = in[i];
+            if (++code == 0xFF) {
+                out[code_idx] = code;
+                code_idx = o++;
+                code = 1;
+            }
+        }
+    }
+    out[code_idx] = code;
+    out[o++] = 0;
+    return o;
+}
+
+/**
+ * Decode one COBS block (without delimiters) in place.
+ * @return Decoded length, or 0 if the block is malformed
+ */
+inline size_t TelemetryCobsDecode(uint8_t* buf, size_t len) {
+    size_t in = 0, out = 0;
+    while (in < len) {
+        uint8_t code = buf[in++];
+        if (code == 0 || in + code - 1 > len) return 0;
+        for (uint8_t i = 1; i < code; i++) buf[out++] = buf[in++];
+        if (code != 0xFF && in < len) buf[out++] = 0;
+    }
+    return out;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#include "trajectory.h"
+#include "Arduino.h"
+#include "config.h"
+#include "globals.h"
+#include "position_control.h"
+#include "console.h"
+
+// Ring of points waiting to be played. Both ends run on the control thread:
+// points are appended as commands come out of the mailbox and consumed by
+// ExecuteTrajectory.
+static struct CommandTrajectoryPoint points[TRAJECTORY_BUFFER_POINTS];
+static int oldest = 0;
+static int buffered = 0;
+// t_ms of the newest point, which the next one has to be later than
+static uint32_t last_t_ms = 0;
+// A trajectory was started with t_ms 0 and its last point hasn't arrived
+static bool accepting = false;
+
+static uint32_t play_start_us = 0;
+static uint32_t play_start_t_ms = 0;
+
+volatile uint32_t trajectory_fill = 0;
+volatile uint32_t trajectory_underruns = 0;
+volatile uint32_t trajectory_play_t_ms = 0;
+
+static void ClearTrajectory() {
+    oldest = 0;
+    buffered = 0;
+    accepting = false;
+    trajectory_fill = 0;
+}
+
+/**
+ * @return Number of points that can be appended right now
+ */
+uint16_t TrajectoryFree() {
+    return TRAJECTORY_BUFFER_POINTS - buffered;
+}
+
+/**
+ * Append one point to the trajectory buffer.
+ * @return CommandStatus: COMMAND_REJECTED if the buffer is full, the point is
+ *         out of order or doesn't belong to a trajectory, or gamma is out of
+ *         range
+ */
+uint8_t TrajectoryAppend(const struct CommandTrajectoryPoint& point) {
+    // Check the point before anything else, so a bad first point doesn't
+    // throw away the trajectory already buffered
+    for (int i = 0; i < 4; i++) {
+        if (point.gamma[i] < 0 || point.gamma[i] > PI * 1000) {
+            return COMMAND_REJECTED;
+        }
+    }
+    if (point.t_ms == 0) {
+        // Can't restart a trajectory while it plays
+        if (state == TRAJECTORY) {
+            return COMMAND_REJECTED;
+        }
+        ClearTrajectory();
+        accepting = true;
+    } else if (!accepting || point.t_ms <= last_t_ms) {
+        return COMMAND_REJECTED;
+    }
+    if (buffered == TRAJECTORY_BUFFER_POINTS) {
+        return COMMAND_REJECTED;
+    }
+
+    points[(oldest + buffered) % TRAJECTORY_BUFFER_POINTS] = point;
+    buffered++;
+    trajectory_fill = buffered;
+    last_t_ms = point.t_ms;
+    if (point.flags & COMMAND_TRAJECTORY_LAST) {
+        accepting = false;
+    }
+    return COMMAND_OK;
+}
+
+/**
+ * Start playing back the buffered trajectory from its oldest point.
+ * @return false if nothing is buffered
+ */
+bool StartTrajectory() {
+    if (buffered == 0) {
+        ConsoleMessage().println("Trajectory buffer empty");
+        return false;
+    }
+    play_start_us = micros();
+    play_start_t_ms = points[oldest].t_ms;
+    state = TRAJECTORY;
+    ConsoleMessage().println("TRAJECTORY");
+    return true;
+}
+
+/**
+ * Send the trajectory setpoints for the current time, interpolated between
+ * the two buffered points around it. Runs out to STOP after the last point,
+ * or early if the host fell behind and the buffer ran dry.
+ * @param gains Leg gains, the published gait gains
+ */
+void ExecuteTrajectory(struct LegGain gains) {
+    float t_ms = play_start_t_ms + (micros() - play_start_us) / 1000.0f;
+    trajectory_play_t_ms = (uint32_t)t_ms;
+
+    // Drop points that are no longer needed for interpolation
+    while (buffered >= 2 && points[(oldest + 1) % TRAJECTORY_BUFFER_POINTS].t_ms <= t_ms) {
+        oldest = (oldest + 1) % TRAJECTORY_BUFFER_POINTS;
+        buffered--;
+    }
+    trajectory_fill = buffered;
+
+    const struct CommandTrajectoryPoint& p0 = points[oldest];
+    if (buffered == 1 && t_ms >= p0.t_ms) {
+        ClearTrajectory();
+        state = STOP;
+        if (p0.flags & COMMAND_TRAJECTORY_LAST) {
+            ConsoleMessage().println("Trajectory Complete.");
+        } else {
+            trajectory_underruns++;
+            ConsoleMessage() << "Trajectory underrun at " << (uint32_t)t_ms << "ms, stopping\n";
+        }
+        return;
+    }
+
+    float frac = 0;
+    const struct CommandTrajectoryPoint& p1 = buffered >= 2 ? points[(oldest + 1) % TRAJECTORY_BUFFER_POINTS] : p0;
+    if (buffered >= 2 && t_ms > p0.t_ms) {
+        frac = (t_ms - p0.t_ms) / (p1.t_ms - p0.t_ms);
+    }
+
+    ODriveArduino* odrives[4] = {&odrv0Interface, &odrv1Interface, &odrv2Interface, &odrv3Interface};
+    struct ODrive* sp[4] = {&global_debug_values.odrv0, &global_debug_values.odrv1,
+                            &global_debug_values.odrv2, &global_debug_values.odrv3};
+    for (int i = 0; i < 4; i++) {
+        float theta = (p0.theta[i] + (p1.theta[i] - p0.theta[i]) * frac) / 1000.0f;
+        float gamma = (p0.gamma[i] + (p1.gamma[i] - p0.gamma[i]) * frac) / 1000.0f;
+        odrives[i]->SetCoupledPosition(theta, gamma, gains);
+        sp[i]->sp_theta = theta;
+        sp[i]->sp_gamma = gamma;
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "ODriveArduino.h"
+#include "command_format.h"
+
+uint8_t TrajectoryAppend(const struct CommandTrajectoryPoint& point);
+bool StartTrajectory();
+void ExecuteTrajectory(struct LegGain gains);
+uint16_t TrajectoryFree();
+
+extern volatile uint32_t trajectory_fill;
+extern volatile uint32_t trajectory_underruns;
+extern volatile uint32_t trajectory_play_t_ms;
+
+#endif
@@ -4,6 +4,7 @@
 #include "ODriveArduino.h"
 #include "globals.h"
 #include "config.h"
+#include "console.h"
 
 //------------------------------------------------------------------------------
 // SerialThread: receive serial messages from ODrive.
@@ -27,15 +28,19 @@ THD_FUNCTION(SerialThread, arg) {
     struct MsgOutput odrv0MsgOutput;
     odrv0MsgOutput.theta = &(global_debug_values.odrv0.est_theta);
     odrv0MsgOutput.gamma = &(global_debug_values.odrv0.est_gamma);
+    odrv0MsgOutput.receive_timestamp = &odrive_receive_timestamp[0];
     struct MsgOutput odrv1MsgOutput;
     odrv1MsgOutput.theta = &(global_debug_values.odrv1.est_theta);
     odrv1MsgOutput.gamma = &(global_debug_values.odrv1.est_gamma);
+    odrv1MsgOutput.receive_timestamp = &odrive_receive_timestamp[1];
     struct MsgOutput odrv2MsgOutput;
     odrv2MsgOutput.theta = &(global_debug_values.odrv2.est_theta);
     odrv2MsgOutput.gamma = &(global_debug_values.odrv2.est_gamma);
+    odrv2MsgOutput.receive_timestamp = &odrive_receive_timestamp[2];
     struct MsgOutput odrv3MsgOutput;
     odrv3MsgOutput.theta = &(global_debug_values.odrv3.est_theta);
     odrv3MsgOutput.gamma = &(global_debug_values.odrv3.est_gamma);
+    odrv3MsgOutput.receive_timestamp = &odrive_receive_timestamp[3];
 
     odrv0Serial.clear();
     odrv1Serial.clear();
@@ -85,7 +90,7 @@ void ProcessSerial(HardwareSerial& odrvSerial, struct MsgParams& odrvMsgParams,
                 payload_length = c;
                 if (payload_length >= BUFFER_SIZE) {
                     #ifdef DEBUG_LOW
-                        Serial << "Payload bigger than buffer!\n";
+                        ConsoleMessage() << "Payload bigger than buffer!\n";
                     #endif
 
                     rx_state = IDLING;
@@ -108,7 +113,7 @@ void ProcessSerial(HardwareSerial& odrvSerial, struct MsgParams& odrvMsgParams,
 
                     #ifdef DEBUG_LOW
                         msg_end = micros();
-                        Serial << "rcvd in: " << msg_end - msg_start << " in " << loop_iters << " loops\n";
+                        ConsoleMessage() << "rcvd in: " << msg_end - msg_start << " in " << loop_iters << " loops\n";
                         // NOTE: As of code 7/7/18, the average receive time was 282us
                         // And number of loop executions to get a message was 34
                     #endif
@@ -126,7 +131,7 @@ void ProcessSerial(HardwareSerial& odrvSerial, struct MsgParams& odrvMsgParams,
                     
                     #ifdef DEBUG_LOW
                         msg_end = micros();
-                        Serial << "rcvd in: " << msg_end - msg_start << " in " << loop_iters << " loops\n";
+                        ConsoleMessage() << "rcvd in: " << msg_end - msg_start << " in " << loop_iters << " loops\n";
                         // NOTE: As of code 10/14/18, the average receive time was 1100
                         // And number of loop executions to get a message was 0 or 1
                     #endif
@@ -144,14 +149,17 @@ void ProcessSerial(HardwareSerial& odrvSerial, struct MsgParams& odrvMsgParams,
  */
 void ProcessPositionMsg(char* msg, int len, HardwareSerial& odrvSerial, struct MsgOutput& odrvMsgOutput) {
     #ifdef DEBUG_LOW
+    {
+        ConsoleMessage bytes;
         for(int i=0; i<len; i++) {
-            Serial << (int)msg[i] << "(" << msg[i] <<") ";
+            bytes << (int)msg[i] << "(" << msg[i] <<") ";
         }
-        Serial << "\n";
+        bytes << "\n";
+    }
     #endif
 
     #ifdef DEBUG_HIGH
-        Serial <<  "rcv at: " << micros() << '\n';
+        ConsoleMessage() << "rcv at: " << micros() << '\n';
     #endif
 
     float th,ga;
@@ -164,7 +172,7 @@ void ProcessPositionMsg(char* msg, int len, HardwareSerial& odrvSerial, struct M
         *(odrvMsgOutput.gamma) = ga;
 
         #ifdef DEBUG_LOW
-            Serial << "Th,Ga: " << th << " " << ga << '\n';
+            ConsoleMessage() << "Th,Ga: " << th << " " << ga << '\n';
         #endif
 
         // NOTE: it's possible that the feedback delay is wrong if an old
@@ -177,21 +185,22 @@ void ProcessPositionMsg(char* msg, int len, HardwareSerial& odrvSerial, struct M
         // This problem won't happen if the delay is short and the control rate is small
         //
         latest_receive_timestamp = micros();
+        *(odrvMsgOutput.receive_timestamp) = latest_receive_timestamp;
         global_debug_values.position_reply_time = latest_receive_timestamp - latest_send_timestamp;
 
         #ifdef DEBUG_HIGH
-            Serial << "Done prs at: " << micros() << '\n';
-            Serial << "Reply time (uS): " << global_debug_values.position_reply_time << "\n";
+            ConsoleMessage() << "Done prs at: " << micros() << '\n';
+            ConsoleMessage() << "Reply time (uS): " << global_debug_values.position_reply_time << "\n";
             // NOTE: As of 7/7/18 code, around 1500us from send to receive
         #endif
     } else {
         #ifdef DEBUG_LOW
-            Serial.println("Parse failed. Wrong message length or bad checksum.");
+            ConsoleMessage().println("Parse failed. Wrong message length or bad checksum.");
         #endif
     }
 }
 
 void ProcessNLMessage(char* msg, size_t len) {
-    Serial << msg;
+    ConsoleMessage() << msg;
     // Serial << "Received NL message: " << msg;
 }
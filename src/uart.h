@@ -29,6 +29,7 @@ struct MsgParams {
 struct MsgOutput{
     float* theta;
     float* gamma;
+    volatile long* receive_timestamp;
 };
 
 
@@ -4,105 +4,486 @@
 #include "globals.h"
 #include "config.h"
 #include "jump.h"
+#include "phase_sequencer.h"
 #include "backflip.h"
 #include "position_control.h"
+#include "debug.h"
+#include "console.h"
+#include "gait_params.h"
+#include "command_format.h"
+#include "command_parser.h"
+#include "script.h"
+#include "trajectory.h"
+#include "gait_kernels.h"
+#include "gait_patterns.h"
+
+// Binary command frames that were malformed or rejected
+volatile uint32_t command_frame_errors = 0;
+// Commands dropped because the control thread had not drained the mailbox
+volatile uint32_t command_mailbox_dropped = 0;
+// Time from the first byte of a command being read to the end of the control
+// tick that applied it, ie when the first motor frame reflecting it was sent
+volatile uint32_t command_latency_us = 0;
+volatile uint32_t command_max_latency_us = 0;
+
+const int MAX_COMMAND_LENGTH = 32;
+static_assert(COMMAND_MAX_PAYLOAD <= MAX_COMMAND_LENGTH, "Binary frames must fit in a mailbox entry");
+
+// Complete commands waiting for the control thread. ProcessUSBSerial is the
+// only producer and ProcessCommandMailbox the only consumer, so the indices
+// need no lock.
+struct CommandMailboxEntry {
+    uint32_t arrival_us; // micros() when the first byte of the command was read
+    bool binary; // Binary frame payload rather than text
+    bool estop;
+    uint8_t len;
+    char data[MAX_COMMAND_LENGTH + 1];
+};
+
+static CommandMailboxEntry mailbox[COMMAND_MAILBOX_LEN];
+static volatile uint8_t mailbox_head = 0;
+static volatile uint8_t mailbox_tail = 0;
+
+// Arrival times of the commands applied in the current control tick, waiting
+// for RecordCommandLatency
+static int applied_count = 0;
+static bool applied_estop = false;
+static uint32_t applied_estop_us = 0;
+static uint32_t applied_oldest_us = 0;
+static uint32_t applied_newest_us = 0;
 
 THD_WORKING_AREA(waUSBSerialThread, 2048);
 
 THD_FUNCTION(USBSerialThread, arg) {
     (void)arg;
 
-    int MAX_COMMAND_LENGTH = 32;
-    char cmd[MAX_COMMAND_LENGTH + 1];
-    int pos = 0;
-
     while(true) {
-        while(Serial.available()) {
-            char c = Serial.read();
-            if (c == ';' || c == '\n') {
-                cmd[pos] = '\0';
-                InterpretCommand(cmd);
-                pos = 0;
-            } else {
-                cmd[pos++] = c;
-            }
+        ProcessUSBSerial();
+        chThdSleepMicroseconds(1000000/USB_SERIAL_FREQ);
+    }
+}
+
+/**
+ * @return true if the command is a STOP, text "S" or a binary 'M' frame with 'S'
+ */
+static bool IsStopCommand(bool binary, const char* data, int len) {
+    if (binary) {
+        return len == 3 && ((uint8_t)data[0] & ~COMMAND_NO_ACK) == COMMAND_STATE && data[2] == 'S';
+    }
+    int i = 0;
+    while (i < len && CommandIsSpace(data[i])) i++;
+    if (i == len || data[i] != 'S') return false;
+    for (i++; i < len; i++) {
+        if (!CommandIsSpace(data[i])) return false;
+    }
+    return true;
+}
+
+/**
+ * Queue a complete command for the control thread. A STOP takes effect here,
+ * on the USB thread, and wakes the control thread, so it doesn't wait for a
+ * tick that is blocked, eg in the middle of a hop or a reset, or for the end
+ * of the control period. The queued copy is still applied like any other
+ * command, for its ack and latency.
+ */
+static void PostCommand(bool binary, const char* data, int len, uint32_t arrival_us) {
+    uint8_t next = (mailbox_head + 1) % COMMAND_MAILBOX_LEN;
+    bool estop = IsStopCommand(binary, data, len);
+    if (estop) {
+        ESTOP();
+        PositionControlWake();
+    }
+    if (next == mailbox_tail) {
+        command_mailbox_dropped++;
+        if (!estop) {
+            ConsoleMessage().println("Command mailbox full, command dropped");
+            return;
         }
+        // Never drop a STOP: it replaces the newest waiting command
+        ConsoleMessage().println("Command mailbox full, newest command replaced by STOP");
+        next = mailbox_head;
+        mailbox_head = (mailbox_head + COMMAND_MAILBOX_LEN - 1) % COMMAND_MAILBOX_LEN;
+    }
+    CommandMailboxEntry& entry = mailbox[mailbox_head];
+    entry.arrival_us = arrival_us;
+    entry.binary = binary;
+    entry.estop = estop;
+    entry.len = len;
+    memcpy(entry.data, data, len);
+    entry.data[len] = '\0';
+    mailbox_head = next;
+}
 
-        chThdSleepMicroseconds(1000000/USB_SERIAL_FREQ);
+/**
+ * Apply every command in the mailbox, oldest first. Called by the control
+ * thread at the start of each tick so commands only ever change the gait
+ * between ticks; RecordCommandLatency must be called once the tick's motor
+ * frames are sent.
+ * @return Number of commands applied
+ */
+int ProcessCommandMailbox() {
+    int n = 0;
+    while (mailbox_tail != mailbox_head) {
+        CommandMailboxEntry& entry = mailbox[mailbox_tail];
+        if (entry.binary) {
+            InterpretBinaryCommand((const uint8_t*)entry.data, entry.len);
+        } else {
+            InterpretCommand(entry.data);
+        }
+        if (applied_count == 0) {
+            applied_oldest_us = entry.arrival_us;
+        }
+        applied_newest_us = entry.arrival_us;
+        if (entry.estop && !applied_estop) {
+            applied_estop = true;
+            applied_estop_us = entry.arrival_us;
+        }
+        applied_count++;
+        mailbox_tail = (mailbox_tail + 1) % COMMAND_MAILBOX_LEN;
+        n++;
+    }
+    return n;
+}
+
+/**
+ * Update the command latency stats for the commands applied this tick.
+ * @param frame_us micros() once the tick's motor frames have been sent
+ */
+void RecordCommandLatency(uint32_t frame_us) {
+    if (applied_count == 0) {
+        return;
+    }
+    command_latency_us = frame_us - applied_newest_us;
+    uint32_t oldest = frame_us - applied_oldest_us;
+    if (oldest > command_max_latency_us) {
+        command_max_latency_us = oldest;
     }
+    if (applied_estop) {
+        ConsoleMessage() << "STOP latency: " << frame_us - applied_estop_us << "us\n";
+    }
+    applied_count = 0;
+    applied_estop = false;
 }
 
-void InterpretCommand(char* cmd) {
-    char c;
-    float f;
-    // Note: Putting a space in front of %c allows you type commands like:
-    // f 2.0; l 0.01; h 0.08
-    int num_parsed = sscanf(cmd, " %c %f", &c, &f);
-    if (num_parsed < 1) {
-        Serial.println("Invalid command");
+/**
+ * Pull every available byte off the command serial port and post each
+ * complete ';' or '\n' terminated text command and each binary command frame
+ * (see command_format.h) to the control thread's mailbox. A
+ * COMMAND_START_BYTE, which never appears in text, switches to reading a
+ * binary frame.
+ */
+void ProcessUSBSerial() {
+    static char cmd[MAX_COMMAND_LENGTH + 1];
+    static int pos = 0;
+    static uint32_t arrival_us = 0;
+
+    static CommandRXState rx_state = COMMAND_RX_TEXT;
+    static uint8_t frame[COMMAND_MAX_PAYLOAD];
+    static int frame_len = 0;
+    static int frame_pos = 0;
+
+    if (!Serial.available()) {
         return;
     }
-    switch(c) {
-        // Change gait frequency
-        case 'f':
-            Serial << "Set freq. to: " << f << "\n";
-            state_gait_params[state].freq = f;
-            break;
-        // Change stride length
-        case 'l':
-            Serial << "Set stride len to: " << f << "\n";
-            state_gait_params[state].step_length = f;
-            break;
-        // Change stride differential
-        case 's':
-            Serial << "Set step difference len to: " << f << "\n";
-            state_gait_params[state].step_diff = f;
-            break;
-        // Change stance height
-        case 'h':
-            Serial << "Set stance ht. to: " << f << "\n";
-            state_gait_params[state].stance_height = f;
-            break;
-        // Change gait up amplitude
-        case 'u':
-            Serial << "Set up amp. to: " << f << "\n";
-            state_gait_params[state].up_amp = f;
-            break;
-        // Change gait down amplitude
-        case 'd':
-            Serial << "Set down amp. to: " << f << "\n";
-            state_gait_params[state].down_amp = f;
-            break;
-        // Change gait flight percent
-        case 'p':
-            Serial << "Set flt. perc. to: " << f << "\n";
-            state_gait_params[state].flight_percent = f;
+    // Bytes are only seen when this runs, so every byte read now arrived at
+    // most one USB_SERIAL_FREQ period ago
+    uint32_t now = micros();
+
+    while(Serial.available()) {
+        char c = Serial.read();
+        switch (rx_state) {
+            case COMMAND_RX_TEXT:
+                if (pos == 0) {
+                    arrival_us = now;
+                }
+                if ((uint8_t)c == COMMAND_START_BYTE) {
+                    arrival_us = now;
+                    pos = 0;
+                    rx_state = COMMAND_RX_LEN;
+                } else if (c == ';' || c == '\n') {
+                    if (pos > MAX_COMMAND_LENGTH) {
+                        ConsoleMessage().println("Command too long");
+                    } else {
+                        PostCommand(false, cmd, pos, arrival_us);
+                    }
+                    pos = 0;
+                } else if (pos < MAX_COMMAND_LENGTH) {
+                    cmd[pos++] = c;
+                } else {
+                    pos = MAX_COMMAND_LENGTH + 1; // Discard the rest of the command
+                }
+                break;
+            case COMMAND_RX_LEN:
+                frame_len = (uint8_t)c;
+                frame_pos = 0;
+                if (frame_len < 2 || frame_len > COMMAND_MAX_PAYLOAD) {
+                    command_frame_errors++;
+                    rx_state = COMMAND_RX_TEXT;
+                } else {
+                    rx_state = COMMAND_RX_PAYLOAD;
+                }
+                break;
+            case COMMAND_RX_PAYLOAD:
+                frame[frame_pos++] = c;
+                if (frame_pos == frame_len) {
+                    rx_state = COMMAND_RX_CHECKSUM;
+                }
+                break;
+            case COMMAND_RX_CHECKSUM:
+                if ((uint8_t)c == CommandChecksum(frame, frame_len)) {
+                    PostCommand(true, (const char*)frame, frame_len, arrival_us);
+                } else {
+                    command_frame_errors++;
+                    SendTelemetryAck(frame[0] & ~COMMAND_NO_ACK, frame[1], COMMAND_BAD_CHECKSUM);
+                }
+                rx_state = COMMAND_RX_TEXT;
+                break;
+        }
+    }
+}
+
+// Text commands that change the state, the only ones COMMAND_STATE accepts
+static const char state_command_letters[] = "SEBTYWPJHFXQR";
+
+/**
+ * Apply one binary command frame and acknowledge it.
+ * @param frame Payload: type, host sequence number, then the command data
+ * @param len   Payload length, at least 2
+ */
+void InterpretBinaryCommand(const uint8_t* frame, int len) {
+    uint8_t type = frame[0] & ~COMMAND_NO_ACK;
+    bool ack = (frame[0] & COMMAND_NO_ACK) == 0;
+    uint8_t seq = frame[1];
+    const uint8_t* data = frame + 2;
+    int data_len = len - 2;
+    uint8_t status = COMMAND_OK;
+
+    switch (type) {
+        case COMMAND_MOTION:
+            if (data_len != sizeof(CommandMotion)) {
+                status = COMMAND_BAD_FORMAT;
+                break;
+            }
+            {
+                CommandMotion m;
+                memcpy(&m, data, sizeof(m));
+                GaitParams& params = state_gait_params[state];
+                if (m.step_length != COMMAND_UNCHANGED) params.step_length = m.step_length / 1000.0f;
+                if (m.step_diff != COMMAND_UNCHANGED) params.step_diff = m.step_diff / 1000.0f;
+                if (m.stance_height != COMMAND_UNCHANGED) params.stance_height = m.stance_height / 1000.0f;
+                if (m.freq != COMMAND_UNCHANGED) params.freq = m.freq / 100.0f;
+                if (!GaitParamsCommit()) {
+                    status = COMMAND_REJECTED;
+                }
+            }
+            break;
+        case COMMAND_STATE:
+            if (data_len != sizeof(CommandState) || !isupper(data[0])) {
+                status = COMMAND_BAD_FORMAT;
+                break;
+            }
+            if (strchr(state_command_letters, data[0]) == NULL) {
+                status = COMMAND_REJECTED;
+                break;
+            }
+            {
+                // Same behavior as the text command
+                char text[2] = {(char)data[0], '\0'};
+                InterpretCommand(text);
+            }
+            break;
+        case COMMAND_GAINS:
+            if (data_len != sizeof(CommandGains)) {
+                status = COMMAND_BAD_FORMAT;
+                break;
+            }
+            {
+                CommandGains g;
+                memcpy(&g, data, sizeof(g));
+                gait_gains.kp_theta = g.kp_theta / 100.0f;
+                gait_gains.kd_theta = g.kd_theta / 100.0f;
+                gait_gains.kp_gamma = g.kp_gamma / 100.0f;
+                gait_gains.kd_gamma = g.kd_gamma / 100.0f;
+                if (!GaitParamsCommit()) {
+                    status = COMMAND_REJECTED;
+                }
+            }
+            break;
+        case COMMAND_KEYFRAME:
+            if (data_len != sizeof(CommandKeyframe)) {
+                status = COMMAND_BAD_FORMAT;
+                break;
+            }
+            {
+                CommandKeyframe k;
+                memcpy(&k, data, sizeof(k));
+                if (!ScriptSetKeyframe(k.index, k.keyframe)) {
+                    status = COMMAND_REJECTED;
+                }
+            }
+            break;
+        case COMMAND_TRAJECTORY:
+            if (data_len == 0) {
+                ack = true; // Buffer state query
+                break;
+            }
+            if (data_len != sizeof(CommandTrajectoryPoint)) {
+                status = COMMAND_BAD_FORMAT;
+                break;
+            }
+            {
+                CommandTrajectoryPoint p;
+                memcpy(&p, data, sizeof(p));
+                status = TrajectoryAppend(p);
+            }
             break;
+        case COMMAND_GAIT_PATTERN:
+            if (data_len != sizeof(CommandGaitPattern)) {
+                status = COMMAND_BAD_FORMAT;
+                break;
+            }
+            {
+                CommandGaitPattern c;
+                memcpy(&c, data, sizeof(c));
+                if (c.swing > SWING_CYCLOID || c.stance > STANCE_FLAT) {
+                    status = COMMAND_REJECTED;
+                    break;
+                }
+                struct GaitDescriptor g = {
+                    {c.offset[0] / 65536.0f, c.offset[1] / 65536.0f, c.offset[2] / 65536.0f, c.offset[3] / 65536.0f},
+                    {c.kp_theta / 100.0f, c.kd_theta / 100.0f, c.kp_gamma / 100.0f, c.kd_gamma / 100.0f},
+                    c.duty / 65536.0f,
+                    (GaitSwingProfile)c.swing,
+                    (GaitStanceProfile)c.stance
+                };
+                if (!GaitPatternDefine(c.index, g)) {
+                    status = COMMAND_REJECTED;
+                }
+            }
+            break;
+        default:
+            status = COMMAND_BAD_FORMAT;
+    }
+
+    if (status != COMMAND_OK) {
+        command_frame_errors++;
+    }
+    if (ack || status != COMMAND_OK) {
+        if (type == COMMAND_TRAJECTORY) {
+            SendTelemetryTrajectoryAck(seq, status);
+        } else {
+            SendTelemetryAck(type, seq, status);
+        }
+    }
+}
+
+// Text commands that set one field of the current state's gait parameters
+struct GaitParamCommand {
+    char letter;
+    const char* message;
+    float GaitParams::*field;
+};
+
+static const GaitParamCommand gait_param_commands[] = {
+    {'f', "Set freq. to: ", &GaitParams::freq},
+    {'l', "Set stride len to: ", &GaitParams::step_length},
+    {'s', "Set step difference len to: ", &GaitParams::step_diff},
+    {'h', "Set stance ht. to: ", &GaitParams::stance_height},
+    {'u', "Set up amp. to: ", &GaitParams::up_amp},
+    {'d', "Set down amp. to: ", &GaitParams::down_amp},
+    {'p', "Set flt. perc. to: ", &GaitParams::flight_percent}
+};
+
+/**
+ * Parse argument i of cmd as a float, printing an error if it isn't one.
+ */
+static bool ParseFloatArg(const CommandText& cmd, int i, float& value) {
+    if (i >= cmd.argc || !CommandParseFloat(cmd.args[i], cmd.arg_len[i], value)) {
+        ConsoleMessage() << "Expected a number after " << cmd.letter << "\n";
+        return false;
+    }
+    return true;
+}
+
+void InterpretCommand(char* text) {
+    // Note: leading spaces and spaces between arguments are skipped, so you
+    // can type commands like: f 2.0; l 0.01; h 0.08
+    CommandText cmd;
+    if (!CommandTokenize(text, cmd)) {
+        ConsoleMessage().println("Invalid command");
+        return;
+    }
+
+    for (const GaitParamCommand& g : gait_param_commands) {
+        if (g.letter == cmd.letter) {
+            float f;
+            if (ParseFloatArg(cmd, 0, f)) {
+                ConsoleMessage() << g.message << f << "\n";
+                state_gait_params[state].*g.field = f;
+                GaitParamsCommit();
+            }
+            return;
+        }
+    }
+
+    switch(cmd.letter) {
         // Change leg gains
         case 'g':
             { // Have to create a new scope here in order to declare variables
                 float kp_t, kd_t, kp_g, kd_g;
-                int res = sscanf(cmd, "g %f %f %f %f", &kp_t, &kd_t, &kp_g, &kd_g);
-                if (res == 4) {
-                    Serial << "Set gains to: " << kp_t << " " << kd_t << " " << kp_g << " " << kd_g << "\n";
+                if (cmd.argc == 4 &&
+                    CommandParseFloat(cmd.args[0], cmd.arg_len[0], kp_t) &&
+                    CommandParseFloat(cmd.args[1], cmd.arg_len[1], kd_t) &&
+                    CommandParseFloat(cmd.args[2], cmd.arg_len[2], kp_g) &&
+                    CommandParseFloat(cmd.args[3], cmd.arg_len[3], kd_g)) {
+                    ConsoleMessage() << "Set gains to: " << kp_t << " " << kd_t << " " << kp_g << " " << kd_g << "\n";
                     gait_gains.kp_theta = kp_t;
                     gait_gains.kd_theta = kd_t;
                     gait_gains.kp_gamma = kp_g;
                     gait_gains.kd_gamma = kd_g;
+                    GaitParamsCommit();
                 } else {
-                    Serial.println("Invalid gain format.");
+                    ConsoleMessage().println("Invalid gain format.");
                 }
             }
             break;
         // Toggle debug printing
         case 'D':
             enable_debug = !enable_debug;
-            Serial << "Debug printing: " << enable_debug << "\n";
+            if (enable_debug) {
+                TelemetrySubscribeDefaults();
+            }
+            ConsoleMessage() << "Debug telemetry: " << enable_debug << "\n";
+            break;
+        // Subscribe telemetry channels: "M <name or prefix*> <decimation>",
+        // eg "M est_* 2" or "M * 0". Just "M" lists the channels.
+        case 'M':
+            {
+                char pattern[24];
+                int32_t decimation;
+                if (cmd.argc == 2 && cmd.arg_len[0] < sizeof(pattern) &&
+                    CommandParseInt(cmd.args[1], cmd.arg_len[1], decimation) &&
+                    decimation >= 0 && decimation <= 255) {
+                    memcpy(pattern, cmd.args[0], cmd.arg_len[0]);
+                    pattern[cmd.arg_len[0]] = '\0';
+                    int matched = TelemetrySubscribe(pattern, decimation);
+                    if (matched == 0) {
+                        ConsoleMessage() << "No telemetry channel " << pattern << "\n";
+                    } else if (decimation > 0) {
+                        enable_debug = true;
+                    }
+                    PrintTelemetryChannels();
+                } else if (cmd.argc == 0) {
+                    PrintTelemetryChannels();
+                } else {
+                    ConsoleMessage().println("Invalid telemetry format.");
+                }
+            }
             break;
         // Switch into STOP state
         case 'S':
-            state = STOP;
-            Serial.println("STOP");
+            ESTOP();
+            ConsoleMessage().println("STOP");
             break;
         // Switch into DANCE state
         case 'E':
@@ -130,42 +511,73 @@ void InterpretCommand(char* cmd) {
             break;
         // Switch into JUMP state
         case 'J':
-            StartJump(millis()/1000.0f);
-            Serial.println("JUMP");
+            StartJump(Micros64());
+            ConsoleMessage().println("JUMP");
             break;
         case 'H':
             TransitionToHop();
             break;
         case 'F':
-            StartFlip(millis()/1000.0f);
+            StartFlip(Micros64());
+            break;
+        // Run the uploaded motion script
+        case 'X':
+            StartScript();
+            break;
+        // Play back the streamed trajectory
+        case 'Q':
+            StartTrajectory();
             break;
         case 'R':
             state = RESET;
-            Serial.println("RESET");
+            ConsoleMessage().println("RESET");
+            break;
+        // List the gait patterns, or switch to one: "G <index>"
+        case 'G':
+            {
+                int32_t index;
+                if (cmd.argc == 1 && CommandParseInt(cmd.args[0], cmd.arg_len[0], index)) {
+                    if (!GaitPatternSelect(index)) {
+                        ConsoleMessage().println("No such gait pattern");
+                    }
+                } else if (cmd.argc == 0) {
+                    PrintGaitPatterns();
+                } else {
+                    ConsoleMessage().println("Invalid gait pattern format.");
+                }
+            }
+            break;
+        // Time the gait kernels against the generic gait path
+        case 'C':
+            if (state == STOP) {
+                GaitBenchmark();
+            } else {
+                ConsoleMessage().println("Gait benchmark only runs in STOP");
+            }
             break;
         // // Switch into TEST state
         // TODO: Make new character for test mode
         case '1':
             state = TEST;
-            Serial.println("(1)TEST");
+            ConsoleMessage().println("(1)TEST");
             break;
         default:
-            Serial.println("Unknown command");
+            ConsoleMessage().println("Unknown command");
     }
 }
 
 void PrintGaitCommands() {
-    Serial.println("Available gait commands:");
-    Serial.println("(f)req");
-    Serial.println("step (l)ength");
-    Serial.println("stance (h)eight");
-    Serial.println("(d)own amplitude");
-    Serial.println("(u)p amplitude");
-    Serial.println("flight (p)roportion");
-    Serial.println("(s)tep difference");
+    ConsoleMessage().println("Available gait commands:");
+    ConsoleMessage().println("(f)req");
+    ConsoleMessage().println("step (l)ength");
+    ConsoleMessage().println("stance (h)eight");
+    ConsoleMessage().println("(d)own amplitude");
+    ConsoleMessage().println("(u)p amplitude");
+    ConsoleMessage().println("flight (p)roportion");
+    ConsoleMessage().println("(s)tep difference");
 }
 
 void PrintStates() {
-    Serial.println("STATES: Danc(E), (W)alk, (T)rot, (B)ound, (P)ronk, (S)top, (J)ump, (Y)TurnTrot");
-    Serial.println("Toggle (D)ebug");
+    ConsoleMessage().println("STATES: Danc(E), (W)alk, (T)rot, (B)ound, (P)ronk, (S)top, (J)ump, (Y)TurnTrot, Run script (X), Play trajectory (Q), (G)ait pattern");
+    ConsoleMessage().println("Toggle (D)ebug, (M)onitor telemetry channels");
 }
@@ -6,8 +6,19 @@
 extern THD_WORKING_AREA(waUSBSerialThread, 2048);
 extern THD_FUNCTION(USBSerialThread, arg);
 
+enum CommandRXState { COMMAND_RX_TEXT, COMMAND_RX_LEN, COMMAND_RX_PAYLOAD, COMMAND_RX_CHECKSUM };
+
+void ProcessUSBSerial();
+int ProcessCommandMailbox();
+void RecordCommandLatency(uint32_t frame_us);
 void InterpretCommand(char* cmd);
+void InterpretBinaryCommand(const uint8_t* frame, int len);
 void PrintGaitCommands();
 void PrintStates();
 
+extern volatile uint32_t command_frame_errors;
+extern volatile uint32_t command_mailbox_dropped;
+extern volatile uint32_t command_latency_us;
+extern volatile uint32_t command_max_latency_us;
+
 #endif
@@ -0,0 +1,309 @@
+// Host benchmark and accuracy check for the attitude estimator in
+// src/attitude.cpp, with the gains from src/config.h.
+//
+// Simulates the BNO080 gyro and accelerometer (bias, white noise, linear
+// acceleration) on synthetic motions at IMU_SEND_FREQ, runs the estimator on
+// them and compares its Euler angles with the true ones. It also compares
+// the pitch half an IMU period after each sample, as a control tick sees it,
+// with and without AttitudePredict, and the Euler angle rates it extrapolates
+// with, including after a pitch tare. Then times the update on this machine.
+//
+// Build from the repository root, from the same revision as the firmware:
+//   g++ -std=c++14 -O2 -Isrc tools/attitude/attitude_bench.cpp src/attitude.cpp -o attitude_bench
+//
+// Usage:
+//   attitude_bench [--csv <scenario>]
+// Prints the RMS and worst error of every scenario, the final gyro bias
+// error perpendicular to gravity and the time per update, and exits with 1
+// if a scenario is outside its limits. --csv writes t, true and estimated pitch and roll of one
+// scenario to stdout instead.
+//
+// Yaw has no reference here, so it is not checked, and neither is the bias
+// about the gravity axis that only yaw would show.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "attitude.h"
+#include "config.h"
+
+static const double G = 9.81;
+
+struct Quat {
+    double w, x, y, z;
+};
+
+static Quat Mul(const Quat& a, const Quat& b) {
+    return {a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+            a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w};
+}
+
+static Quat Conj(const Quat& q) { return {q.w, -q.x, -q.y, -q.z}; }
+
+static Quat AxisAngle(double x, double y, double z, double angle) {
+    double s = sin(angle / 2);
+    return {cos(angle / 2), x * s, y * s, z * s};
+}
+
+// World vector v in the body frame of attitude q
+static void ToBody(const Quat& q, const double v[3], double out[3]) {
+    Quat r = Mul(Mul(Conj(q), {0, v[0], v[1], v[2]}), q);
+    out[0] = r.x;
+    out[1] = r.y;
+    out[2] = r.z;
+}
+
+// Body attitude and world acceleration of the robot at time t. Angles use the
+// AttitudeEuler conventions: pitch is minus the rotation about body y.
+struct Pose {
+    double yaw, pitch, roll;
+    double acc[3]; // World frame linear acceleration, m/s^2
+};
+
+static Quat PoseQuat(const Pose& p) {
+    return Mul(Mul(AxisAngle(0, 0, 1, p.yaw), AxisAngle(1, 0, 0, p.roll)), AxisAngle(0, 1, 0, -p.pitch));
+}
+
+struct Scenario {
+    const char* name;
+    double seconds;
+    std::function<Pose(double)> motion;
+    double bias[3];       // True gyro bias, rad/s
+    double settle_s;      // Errors before this are not scored
+    double max_rms_deg;   // Limits on pitch and roll error after settle_s
+    double max_err_deg;
+    double max_bias_err;  // Limit on the final bias error, rad/s, or 0
+    double tare = 0;      // Pitch taken off as IMUTarePitch would, rad
+    double max_rate_err_deg = 0; // Limit on the pitch, roll and yaw rate error, deg/s, or 0
+};
+
+static double WrapPi(double a) {
+    return a - 2 * M_PI * floor((a + M_PI) / (2 * M_PI));
+}
+
+static double SmoothStep(double t, double t0, double t1) {
+    if (t <= t0) return 0;
+    if (t >= t1) return 1;
+    double u = (t - t0) / (t1 - t0);
+    return u * u * (3 - 2 * u);
+}
+
+static std::vector<Scenario> Scenarios() {
+    std::vector<Scenario> s;
+    s.push_back({"still, tilted, biased gyro", 60,
+                 [](double) { return Pose{0.3, 0.17, 0.09, {0, 0, 0}}; },
+                 {0.02, -0.03, 0.01}, 20, 0.3, 0.6, 0.001});
+    s.push_back({"pitch and roll sway", 30,
+                 [](double t) {
+                     return Pose{0.1 * t, 0.3 * sin(2 * M_PI * 1.0 * t), 0.1 * sin(2 * M_PI * 0.7 * t),
+                                 {0.5 * sin(2 * M_PI * 1.3 * t), 0, 0}};
+                 },
+                 {0.01, 0.01, -0.02}, 5, 1.0, 2.5, 0});
+    s.push_back({"trot, 1g vertical bounce", 30,
+                 [](double t) {
+                     return Pose{0, 0.05 * sin(2 * M_PI * 2 * t), 0.03 * sin(2 * M_PI * 2 * t + 1),
+                                 {0, 0, G * sin(2 * M_PI * 4 * t)}};
+                 },
+                 {0.005, -0.01, 0}, 5, 1.0, 2.5, 0});
+    s.push_back({"backflip", 6,
+                 [](double t) {
+                     // Push off for 0.2s at 2g, then a full rotation in 0.5s of
+                     // free fall, then land and stand
+                     Pose p{0, 0, 0, {0, 0, 0}};
+                     if (t >= 2.0 && t < 2.2) p.acc[2] = 2 * G;
+                     if (t >= 2.2 && t < 2.7) p.acc[2] = -G;
+                     if (t >= 2.7 && t < 2.8) p.acc[2] = 3 * G;
+                     p.pitch = 2 * M_PI * SmoothStep(t, 2.2, 2.7);
+                     return p;
+                 },
+                 {0.005, 0.005, 0}, 1, 1.0, 3.0, 0});
+    // Tared while leaning back, then yawing and rolling: the angle rates
+    // must still be turned by the body's pitch, not the tared one
+    s.push_back({"yaw and roll, tared pitch", 20,
+                 [](double t) {
+                     return Pose{0.8 * sin(2 * M_PI * 0.5 * t), 0.6 + 0.1 * sin(2 * M_PI * 0.3 * t),
+                                 0.3 * sin(2 * M_PI * 0.8 * t), {0, 0, 0}};
+                 },
+                 {0.01, 0.01, -0.02}, 5, 1.0, 2.5, 0, 0.6, 10});
+    return s;
+}
+
+struct Result {
+    double rms_pitch, rms_roll, max_err, bias_err;
+    double stale_pitch_err, predicted_pitch_err; // Worst pitch error half an IMU period after a sample
+    double rate_err; // Worst pitch, roll or yaw rate error, deg/s
+};
+
+static Result Run(const Scenario& sc, FILE* csv) {
+    const double dt = 1.0 / IMU_SEND_FREQ;
+    const int substeps = 20;
+    std::mt19937 rng(1);
+    std::normal_distribution<double> gyro_noise(0, 0.003), accel_noise(0, 0.05);
+
+    AttitudeEstimator e;
+    AttitudeInit(e, IMU_ATTITUDE_KP, IMU_ATTITUDE_KI, IMU_ACCEL_GATE);
+
+    Result r = {0, 0, 0, 0, 0, 0, 0};
+    int scored = 0;
+    int n = (int)(sc.seconds / dt);
+    for (int i = 0; i < n; i++) {
+        double t = i * dt;
+        // Average body rate over the sample period, as the BNO080 reports it
+        double rate[3] = {0, 0, 0};
+        for (int k = 0; k < substeps; k++) {
+            double h = dt / substeps;
+            double ta = t - dt + k * h;
+            Quat qa = PoseQuat(sc.motion(ta)), qb = PoseQuat(sc.motion(ta + h));
+            Quat d = Mul(Conj(qa), qb);
+            if (d.w < 0) d = {-d.w, -d.x, -d.y, -d.z};
+            double angle = 2 * atan2(sqrt(d.x * d.x + d.y * d.y + d.z * d.z), d.w);
+            double norm = sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+            if (norm > 0) {
+                rate[0] += d.x / norm * angle / dt;
+                rate[1] += d.y / norm * angle / dt;
+                rate[2] += d.z / norm * angle / dt;
+            }
+        }
+        Pose p = sc.motion(t);
+        Quat q = PoseQuat(p);
+        double f_world[3] = {p.acc[0], p.acc[1], p.acc[2] + G};
+        double f[3];
+        ToBody(q, f_world, f);
+
+        float gx = rate[0] + sc.bias[0] + gyro_noise(rng);
+        float gy = rate[1] + sc.bias[1] + gyro_noise(rng);
+        float gz = rate[2] + sc.bias[2] + gyro_noise(rng);
+        float ax = f[0] + accel_noise(rng), ay = f[1] + accel_noise(rng), az = f[2] + accel_noise(rng);
+        AttitudeUpdate(e, gx, gy, gz, ax, ay, az, dt);
+
+        float yaw, pitch, roll;
+        AttitudeEuler(e, yaw, pitch, roll);
+        double pitch_err = WrapPi(pitch - p.pitch) * 180 / M_PI;
+        double roll_err = (roll - p.roll) * 180 / M_PI;
+        if (csv) {
+            fprintf(csv, "%.3f,%.3f,%.3f,%.3f,%.3f\n", t, p.pitch * 180 / M_PI, WrapPi(pitch) * 180 / M_PI,
+                    p.roll * 180 / M_PI, roll * 180 / M_PI);
+        }
+        // Where a control tick half an IMU period later sees the body, as
+        // the sample left it and extrapolated with IMUPredictAttitude's math
+        // with the tare taken off the pitch as imu.cpp does
+        float tared = pitch - (float)sc.tare;
+        Attitude a = {(uint32_t)(t * 1e6), yaw, tared, roll, gx - e.bias_x, gy - e.bias_y, gz - e.bias_z, 0, 0, 0};
+        AttitudeSetEulerRates(a, pitch);
+        Attitude predicted;
+        AttitudePredict(a, a.t_us + (uint32_t)(dt * 0.5e6), IMU_MAX_PREDICT_US, predicted);
+        double later = sc.motion(t + dt / 2).pitch - sc.tare;
+        // The gyro reports the average rate over the sample period, so compare
+        // with the angles' rates halfway through it
+        Pose p0 = sc.motion(t - dt), p1 = sc.motion(t);
+        double rate_err = std::max(fabs(a.pitch_rate - WrapPi(p1.pitch - p0.pitch) / dt),
+                                   std::max(fabs(a.roll_rate - (p1.roll - p0.roll) / dt),
+                                            fabs(a.yaw_rate - WrapPi(p1.yaw - p0.yaw) / dt)));
+
+        if (t >= sc.settle_s) {
+            r.stale_pitch_err = std::max(r.stale_pitch_err, fabs(WrapPi(tared - later)) * 180 / M_PI);
+            r.predicted_pitch_err = std::max(r.predicted_pitch_err, fabs(WrapPi(predicted.pitch - later)) * 180 / M_PI);
+            r.rate_err = std::max(r.rate_err, rate_err * 180 / M_PI);
+            r.rms_pitch += pitch_err * pitch_err;
+            r.rms_roll += roll_err * roll_err;
+            r.max_err = std::max(r.max_err, std::max(fabs(pitch_err), fabs(roll_err)));
+            scored++;
+        }
+    }
+    r.rms_pitch = sqrt(r.rms_pitch / scored);
+    r.rms_roll = sqrt(r.rms_roll / scored);
+    // Only the bias perpendicular to gravity is observable from the accelerometer
+    double up[3], world_up[3] = {0, 0, 1};
+    ToBody(PoseQuat(sc.motion(sc.seconds)), world_up, up);
+    double err[3] = {e.bias_x - sc.bias[0], e.bias_y - sc.bias[1], e.bias_z - sc.bias[2]};
+    double along = err[0] * up[0] + err[1] * up[1] + err[2] * up[2];
+    for (int i = 0; i < 3; i++) err[i] -= along * up[i];
+    r.bias_err = sqrt(err[0] * err[0] + err[1] * err[1] + err[2] * err[2]);
+    return r;
+}
+
+static void Benchmark() {
+    AttitudeEstimator e;
+    AttitudeInit(e, IMU_ATTITUDE_KP, IMU_ATTITUDE_KI, IMU_ACCEL_GATE);
+    const int n = 10000000;
+    // Inputs that change every update so nothing is hoisted out of the loop
+    std::vector<float> in(1024);
+    std::mt19937 rng(2);
+    std::normal_distribution<float> noise(0, 0.05f);
+    for (float& v : in) v = noise(rng);
+
+    float sink = 0;
+    auto start = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned long long c0 = __rdtsc();
+#endif
+    for (int i = 0; i < n; i++) {
+        float v = in[i & 1023];
+        AttitudeUpdate(e, v, -v, 0.5f * v, v, -v, G + v, 0.01f);
+        sink += e.q1;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned long long c1 = __rdtsc();
+#endif
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+    printf("update: %.1f ns", ns);
+#if defined(__x86_64__) || defined(__i386__)
+    printf(", %.0f TSC cycles", (double)(c1 - c0) / n);
+#endif
+    printf(" (sink %g)\n", sink);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+        float yaw, pitch, roll;
+        e.q1 = in[i & 1023];
+        AttitudeEuler(e, yaw, pitch, roll);
+        sink += yaw + pitch + roll;
+    }
+    ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+    printf("euler:  %.1f ns (sink %g)\n", ns, sink);
+}
+
+int main(int argc, char** argv) {
+    std::vector<Scenario> scenarios = Scenarios();
+    if (argc == 3 && strcmp(argv[1], "--csv") == 0) {
+        for (const Scenario& sc : scenarios) {
+            if (sc.name == std::string(argv[2])) {
+                printf("t,pitch,est_pitch,roll,est_roll\n");
+                Run(sc, stdout);
+                return 0;
+            }
+        }
+        fprintf(stderr, "No scenario named \"%s\"\n", argv[2]);
+        return 2;
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: attitude_bench [--csv <scenario>]\n");
+        return 2;
+    }
+
+    bool ok = true;
+    printf("%-28s %10s %10s %10s %12s %11s %11s %11s\n", "scenario", "rms pitch", "rms roll", "max err", "bias err",
+           "stale err", "pred err", "rate err");
+    for (const Scenario& sc : scenarios) {
+        Result r = Run(sc, NULL);
+        bool pass = r.rms_pitch <= sc.max_rms_deg && r.rms_roll <= sc.max_rms_deg && r.max_err <= sc.max_err_deg &&
+                    (sc.max_bias_err == 0 || r.bias_err <= sc.max_bias_err) &&
+                    (sc.max_rate_err_deg == 0 || r.rate_err <= sc.max_rate_err_deg);
+        printf("%-28s %8.3f d %8.3f d %8.3f d %8.4f r/s %9.3f d %9.3f d %7.2f d/s  %s\n", sc.name, r.rms_pitch,
+               r.rms_roll, r.max_err, r.bias_err, r.stale_pitch_err, r.predicted_pitch_err, r.rate_err,
+               pass ? "ok" : "FAIL");
+        ok = ok && pass;
+    }
+    Benchmark();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+// Host fuzz and throughput test of the text command parser in
+// src/command_parser.h.
+//
+// Checks CommandParseFloat against strtof on random numbers it promises to
+// round correctly, and CommandParseInt against strtoll, including overflow.
+// Then feeds random commands and random bytes to CommandTokenize and both
+// parsers and checks that every token stays inside its command and that
+// whatever they accept strtof/strtoll read the same way. Build it with
+// -fsanitize=address,undefined to catch reads past the buffer. Finally times
+// typical commands against the sscanf parsing InterpretCommand used before.
+//
+// Build from the repository root, from the same revision as the firmware:
+//   g++ -std=c++14 -O2 -Isrc -Itools/common tools/cmdparse/cmdparse_test.cpp -o cmdparse_test
+//
+// Usage:
+//   cmdparse_test [iterations]
+// Prints the worst error of every check and the time per command, and exits
+// with 1 if a check is outside its limit.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "command_parser.h"
+#include "check.h"
+
+// Same as MAX_COMMAND_LENGTH in src/usb_serial.cpp
+static const int MAX_COMMAND_LENGTH = 32;
+
+static uint32_t rng = 12345;
+
+static uint32_t Random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static int RandomInt(int lo, int hi) {
+    return lo + (int)(Random() % (uint32_t)(hi - lo + 1));
+}
+
+/**
+ * A number CommandParseFloat rounds correctly: up to 7 significant digits,
+ * exponent within +-10, written in one of the ways people type them.
+ */
+static std::string RandomNumber() {
+    int digits = RandomInt(1, 7);
+    std::string mantissa;
+    for (int i = 0; i < digits; i++) {
+        mantissa += (char)('0' + RandomInt(i == 0 ? 1 : 0, 9));
+    }
+    int point = RandomInt(0, digits);
+    std::string s = RandomInt(0, 3) == 0 ? "-" : (RandomInt(0, 7) == 0 ? "+" : "");
+    if (point == 0) {
+        s += RandomInt(0, 1) ? "0." : ".";
+        s += mantissa;
+    } else {
+        s += mantissa.substr(0, point);
+        if (point < digits || RandomInt(0, 3) == 0) s += ".";
+        s += mantissa.substr(point);
+    }
+    if (RandomInt(0, 3) == 0) {
+        // The value is the digits as an integer times 10^(e - digits after
+        // the point); keep that power within +-10
+        int scale = digits - point;
+        int e = RandomInt(scale - 10, scale + 10);
+        char buf[8];
+        snprintf(buf, sizeof(buf), "%s%d", RandomInt(0, 1) ? "e" : "E", e);
+        s += buf;
+    }
+    return s;
+}
+
+/**
+ * Bytes a command could hold, weighted towards the characters the lexer and
+ * parsers treat specially.
+ */
+static std::string RandomBytes(int max_len) {
+    static const char special[] = " \t\r0123456789.-+eE";
+    int len = RandomInt(0, max_len);
+    std::string s;
+    for (int i = 0; i < len; i++) {
+        if (RandomInt(0, 2) == 0) {
+            s += (char)RandomInt(1, 255);
+        } else {
+            s += special[RandomInt(0, sizeof(special) - 2)];
+        }
+    }
+    return s;
+}
+
+static const char* const typical_commands[] = {
+    "f 2.0", "l 0.15", "h 0.17", "s -0.04", "p 0.35", "g 80 0.5 50 0.5", "T", " S", "M est_* 2", "u 0.06",
+};
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    // Floats: bit for bit what strtof makes of them
+    int float_mismatches = 0;
+    for (int i = 0; i < iterations; i++) {
+        std::string s = RandomNumber();
+        float value;
+        bool ok = CommandParseFloat(s.data(), s.size(), value);
+        float expected = strtof(s.c_str(), NULL);
+        if (!ok || value != expected) {
+            if (float_mismatches++ < 5) {
+                printf("  float \"%s\": %s %.9g, strtof %.9g\n", s.c_str(), ok ? "got" : "rejected", value, expected);
+            }
+        }
+    }
+    Check("float vs strtof (mismatches)", float_mismatches, 0);
+
+    // Integers, with values past INT32 to check overflow is rejected
+    int int_mismatches = 0;
+    for (int i = 0; i < iterations; i++) {
+        int64_t v = (int64_t)(((uint64_t)Random() << 32) | Random()) >> RandomInt(0, 62);
+        std::string s = std::to_string(v);
+        int32_t value;
+        bool ok = CommandParseInt(s.data(), s.size(), value);
+        bool fits = v >= -INT32_MAX && v <= INT32_MAX;
+        if (ok != fits || (ok && value != v)) {
+            if (int_mismatches++ < 5) {
+                printf("  int \"%s\": %s %d\n", s.c_str(), ok ? "got" : "rejected", ok ? value : 0);
+            }
+        }
+    }
+    Check("int vs strtoll (mismatches)", int_mismatches, 0);
+
+    // Random commands: tokens must lie inside the command, hold no spaces,
+    // and anything a parser accepts must read the same with the C library
+    int token_errors = 0, parse_errors = 0;
+    double float_err = 0;
+    int accepted_floats = 0, accepted_ints = 0;
+    for (int i = 0; i < iterations; i++) {
+        std::string text;
+        if (RandomInt(0, 1) == 0) {
+            text = RandomBytes(MAX_COMMAND_LENGTH);
+        } else {
+            text = (char)RandomInt('a', 'z');
+            int args = RandomInt(0, COMMAND_MAX_ARGS + 1);
+            for (int a = 0; a < args; a++) {
+                text += " " + (RandomInt(0, 3) == 0 ? RandomBytes(6) : RandomNumber());
+            }
+        }
+        // NUL ends a command, as it does in the mailbox
+        text = text.substr(0, strlen(text.c_str()));
+        // Exact size heap copy, so reading past the NUL trips the sanitizer
+        std::vector<char> buf(text.begin(), text.end());
+        buf.push_back('\0');
+        const char* begin = buf.data();
+        const char* end = begin + text.size();
+
+        CommandText cmd;
+        if (!CommandTokenize(begin, cmd)) {
+            continue;
+        }
+        if (CommandIsSpace(cmd.letter) || cmd.argc < 0 || cmd.argc > COMMAND_MAX_ARGS) {
+            token_errors++;
+            continue;
+        }
+        for (int a = 0; a < cmd.argc; a++) {
+            const char* arg = cmd.args[a];
+            int len = cmd.arg_len[a];
+            bool bad = arg <= begin || arg + len > end || len == 0;
+            for (int k = 0; !bad && k < len; k++) {
+                bad = CommandIsSpace(arg[k]) || arg[k] == '\0';
+            }
+            if (bad) {
+                token_errors++;
+                continue;
+            }
+
+            std::string arg_text(arg, len);
+            float f;
+            if (CommandParseFloat(arg, len, f)) {
+                accepted_floats++;
+                char* stop;
+                float expected = strtof(arg_text.c_str(), &stop);
+                if (*stop != '\0') {
+                    parse_errors++;
+                } else if (std::isfinite(expected) && expected != 0) {
+                    // More than 7 digits or a far exponent is only close
+                    float_err = fmax(float_err, fabs((double)f - expected) / fabs(expected));
+                }
+            }
+            int32_t n;
+            if (CommandParseInt(arg, len, n)) {
+                accepted_ints++;
+                char* stop;
+                long long expected = strtoll(arg_text.c_str(), &stop, 10);
+                if (*stop != '\0' || expected != n) {
+                    parse_errors++;
+                }
+            }
+        }
+    }
+    printf("fuzzed %d commands, %d floats and %d ints accepted\n", iterations, accepted_floats, accepted_ints);
+    Check("tokens outside their command", token_errors, 0);
+    Check("accepted, C library disagrees", parse_errors, 0);
+    Check("accepted floats, rel. error", float_err, 1e-6);
+
+    // Throughput on typical commands, against the sscanf parsing
+    // InterpretCommand did before: " %c %f", then "g %f %f %f %f" for gains
+    const int n_typical = sizeof(typical_commands) / sizeof(typical_commands[0]);
+    const int rounds = iterations / n_typical + 1;
+    float sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < n_typical; i++) {
+            CommandText cmd;
+            float f;
+            if (CommandTokenize(typical_commands[i], cmd)) {
+                for (int a = 0; a < cmd.argc; a++) {
+                    if (CommandParseFloat(cmd.args[a], cmd.arg_len[a], f)) sink += f;
+                }
+            }
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < n_typical; i++) {
+            char c = 0;
+            float f[4];
+            if (sscanf(typical_commands[i], " %c %f", &c, &f[0]) == 2) sink += f[0];
+            if (c == 'g' && sscanf(typical_commands[i], "g %f %f %f %f", &f[0], &f[1], &f[2], &f[3]) == 4) sink += f[3];
+        }
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    double commands = (double)rounds * n_typical;
+    printf("command_parser: %.1f ns per command\n", std::chrono::duration<double, std::nano>(t1 - t0).count() / commands);
+    printf("sscanf:         %.1f ns per command\n", std::chrono::duration<double, std::nano>(t2 - t1).count() / commands);
+    if (sink == 12345.0f) printf("\n"); // Keep the loops from being optimized away
+
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+// Pass/fail bookkeeping for the host checks under tools/. Each check program
+// includes it once, calls Check for every measurement and exits with 1 if
+// failures is not 0.
+
+#ifndef TOOLS_CHECK_H
+#define TOOLS_CHECK_H
+
+#include <cstdio>
+
+static int failures = 0;
+
+/**
+ * Print the worst error a check saw against its limit, and count it as a
+ * failure if it is over.
+ */
+static void Check(const char* name, double worst, double limit) {
+    bool ok = worst <= limit;
+    printf("%-32s worst %.3g (limit %.3g)%s\n", name, worst, limit, ok ? "" : "  FAIL");
+    if (!ok) failures++;
+}
+
+#endif
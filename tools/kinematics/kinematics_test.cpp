@@ -0,0 +1,106 @@
+// Host check of the leg Jacobian in src/kinematics.cpp.
+//
+// Compares LegJacobian with central finite differences of
+// LegForwardKinematics over the leg's working range, checks that foot forces
+// and currents survive the round trip through the force and current maps,
+// and that the forces do the same virtual work as the torques. Then times
+// both force maps for all four legs, as the control tick runs them.
+//
+// Build from the repository root, from the same revision as the firmware:
+//   g++ -std=c++14 -O2 -Isrc -Itools/common tools/kinematics/kinematics_test.cpp src/kinematics.cpp -o kinematics_test
+//
+// Usage:
+//   kinematics_test
+// Prints the worst error of every check and the time per control tick, and
+// exits with 1 if a check is outside its limit.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "kinematics.h"
+#include "check.h"
+
+int main() {
+    // theta over a full step either way, gamma from nearly straight to
+    // nearly folded; the singular ends are excluded
+    double jacobian_err = 0, force_err = 0, work_err = 0, current_err = 0;
+    int points = 0;
+    for (int dir = 0; dir < 2; dir++) {
+        float d = dir == 0 ? -1.0f : 1.0f;
+        for (float theta = -1.2f; theta <= 1.2f; theta += 0.05f) {
+            for (float gamma = 0.15f; gamma <= 2.6f; gamma += 0.05f) {
+                points++;
+                float J[2][2];
+                LegJacobian(theta, gamma, d, J);
+
+                // Central differences. Float rounding in the kinematics
+                // limits their accuracy to ~1e-7 / h.
+                const float h = 1e-3f;
+                float xp, yp, xm, ym;
+                LegForwardKinematics(theta + h, gamma, d, xp, yp);
+                LegForwardKinematics(theta - h, gamma, d, xm, ym);
+                jacobian_err = fmax(jacobian_err, fabs((xp - xm) / (2 * h) - J[0][0]));
+                jacobian_err = fmax(jacobian_err, fabs((yp - ym) / (2 * h) - J[1][0]));
+                LegForwardKinematics(theta, gamma + h, d, xp, yp);
+                LegForwardKinematics(theta, gamma - h, d, xm, ym);
+                jacobian_err = fmax(jacobian_err, fabs((xp - xm) / (2 * h) - J[0][1]));
+                jacobian_err = fmax(jacobian_err, fabs((yp - ym) / (2 * h) - J[1][1]));
+
+                // Force to torque and back
+                float fx = 20.0f * sinf(3 * theta + gamma), fy = 40.0f + 10.0f * cosf(gamma);
+                float tau_theta, tau_gamma, fx2, fy2;
+                LegFootForceToTorque(theta, gamma, d, fx, fy, tau_theta, tau_gamma);
+                if (LegTorqueToFootForce(theta, gamma, d, tau_theta, tau_gamma, fx2, fy2)) {
+                    force_err = fmax(force_err, fmax(fabs(fx2 - fx), fabs(fy2 - fy)) / 50.0);
+                }
+
+                // Virtual work: a small leg motion moves the foot by J dq,
+                // and tau . dq must equal f . dx
+                float dtheta = 1e-3f, dgamma = -2e-3f;
+                double dx = J[0][0] * dtheta + J[0][1] * dgamma;
+                double dy = J[1][0] * dtheta + J[1][1] * dgamma;
+                double work_f = fx * dx + fy * dy;
+                double work_tau = tau_theta * dtheta + tau_gamma * dgamma;
+                work_err = fmax(work_err, fabs(work_f - work_tau));
+
+                // Feedforward currents through the motor map and back to a force
+                float i_theta, i_gamma, c0, c1, fx3, fy3;
+                LegFootForceToCurrents(theta, gamma, d, fx, fy, i_theta, i_gamma);
+                CoupledToMotorCurrents(i_theta, i_gamma, c0, c1);
+                if (LegCurrentsToFootForce(theta, gamma, d, c0, c1, fx3, fy3)) {
+                    current_err = fmax(current_err, fmax(fabs(fx3 - fx), fabs(fy3 - fy)) / 50.0);
+                }
+            }
+        }
+    }
+    printf("%d leg poses\n", points);
+    Check("Jacobian vs differences", jacobian_err, 1e-3);
+    Check("force round trip (rel)", force_err, 1e-4);
+    Check("virtual work (J)", work_err, 1e-6);
+    Check("current round trip (rel)", current_err, 1e-4);
+
+    float fx, fy;
+    bool straight = LegTorqueToFootForce(0.0f, 0.0f, 1.0f, 1.0f, 1.0f, fx, fy);
+    printf("straight leg rejected: %s\n", straight ? "no  FAIL" : "yes");
+    if (straight) failures++;
+
+    // Per control tick cost: both maps for all four legs
+    const int ticks = 200000;
+    volatile float sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int t = 0; t < ticks; t++) {
+        for (int i = 0; i < 4; i++) {
+            float theta = 0.3f * sinf(t * 1e-3f + i), gamma = 1.0f + 0.3f * cosf(t * 1e-3f);
+            float c0 = 2.0f, c1 = -1.0f, fx, fy, i_theta, i_gamma;
+            LegCurrentsToFootForce(theta, gamma, LEG_DIRECTION[i], c0, c1, fx, fy);
+            LegFootForceToCurrents(theta, gamma, LEG_DIRECTION[i], 0.0f, 12.0f, i_theta, i_gamma);
+            sink += fx + fy + i_theta + i_gamma;
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / ticks;
+    printf("four legs, both maps: %.0f ns per tick\n", ns);
+
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,295 @@
+// Host decoder for the self-describing SD logs written by DatalogThread
+// (LOGGERnn.BIN, format described in src/log_format.h).
+//
+// The schema is read from the file header, so logs from older or newer
+// firmware decode without changes here as long as the format version matches.
+//
+// Build from the repository root:
+//   g++ -std=c++14 -O2 -Isrc tools/logdecode/logdecode.cpp -o logdecode
+//
+// Usage:
+//   logdecode <LOGGERnn.BIN> [-o out.csv]      CSV with a header row (default stdout)
+//   logdecode <LOGGERnn.BIN> --columns <dir>   one little endian float64 file per
+//                                              field, <dir>/<name>.f64
+//   logdecode <LOGGERnn.BIN> --schema          print the schema and stop
+// Add --stats to print record counts, drops and decode throughput to stderr.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "log_format.h"
+
+struct Field {
+    std::string name;
+    uint8_t encoding;
+    float scale;
+    int decimals; // Digits after the point if scale is a power of ten, else -1
+};
+
+// Buffered writer that avoids stdio per value. Callers reserve space for a
+// whole line up front and then write straight into the buffer.
+class Output {
+public:
+    explicit Output(FILE* f) : f_(f), buf_(new char[kSize]), pos_(0) {}
+    ~Output() { Flush(); delete[] buf_; }
+    char* Reserve(size_t n) {
+        if (pos_ + n > kSize) Flush();
+        return buf_ + pos_;
+    }
+    void Commit(char* end) { pos_ = end - buf_; }
+    void Put(const char* s, size_t n) {
+        char* p = Reserve(n);
+        memcpy(p, s, n);
+        Commit(p + n);
+    }
+    void Flush() {
+        if (pos_ > 0) fwrite(buf_, 1, pos_, f_);
+        pos_ = 0;
+    }
+private:
+    static const size_t kSize = 1 << 20;
+    FILE* f_;
+    char* buf_;
+    size_t pos_;
+};
+
+// Formats q / 10^decimals without going through floating point
+static char* FormatFixed(char* out, int64_t q, int decimals) {
+    char tmp[32];
+    bool neg = q < 0;
+    uint64_t v = neg ? (uint64_t)(-q) : (uint64_t)q;
+    int n = 0;
+    do {
+        tmp[n++] = '0' + (v % 10);
+        v /= 10;
+        if (n == decimals) tmp[n++] = '.';
+    } while (v != 0 || n <= decimals);
+    if (tmp[n - 1] == '.') tmp[n++] = '0';
+    if (neg) *out++ = '-';
+    while (n > 0) *out++ = tmp[--n];
+    return out;
+}
+
+static bool ParseSchema(const uint8_t* p, size_t size, LogFileHeader& header, std::vector<Field>& fields) {
+    if (size < sizeof(header)) return false;
+    memcpy(&header, p, sizeof(header));
+    if (header.magic != LOG_FILE_MAGIC) {
+        fprintf(stderr, "Not a Doggo log file\n");
+        return false;
+    }
+    if (header.version != LOG_FORMAT_VERSION) {
+        fprintf(stderr, "Unsupported log format version %u (expected %u)\n",
+                header.version, LOG_FORMAT_VERSION);
+        return false;
+    }
+    size_t end = (size_t)header.header_blocks * LOG_BLOCK_SIZE;
+    if (end > size) return false;
+    size_t off = sizeof(header);
+    for (int i = 0; i < header.field_count; i++) {
+        const void* nul = memchr(p + off, 0, end - off);
+        if (nul == NULL) return false;
+        Field f;
+        f.name = (const char*)(p + off);
+        off = (const uint8_t*)nul - p + 1;
+        if (off + 1 + sizeof(float) > end) return false;
+        f.encoding = p[off++];
+        memcpy(&f.scale, p + off, sizeof(float));
+        off += sizeof(float);
+        f.decimals = -1;
+        float s = 1;
+        for (int d = 0; d <= 9; d++, s *= 10) {
+            if (f.scale == s) f.decimals = d;
+        }
+        fields.push_back(f);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* path = NULL;
+    const char* out_path = NULL;
+    const char* columns_dir = NULL;
+    bool schema_only = false, stats = false;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "-o" && i + 1 < argc) out_path = argv[++i];
+        else if (a == "--columns" && i + 1 < argc) columns_dir = argv[++i];
+        else if (a == "--schema") schema_only = true;
+        else if (a == "--stats") stats = true;
+        else path = argv[i];
+    }
+    if (path == NULL) {
+        fprintf(stderr, "usage: logdecode <LOGGERnn.BIN> [-o out.csv | --columns dir | --schema] [--stats]\n");
+        return 2;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    size_t size = st.st_size;
+    const uint8_t* data = (const uint8_t*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Cannot map %s\n", path);
+        return 1;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    LogFileHeader header;
+    std::vector<Field> fields;
+    if (!ParseSchema(data, size, header, fields)) {
+        fprintf(stderr, "%s: bad or truncated header\n", path);
+        return 1;
+    }
+    if (schema_only) {
+        printf("version %u, %zu fields\n", header.version, fields.size());
+        static const char* enc_names[] = {"varint", "delta", "counter"};
+        for (const Field& f : fields) {
+            printf("%-16s %-8s scale %g\n", f.name.c_str(),
+                   f.encoding <= LOG_ENC_COUNTER ? enc_names[f.encoding] : "?", f.scale);
+        }
+        return 0;
+    }
+
+    // Set up the output
+    FILE* csv_file = NULL;
+    std::vector<FILE*> column_files;
+    std::vector<std::vector<double>> column_bufs;
+    if (columns_dir) {
+        for (const Field& f : fields) {
+            std::string p = std::string(columns_dir) + "/" + f.name + ".f64";
+            FILE* cf = fopen(p.c_str(), "wb");
+            if (cf == NULL) {
+                fprintf(stderr, "Cannot create %s\n", p.c_str());
+                return 1;
+            }
+            column_files.push_back(cf);
+        }
+        column_bufs.resize(fields.size());
+    } else {
+        csv_file = out_path ? fopen(out_path, "w") : stdout;
+        if (csv_file == NULL) {
+            fprintf(stderr, "Cannot create %s\n", out_path);
+            return 1;
+        }
+    }
+    Output csv(csv_file ? csv_file : stdout);
+    if (csv_file) {
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (i) csv.Put(",", 1);
+            csv.Put(fields[i].name.data(), fields[i].name.size());
+        }
+        csv.Put("\n", 1);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const size_t n_fields = fields.size();
+    std::vector<int32_t> prev(n_fields);
+    std::vector<int64_t> counter(n_fields, 0);
+    std::vector<uint32_t> counter_raw(n_fields, 0);
+    std::vector<uint8_t> counter_init(n_fields, 0);
+    uint64_t records = 0, dropped = 0, blocks = 0;
+    // Longest possible CSV value is a sign, 20 digits and a point
+    const size_t line_max = n_fields * 24 + 1;
+
+    for (size_t off = (size_t)header.header_blocks * LOG_BLOCK_SIZE;
+         off + LOG_BLOCK_SIZE <= size; off += LOG_BLOCK_SIZE, blocks++) {
+        LogBlockHeader bh;
+        memcpy(&bh, data + off, sizeof(bh));
+        if (bh.magic != LOG_BLOCK_MAGIC || bh.seq != blocks || bh.bytes > LOG_BLOCK_PAYLOAD) {
+            break; // End of the log
+        }
+        dropped += bh.dropped;
+        const uint8_t* p = data + off + sizeof(bh);
+        const uint8_t* end = p + bh.bytes;
+        std::fill(prev.begin(), prev.end(), 0);
+
+        while (p < end) {
+            char* line = columns_dir ? NULL : csv.Reserve(line_max);
+            for (size_t i = 0; i < n_fields; i++) {
+                uint32_t raw;
+                int n = LogGetVarint(p, end, raw);
+                if (n == 0) {
+                    fprintf(stderr, "Truncated record in block %llu\n", (unsigned long long)blocks);
+                    return 1;
+                }
+                p += n;
+
+                const Field& f = fields[i];
+                int64_t q;
+                if (f.encoding == LOG_ENC_COUNTER) {
+                    uint32_t value = (uint32_t)prev[i] + raw;
+                    prev[i] = (int32_t)value;
+                    // Unwrap across the whole file, not just this block
+                    counter[i] += counter_init[i] ? (uint32_t)(value - counter_raw[i]) : value;
+                    counter_raw[i] = value;
+                    counter_init[i] = 1;
+                    q = counter[i];
+                } else {
+                    int32_t v = LogUnZigZag(raw);
+                    if (f.encoding == LOG_ENC_DELTA) {
+                        v = (int32_t)((uint32_t)prev[i] + (uint32_t)v);
+                    }
+                    prev[i] = v;
+                    q = v;
+                }
+
+                bool is_nan = f.encoding != LOG_ENC_COUNTER && q == LOG_NAN;
+                if (columns_dir) {
+                    column_bufs[i].push_back(is_nan ? NAN : q / (double)f.scale);
+                } else {
+                    if (i) *line++ = ',';
+                    if (is_nan) {
+                        memcpy(line, "nan", 3);
+                        line += 3;
+                    } else if (f.decimals >= 0) {
+                        line = FormatFixed(line, q, f.decimals);
+                    } else {
+                        line += snprintf(line, 24, "%.7g", q / (double)f.scale);
+                    }
+                }
+            }
+            if (line) {
+                *line++ = '\n';
+                csv.Commit(line);
+            }
+            records++;
+        }
+
+        if (columns_dir && column_bufs[0].size() >= 65536) {
+            for (size_t i = 0; i < n_fields; i++) {
+                fwrite(column_bufs[i].data(), sizeof(double), column_bufs[i].size(), column_files[i]);
+                column_bufs[i].clear();
+            }
+        }
+    }
+
+    for (size_t i = 0; i < column_files.size(); i++) {
+        fwrite(column_bufs[i].data(), sizeof(double), column_bufs[i].size(), column_files[i]);
+        fclose(column_files[i]);
+    }
+    csv.Flush();
+    if (csv_file && csv_file != stdout) fclose(csv_file);
+
+    if (stats) {
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double mb = blocks * (double)LOG_BLOCK_SIZE / 1e6;
+        fprintf(stderr, "%llu blocks, %llu records (%.1f bytes/record), %llu dropped, %.1f MB/s\n",
+                (unsigned long long)blocks, (unsigned long long)records,
+                records ? blocks * (double)LOG_BLOCK_PAYLOAD / records : 0.0,
+                (unsigned long long)dropped, s > 0 ? mb / s : 0.0);
+    }
+    munmap((void*)data, size);
+    close(fd);
+    return 0;
+}
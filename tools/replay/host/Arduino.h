@@ -0,0 +1,110 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Minimal host stand-in for the Teensy Arduino core. Only what the control
+// code (src/) and ODriveArduino actually touch is provided. Time is virtual:
+// it only moves when the replay harness or a chThdSleep* call advances it, so
+// every run over the same input is bit-identical.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+#define DEC 10
+#define HEX 16
+#define F(s) (s)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Virtual clock in microseconds, owned by the harness
+extern uint64_t host_clock_us;
+
+inline uint32_t micros() { return (uint32_t)host_clock_us; }
+inline uint32_t millis() { return (uint32_t)(host_clock_us / 1000); }
+inline void delay(uint32_t ms) { host_clock_us += (uint64_t)ms * 1000; }
+inline void delayMicroseconds(uint32_t us) { host_clock_us += us; }
+
+class String {
+public:
+    String() {}
+    String(const char* s) : s_(s) {}
+    String& operator+=(char c) { s_ += c; return *this; }
+    float toFloat() const { return strtof(s_.c_str(), NULL); }
+    long toInt() const { return strtol(s_.c_str(), NULL, 10); }
+    const char* c_str() const { return s_.c_str(); }
+private:
+    std::string s_;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t b) = 0;
+    size_t write(const uint8_t* buf, size_t len) {
+        for (size_t i = 0; i < len; i++) write(buf[i]);
+        return len;
+    }
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(int v, int base = DEC) { return print((long)v, base); }
+    size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(long v, int base = DEC) {
+        char buf[24];
+        snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%ld", v);
+        return write(buf);
+    }
+    size_t print(unsigned long v, int base = DEC) {
+        char buf[24];
+        snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", v);
+        return write(buf);
+    }
+    size_t print(double v, int digits = 2) {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "%.*f", digits, v);
+        return write(buf);
+    }
+
+    size_t println() { return write("\r\n"); }
+    template<class T> size_t println(T v) { size_t n = print(v); return n + println(); }
+    template<class T> size_t println(T v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+};
+
+// Serial port backed by two byte queues: rx is filled by the harness, tx
+// collects everything the firmware writes.
+class HardwareSerial : public Print {
+public:
+    using Print::write;
+    void begin(uint32_t baud) { (void)baud; }
+    void clear() { rx.clear(); }
+    int available() { return (int)rx.size(); }
+    int availableForWrite() { return 4096; }
+    void addMemoryForWrite(void* buffer, size_t size) { (void)buffer; (void)size; }
+    int read() {
+        if (rx.empty()) return -1;
+        uint8_t c = rx.front();
+        rx.pop_front();
+        return c;
+    }
+    size_t write(uint8_t b) override { tx.push_back(b); return 1; }
+    operator bool() { return true; }
+
+    std::deque<uint8_t> rx;
+    std::vector<uint8_t> tx;
+};
+
+extern HardwareSerial Serial, Serial1, Serial2, Serial3, Serial4, Serial5;
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef HOST_CHRT_H
+#define HOST_CHRT_H
+
+// Host stand-in for ChibiOS/RT. Threads are never started on the host; the
+// harness calls the per-tick functions directly. Sleeping advances the
+// virtual clock so blocking state machines (hop, reset) still see time pass.
+
+#include "Arduino.h"
+
+#define NORMALPRIO 128
+#define THD_WORKING_AREA(s, n) char s[n]
+#define THD_FUNCTION(tname, arg) void tname(void* arg)
+
+inline void chThdSleepMicroseconds(uint32_t us) { host_clock_us += us; }
+inline void chThdSleepMilliseconds(uint32_t ms) { host_clock_us += (uint64_t)ms * 1000; }
+inline void chThdYield() {}
+
+// Signaling the control thread's wakeup semaphore sets host_wakeup_pending
+// (owned by the harness), which runs the next tick straight away like the
+// firmware does. Waiting is the harness's job, so it never blocks here.
+extern bool host_wakeup_pending;
+struct binary_semaphore_t {};
+#define BSEMAPHORE_DECL(name, taken) binary_semaphore_t name
+#define TIME_US2I(us) (us)
+#define TIME_IMMEDIATE 0
+inline void chBSemSignal(binary_semaphore_t*) { host_wakeup_pending = true; }
+inline int chBSemWaitTimeout(binary_semaphore_t*, uint32_t us) { host_clock_us += us; return 0; }
+
+#endif
@@ -0,0 +1,473 @@
+// Deterministic log-replay harness for the Doggo control pipeline.
+//
+// Feeds a recorded input stream (ODrive 'P' replies, IMU pitch samples and
+// USB/XBee command bytes, see replay_format.h) through the real firmware code
+// on the host and writes one trace line per control tick holding every byte
+// sent to the ODrives. Time is virtual, so the trace is bit-identical across
+// runs and two traces from different builds can be diffed with --compare.
+//
+// Build from the repository root (the Teensy toolchain builds src/ as C++14):
+//   g++ -std=c++14 -O2 -Itools/replay/host -Isrc -Ilib/ODriveArduino
+//       tools/replay/replay.cpp src/position_control.cpp src/jump.cpp
+//       src/backflip.cpp src/uart.cpp src/usb_serial.cpp src/globals.cpp
+//       src/flight_recorder.cpp src/debug.cpp src/console.cpp src/gait_params.cpp
+//       src/script.cpp src/trajectory.cpp src/attitude.cpp src/kinematics.cpp
+//       src/state_estimator.cpp src/imu_trigger.cpp src/phase_sequencer.cpp
+//       src/foot_forces.cpp src/stance_forces.cpp src/impedance.cpp src/contact.cpp
+//       src/gait_kernels.cpp src/gait_patterns.cpp
+//       lib/ODriveArduino/ODriveArduino.cpp -o replay
+//
+// Usage:
+//   replay run <input.dgrp> [-o trace.txt] [--timing ticks.csv] [--tail-ms N] [--console]
+//   replay compare <a.trace> <b.trace>
+//   replay pack <input.txt> <output.dgrp>
+//   replay gaitbench [ticks]
+//
+// "gaitbench" times the specialized gait kernels (src/gait_kernels.h), the
+// generic gait code and the old per-leg gait code on the host, like the
+// firmware's 'C' command.
+//
+// The text format accepted by "pack" has one event per line:
+//   <t_us> odrv<N> <hex bytes>     e.g. 1500 odrv0 01065034127856xx
+//   <t_us> imu <pitch rad>
+//   <t_us> cmd <text>              a trailing ';' or newline is added if missing
+//   <t_us> cmdhex <hex bytes>      raw command port bytes, eg binary command frames
+// Lines starting with '#' are ignored.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "ChRt.h"
+#include "config.h"
+#include "globals.h"
+#include "position_control.h"
+#include "uart.h"
+#include "usb_serial.h"
+#include "console.h"
+#include "gait_params.h"
+#include "replay_format.h"
+#include "imu.h"
+#include "imu_trigger.h"
+#include "phase_sequencer.h"
+#include "state_estimator.h"
+#include "foot_forces.h"
+#include "contact.h"
+#include "gait_kernels.h"
+#include "gait_patterns.h"
+
+// config.h routes Serial to the XBee port; the harness wants the real objects
+#undef Serial
+
+uint64_t host_clock_us = 0;
+bool host_wakeup_pending = false;
+HardwareSerial Serial, Serial1, Serial2, Serial3, Serial4, Serial5;
+
+// imu.cpp and datalog.cpp need the BNO080 and SdFat drivers so they are not
+// built on the host. Pitch comes straight from the recorded samples, which
+// already include any tare, and its rate is the slope between the last two
+// samples, standing in for the gyro.
+static struct Attitude replay_attitude = {};
+void IMUTarePitch() {
+    global_debug_values.imu.pitch = 0;
+    replay_attitude.pitch = 0;
+    replay_attitude.pitch_rate = 0;
+}
+uint32_t IMUPredictAttitude(uint32_t t_us, struct Attitude& attitude) {
+    return AttitudePredict(replay_attitude, t_us, IMU_MAX_PREDICT_US, attitude);
+}
+// There are no recorded accelerometer samples
+int IMUReadSamples(uint32_t& cursor, struct IMUSample* out, int max) {
+    return 0;
+}
+void DatalogRecordTick(uint32_t tick_start_us, uint32_t tick_us) {}
+volatile uint32_t imu_read_latency_us = 0;
+volatile uint32_t imu_cpu_us = 0;
+
+struct ReplayEvent {
+    uint32_t t_us;
+    uint8_t source;
+    std::vector<uint8_t> data;
+};
+
+static bool ReadEvents(const char* path, std::vector<ReplayEvent>& events) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open " << path << "\n";
+        return false;
+    }
+    ReplayFileHeader header;
+    in.read((char*)&header, sizeof(header));
+    if (!in || memcmp(header.magic, REPLAY_MAGIC, 4) != 0 || header.version != REPLAY_VERSION) {
+        std::cerr << path << ": not a version " << REPLAY_VERSION << " replay stream\n";
+        return false;
+    }
+    ReplayEventHeader eh;
+    while (in.read((char*)&eh, sizeof(eh))) {
+        ReplayEvent ev;
+        ev.t_us = eh.t_us;
+        ev.source = eh.source;
+        ev.data.resize(eh.len);
+        if (eh.len > 0 && !in.read((char*)ev.data.data(), eh.len)) {
+            std::cerr << path << ": truncated event at t=" << eh.t_us << "us\n";
+            return false;
+        }
+        events.push_back(ev);
+    }
+    std::stable_sort(events.begin(), events.end(),
+        [](const ReplayEvent& a, const ReplayEvent& b) { return a.t_us < b.t_us; });
+    return true;
+}
+
+static void AppendHex(std::string& out, const std::vector<uint8_t>& bytes) {
+    static const char digits[] = "0123456789abcdef";
+    for (uint8_t b : bytes) {
+        out += digits[b >> 4];
+        out += digits[b & 0xF];
+    }
+    if (bytes.empty()) out += '-';
+}
+
+static int Run(int argc, char** argv) {
+    const char* input = NULL;
+    const char* trace_path = NULL;
+    const char* timing_path = NULL;
+    uint32_t tail_ms = 0;
+    bool echo_console = false;
+    for (int i = 0; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "-o" && i + 1 < argc) trace_path = argv[++i];
+        else if (a == "--timing" && i + 1 < argc) timing_path = argv[++i];
+        else if (a == "--tail-ms" && i + 1 < argc) tail_ms = atoi(argv[++i]);
+        else if (a == "--console") echo_console = true;
+        else input = argv[i];
+    }
+    if (input == NULL) {
+        std::cerr << "run: missing input stream\n";
+        return 2;
+    }
+
+    std::vector<ReplayEvent> events;
+    if (!ReadEvents(input, events)) return 1;
+
+    std::ofstream trace_file, timing_file;
+    std::ostream* trace = &std::cout;
+    if (trace_path) {
+        trace_file.open(trace_path);
+        trace = &trace_file;
+    }
+    if (timing_path) {
+        timing_file.open(timing_path);
+        timing_file << "tick,t_us,compute_ns\n";
+    }
+
+    // Same as the start of PositionControlThread
+    GaitParamsCommit();
+
+    // Same wiring as SerialThread
+    HardwareSerial* odrv_serial[4] = {&Serial1, &Serial2, &Serial3, &Serial4};
+    struct ODrive* odrv_values[4] = {&global_debug_values.odrv0, &global_debug_values.odrv1,
+                                     &global_debug_values.odrv2, &global_debug_values.odrv3};
+    struct MsgParams msg_params[4];
+    struct MsgOutput msg_output[4];
+    for (int i = 0; i < 4; i++) {
+        msg_output[i].theta = &odrv_values[i]->est_theta;
+        msg_output[i].gamma = &odrv_values[i]->est_gamma;
+        msg_output[i].receive_timestamp = &odrive_receive_timestamp[i];
+    }
+
+    const uint64_t end_us = (events.empty() ? 0 : events.back().t_us) + (uint64_t)tail_ms * 1000;
+
+    std::vector<double> compute_ns;
+    size_t next_event = 0;
+    uint64_t next_tick_us = 0;
+    host_clock_us = 0;
+
+    for (uint32_t tick = 0; next_tick_us <= end_us; tick++) {
+        // Deliver all input that arrived before this tick, in arrival order. A
+        // STOP or a fired IMU trigger wakes the control thread, so the tick
+        // runs as soon as it is read.
+        host_wakeup_pending = false;
+        while (!host_wakeup_pending && next_event < events.size() && events[next_event].t_us <= next_tick_us) {
+            const ReplayEvent& ev = events[next_event++];
+            host_clock_us = std::max<uint64_t>(host_clock_us, ev.t_us);
+            if (ev.source <= REPLAY_ODRV3_RX) {
+                int n = ev.source - REPLAY_ODRV0_RX;
+                odrv_serial[n]->rx.insert(odrv_serial[n]->rx.end(), ev.data.begin(), ev.data.end());
+                ProcessSerial(*odrv_serial[n], msg_params[n], msg_output[n]);
+            } else if (ev.source == REPLAY_IMU_PITCH && ev.data.size() == sizeof(float)) {
+                memcpy(&global_debug_values.imu.pitch, ev.data.data(), sizeof(float));
+                float pitch = global_debug_values.imu.pitch;
+                if (ev.t_us > replay_attitude.t_us) {
+                    replay_attitude.pitch_rate = (pitch - replay_attitude.pitch) / ((ev.t_us - replay_attitude.t_us) * 1e-6f);
+                }
+                replay_attitude.t_us = ev.t_us;
+                replay_attitude.pitch = pitch;
+                IMUCheckTriggers(replay_attitude);
+            } else if (ev.source == REPLAY_COMMAND) {
+                Serial5.rx.insert(Serial5.rx.end(), ev.data.begin(), ev.data.end());
+                ProcessUSBSerial();
+            }
+        }
+        if (!host_wakeup_pending) {
+            host_clock_us = std::max(host_clock_us, next_tick_us);
+        }
+
+        for (int i = 0; i < 4; i++) odrv_serial[i]->tx.clear();
+        uint64_t tick_start_us = host_clock_us;
+
+        auto t0 = std::chrono::steady_clock::now();
+        ProcessCommandMailbox();
+        StateEstimatorUpdate(tick_start_us);
+        FootForcesUpdate(tick_start_us);
+        ContactUpdate(tick_start_us);
+        PositionControlTick();
+        auto t1 = std::chrono::steady_clock::now();
+        RecordCommandLatency(host_clock_us);
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        compute_ns.push_back(ns);
+
+        std::string line = std::to_string(tick) + " " + std::to_string(tick_start_us) +
+                           " " + std::to_string((int)state);
+        for (int i = 0; i < 4; i++) {
+            line += " ";
+            AppendHex(line, odrv_serial[i]->tx);
+        }
+        *trace << line << "\n";
+        if (timing_path) {
+            timing_file << tick << "," << tick_start_us << "," << (uint64_t)ns << "\n";
+        }
+
+        // Same as ConsoleThread, so queued messages reach the port
+        ProcessConsole();
+        if (echo_console) {
+            for (HardwareSerial* s : {&Serial, &Serial5}) {
+                std::cerr.write((const char*)s->tx.data(), s->tx.size());
+            }
+        }
+        Serial.tx.clear();
+        Serial5.tx.clear();
+
+        // The control thread sleeps one period after the tick returns, or less
+        // to meet a phase boundary, and hop()/reset() may already have
+        // advanced the clock inside the tick
+        next_tick_us = host_clock_us + PositionControlSleepUs(Micros64());
+    }
+
+    if (compute_ns.empty()) return 0;
+    std::vector<double> sorted = compute_ns;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0;
+    for (double v : sorted) sum += v;
+    std::cerr << "ticks: " << sorted.size()
+              << "  compute us mean " << sum / sorted.size() / 1000.0
+              << "  p50 " << sorted[sorted.size() / 2] / 1000.0
+              << "  p99 " << sorted[(sorted.size() * 99) / 100] / 1000.0
+              << "  max " << sorted.back() / 1000.0
+              << "  command latency us max " << command_max_latency_us << "\n";
+    return 0;
+}
+
+// Decode every 'S' (coupled position + gains) frame in a hex dump of the
+// bytes sent to one ODrive. Returns sp_theta, sp_gamma pairs in radians.
+static std::vector<float> DecodeSetpoints(const std::string& hex) {
+    std::vector<uint8_t> b;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        b.push_back((uint8_t)strtol(hex.substr(i, 2).c_str(), NULL, 16));
+    }
+    std::vector<float> sp;
+    for (size_t i = 0; i + 16 <= b.size(); i++) {
+        if (b[i] == 1 && b[i + 1] == 14 && b[i + 2] == 'S') {
+            int16_t th = (int16_t)(b[i + 3] | (b[i + 4] << 8));
+            int16_t ga = (int16_t)(b[i + 9] | (b[i + 10] << 8));
+            sp.push_back(th / 1000.0f);
+            sp.push_back(ga / 1000.0f);
+            i += 15;
+        }
+    }
+    return sp;
+}
+
+static int Compare(const char* a_path, const char* b_path) {
+    std::ifstream a(a_path), b(b_path);
+    if (!a || !b) {
+        std::cerr << "Cannot open traces\n";
+        return 2;
+    }
+    std::string la, lb;
+    uint32_t ticks = 0, diverged = 0;
+    float max_err = 0;
+    bool reported = false;
+    while (true) {
+        bool ga = (bool)std::getline(a, la);
+        bool gb = (bool)std::getline(b, lb);
+        if (!ga || !gb) {
+            if (ga != gb) {
+                std::cout << "Traces differ in length after " << ticks << " ticks\n";
+                diverged++;
+            }
+            break;
+        }
+        ticks++;
+        if (la == lb) continue;
+        diverged++;
+
+        std::istringstream sa(la), sb(lb);
+        std::string tick, t_us, state_a, state_b, tmp;
+        sa >> tick >> t_us >> state_a;
+        sb >> tmp >> tmp >> state_b;
+        for (int port = 0; port < 4; port++) {
+            std::string ha, hb;
+            sa >> ha;
+            sb >> hb;
+            std::vector<float> spa = DecodeSetpoints(ha), spb = DecodeSetpoints(hb);
+            for (size_t i = 0; i < std::min(spa.size(), spb.size()); i++) {
+                max_err = std::max(max_err, fabsf(spa[i] - spb[i]));
+            }
+            if (!reported && ha != hb) {
+                std::cout << "First divergence at tick " << tick << " (t=" << t_us
+                          << "us, state " << state_a << " vs " << state_b << ") odrv" << port << ":\n";
+                std::cout << "  a:";
+                for (float v : spa) std::cout << " " << v;
+                std::cout << "\n  b:";
+                for (float v : spb) std::cout << " " << v;
+                std::cout << "\n";
+                reported = true;
+            }
+        }
+    }
+    std::cout << diverged << " of " << ticks << " ticks differ";
+    if (diverged) std::cout << ", max setpoint difference " << max_err << " rad";
+    std::cout << "\n";
+    return diverged ? 1 : 0;
+}
+
+static int Pack(const char* in_path, const char* out_path) {
+    std::ifstream in(in_path);
+    std::ofstream out(out_path, std::ios::binary);
+    if (!in || !out) {
+        std::cerr << "Cannot open files\n";
+        return 2;
+    }
+    ReplayFileHeader header;
+    memcpy(header.magic, REPLAY_MAGIC, 4);
+    header.version = REPLAY_VERSION;
+    header.reserved = 0;
+    out.write((const char*)&header, sizeof(header));
+
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ls(line);
+        uint32_t t_us;
+        std::string kind;
+        if (!(ls >> t_us >> kind)) {
+            std::cerr << in_path << ":" << line_no << ": expected '<t_us> <source> ...'\n";
+            return 1;
+        }
+        ReplayEventHeader eh;
+        eh.t_us = t_us;
+        std::vector<uint8_t> data;
+        if ((kind.compare(0, 4, "odrv") == 0 && kind.size() == 5 && kind[4] >= '0' && kind[4] <= '3') ||
+            kind == "cmdhex") {
+            eh.source = kind == "cmdhex" ? REPLAY_COMMAND : REPLAY_ODRV0_RX + (kind[4] - '0');
+            std::string hex;
+            ls >> hex;
+            for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+                data.push_back((uint8_t)strtol(hex.substr(i, 2).c_str(), NULL, 16));
+            }
+        } else if (kind == "imu") {
+            eh.source = REPLAY_IMU_PITCH;
+            float pitch = 0;
+            ls >> pitch;
+            data.resize(sizeof(float));
+            memcpy(data.data(), &pitch, sizeof(float));
+        } else if (kind == "cmd") {
+            eh.source = REPLAY_COMMAND;
+            std::string text;
+            std::getline(ls, text);
+            size_t first = text.find_first_not_of(' ');
+            text = first == std::string::npos ? "" : text.substr(first);
+            if (text.empty() || (text.back() != ';' && text.back() != '\n')) text += ';';
+            data.assign(text.begin(), text.end());
+        } else {
+            std::cerr << in_path << ":" << line_no << ": unknown source '" << kind << "'\n";
+            return 1;
+        }
+        // Events longer than 255 bytes are split
+        for (size_t off = 0; off < data.size() || off == 0; off += 255) {
+            size_t n = std::min<size_t>(255, data.size() - off);
+            eh.len = (uint8_t)n;
+            out.write((const char*)&eh, sizeof(eh));
+            out.write((const char*)data.data() + off, n);
+            if (data.empty()) break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Host version of GaitBenchmark: wall clock instead of cycle counts, and many
+ * more ticks so the timer resolution doesn't matter.
+ */
+static int GaitBench(int ticks) {
+    using Clock = std::chrono::steady_clock;
+    int failures = 0;
+    for (int k = 0; k < num_gait_patterns; k++) {
+        const struct GaitPattern& e = gait_patterns[k];
+        if (e.kernel == NULL) {
+            continue;
+        }
+        struct GaitParams params;
+        struct LegGain gains;
+        GaitParamsRead(e.state, params, gains);
+
+        Clock::duration per_leg_time{0}, generic_time{0}, kernel_time{0};
+        int mismatches = 0;
+        for (int i = 0; i < ticks; i++) {
+            float t = (float)i / POSITION_CONTROL_FREQ;
+            float theta0[4], gamma0[4], theta1[4], gamma1[4], theta2[4], gamma2[4];
+            auto t0 = Clock::now();
+            GaitSetpointsPerLeg(e.gait, params, t, theta0, gamma0);
+            auto t1 = Clock::now();
+            GaitSetpointsGeneric(e.gait, e.gait.offset, params, t, theta1, gamma1);
+            auto t2 = Clock::now();
+            e.kernel(params, t, theta2, gamma2);
+            auto t3 = Clock::now();
+            per_leg_time += t1 - t0;
+            generic_time += t2 - t1;
+            kernel_time += t3 - t2;
+            for (int j = 0; j < 4; j++) {
+                mismatches += theta0[j] != theta1[j] || gamma0[j] != gamma1[j];
+                mismatches += theta0[j] != theta2[j] || gamma0[j] != gamma2[j];
+            }
+        }
+        double per_leg_ns = std::chrono::duration<double, std::nano>(per_leg_time).count() / ticks;
+        double generic_ns = std::chrono::duration<double, std::nano>(generic_time).count() / ticks;
+        double kernel_ns = std::chrono::duration<double, std::nano>(kernel_time).count() / ticks;
+        std::cout << e.name << ": per-leg " << per_leg_ns << " ns, generic " << generic_ns << " ns, kernel "
+                  << kernel_ns << " ns per tick" << (mismatches > 0 ? ", SETPOINTS DIFFER" : "") << "\n";
+        failures += mismatches > 0;
+    }
+    return failures > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "run") return Run(argc - 2, argv + 2);
+    if (mode == "compare" && argc == 4) return Compare(argv[2], argv[3]);
+    if (mode == "pack" && argc == 4) return Pack(argv[2], argv[3]);
+    if (mode == "gaitbench" && argc <= 3) return GaitBench(argc == 3 ? atoi(argv[2]) : 100000);
+    std::cerr << "usage: replay run <input.dgrp> [-o trace.txt] [--timing ticks.csv] [--tail-ms N] [--console]\n"
+                 "       replay compare <a.trace> <b.trace>\n"
+                 "       replay pack <input.txt> <output.dgrp>\n"
+                 "       replay gaitbench [ticks]\n";
+    return 2;
+}
@@ -0,0 +1,41 @@
+#ifndef REPLAY_FORMAT_H
+#define REPLAY_FORMAT_H
+
+#include <stdint.h>
+
+// Replay stream file layout (little endian):
+//
+//   ReplayFileHeader
+//   { ReplayEventHeader, uint8_t data[len] } repeated, sorted by t_us
+//
+// Each event is one chunk of input exactly as the Teensy saw it: raw bytes
+// from an ODrive UART, raw bytes from the USB/XBee command port, or one IMU
+// pitch sample (a 4 byte float, the value stored to global_debug_values).
+
+const char REPLAY_MAGIC[4] = {'D', 'G', 'R', 'P'};
+const uint16_t REPLAY_VERSION = 1;
+
+enum ReplaySource {
+    REPLAY_ODRV0_RX = 0,
+    REPLAY_ODRV1_RX = 1,
+    REPLAY_ODRV2_RX = 2,
+    REPLAY_ODRV3_RX = 3,
+    REPLAY_IMU_PITCH = 4,
+    REPLAY_COMMAND = 5
+};
+
+#pragma pack(push, 1)
+struct ReplayFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+};
+
+struct ReplayEventHeader {
+    uint32_t t_us; // Arrival time since start of recording (us)
+    uint8_t source; // ReplaySource
+    uint8_t len; // Number of data bytes that follow
+};
+#pragma pack(pop)
+
+#endif
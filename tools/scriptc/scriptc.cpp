@@ -0,0 +1,149 @@
+// Compiles a text motion script into the COMMAND_KEYFRAME frames that upload
+// it to the robot (keyframe format described in src/script_format.h). Send
+// 'X' afterwards to run it.
+//
+// Build from the repository root, from the same revision as the firmware:
+//   g++ -std=c++14 -O2 -Isrc tools/scriptc/scriptc.cpp -o scriptc
+//
+// Usage:
+//   scriptc <script.txt> > /dev/ttyUSB0        binary frames, port set up with stty raw
+//   scriptc <script.txt> --replay <t_us>       "cmdhex" lines for a replay pack
+//                                              (tools/replay), 1ms apart from t_us
+//
+// One keyframe per line, '#' starts a comment:
+//   <until> <ms> [<guard deg>] <legs> xy <x mm> <y mm> <kp_t> <kd_t> <kp_g> <kd_g> [flags]
+//   <until> <ms> [<guard deg>] <legs> tg <theta deg> <gamma deg> <kp_t> <kd_t> <kp_g> <kd_g> [flags]
+// <until> is "time", or "above"/"below" followed by a pitch in degrees; for
+// those <ms> is the timeout after which the robot stops. <legs> lists the
+// legs the keyframe moves by ODrive number, eg 0123 or 03. Flags are "ramp",
+// "pitch" and "-pitch". The SCRIPT_END keyframe is added after the last line.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "command_format.h"
+#include "script_format.h"
+
+static bool ToInt16(double v, int16_t& out) {
+    v = std::round(v);
+    if (v < INT16_MIN + 1 || v > INT16_MAX) return false;
+    out = (int16_t)v;
+    return true;
+}
+
+/**
+ * Parse one script line into a keyframe.
+ * @return Error message, or empty on success
+ */
+static std::string ParseLine(const std::string& line, ScriptKeyframe& k) {
+    std::istringstream in(line);
+    std::string until, legs, mode;
+    double ms, a, b, kp_t, kd_t, kp_g, kd_g;
+    memset(&k, 0, sizeof(k));
+
+    in >> until >> ms;
+    if (until == "time") {
+        k.op = SCRIPT_UNTIL_TIME;
+    } else if (until == "above" || until == "below") {
+        k.op = until == "above" ? SCRIPT_UNTIL_PITCH_ABOVE : SCRIPT_UNTIL_PITCH_BELOW;
+        double guard_deg;
+        if (!(in >> guard_deg) || !ToInt16(guard_deg * M_PI / 180.0 * 1000.0, k.guard)) {
+            return "bad pitch guard";
+        }
+    } else {
+        return "expected time, above or below";
+    }
+    if (!in || ms < 0 || ms > UINT16_MAX) return "bad duration";
+    k.duration_ms = (uint16_t)ms;
+
+    if (!(in >> legs)) return "missing legs";
+    for (char c : legs) {
+        if (c < '0' || c > '3') return "legs must be ODrive numbers 0-3";
+        k.legs |= 1 << (c - '0');
+    }
+
+    if (!(in >> mode >> a >> b >> kp_t >> kd_t >> kp_g >> kd_g)) return "missing target or gains";
+    bool ok;
+    if (mode == "xy") {
+        k.flags |= SCRIPT_FLAG_CARTESIAN;
+        ok = ToInt16(a * 10, k.a) && ToInt16(b * 10, k.b);
+    } else if (mode == "tg") {
+        ok = ToInt16(a * M_PI / 180.0 * 1000.0, k.a) && ToInt16(b * M_PI / 180.0 * 1000.0, k.b);
+    } else {
+        return "expected xy or tg";
+    }
+    if (!ok) return "target out of range";
+    if (!ToInt16(kp_t * 100, k.kp_theta) || !ToInt16(kd_t * 100, k.kd_theta) ||
+        !ToInt16(kp_g * 100, k.kp_gamma) || !ToInt16(kd_g * 100, k.kd_gamma)) {
+        return "gain out of range";
+    }
+
+    std::string flag;
+    while (in >> flag) {
+        if (flag == "ramp") k.flags |= SCRIPT_FLAG_RAMP;
+        else if (flag == "pitch") k.flags |= SCRIPT_FLAG_PITCH;
+        else if (flag == "-pitch") k.flags |= SCRIPT_FLAG_NEG_PITCH;
+        else return "unknown flag " + flag;
+    }
+    return "";
+}
+
+int main(int argc, char** argv) {
+    const char* path = NULL;
+    long replay_t_us = -1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replay_t_us = atol(argv[++i]);
+        else path = argv[i];
+    }
+    if (path == NULL) {
+        std::cerr << "usage: scriptc <script.txt> [--replay <t_us>]\n";
+        return 2;
+    }
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open " << path << "\n";
+        return 1;
+    }
+
+    std::vector<ScriptKeyframe> keyframes;
+    std::string line;
+    for (int line_no = 1; std::getline(in, line); line_no++) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        ScriptKeyframe k;
+        std::string err = ParseLine(line, k);
+        if (!err.empty()) {
+            std::cerr << path << ":" << line_no << ": " << err << "\n";
+            return 1;
+        }
+        keyframes.push_back(k);
+    }
+    keyframes.push_back(ScriptKeyframe()); // SCRIPT_END
+    if (keyframes.size() > 255) {
+        std::cerr << "Too many keyframes\n";
+        return 1;
+    }
+
+    for (size_t i = 0; i < keyframes.size(); i++) {
+        CommandKeyframe cmd;
+        cmd.index = (uint8_t)i;
+        cmd.keyframe = keyframes[i];
+        uint8_t frame[COMMAND_MAX_PAYLOAD + 3];
+        size_t len = CommandEncode(COMMAND_KEYFRAME, (uint8_t)i, &cmd, sizeof(cmd), frame);
+        if (replay_t_us >= 0) {
+            printf("%ld cmdhex ", replay_t_us + (long)i * 1000);
+            for (size_t j = 0; j < len; j++) printf("%02x", frame[j]);
+            printf("\n");
+        } else {
+            fwrite(frame, 1, len, stdout);
+        }
+    }
+    return 0;
+}
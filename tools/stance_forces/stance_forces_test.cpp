@@ -0,0 +1,284 @@
+// Host check of the stance force solver in src/stance_forces.h.
+//
+// Compares StanceForceSolve with the closed form least squares solution where
+// no limit is reached, and with a long cold solve where the friction cones and
+// current limits bind. Checks that no solution leaves its limits, and that
+// warm starts keep up with a wrench that changes every tick. Then times one
+// solve for two and four legs at the firmware's iteration count.
+//
+// Build from the repository root, from the same revision as the firmware:
+//   g++ -std=c++14 -O2 -Isrc -Itools/common tools/stance_forces/stance_forces_test.cpp src/stance_forces.cpp src/kinematics.cpp -o stance_forces_test
+//
+// Usage:
+//   stance_forces_test
+// Prints the worst error of every check and the time per solve, and exits
+// with 1 if a check is outside its limit.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "stance_forces.h"
+#include "check.h"
+
+// Same as src/config.h
+static const struct StanceForceParams params = {0.6f, 2.0f, 1.0f, 100.0f, 1.0f, 20};
+static const float GRAVITY = 9.81f;
+static const float ROBOT_MASS = 4.8f;
+
+static float Uniform(float lo, float hi) {
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+// Stance feet around the hips at +-0.2m, 0.1 to 0.25m below the body. Legs
+// 0 and 3 are at the front, as odrv0 and odrv3 are, so 0, 2 and 1, 3 are the
+// trot's diagonal pairs.
+template <int N>
+static void RandomFeet(struct StanceForceSolver<N>& s, float max_vertical) {
+    for (int i = 0; i < N; i++) {
+        float hip = (i == 0 || i == 3) ? 0.2f : -0.2f;
+        s.foot_x[i] = hip + Uniform(-0.08f, 0.08f);
+        s.foot_z[i] = -Uniform(0.1f, 0.25f);
+        s.max_vertical[i] = max_vertical;
+    }
+}
+
+// The desired force split evenly over the feet that can push
+template <int N>
+static void Share(const struct StanceForceSolver<N>& s, const struct BodyWrench& d,
+                  double& share_x, double& share_z) {
+    int feet = 0;
+    for (int i = 0; i < N; i++) feet += s.max_vertical[i] > 0;
+    share_x = feet > 0 ? (double)d.fx / feet : 0;
+    share_z = feet > 0 ? (double)d.fz / feet : 0;
+}
+
+// Solves M y = v by Cramer's rule
+static void Solve3(const double M[3][3], const double v[3], double y[3]) {
+    double det = M[0][0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1])
+               - M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0])
+               + M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0]);
+    for (int c = 0; c < 3; c++) {
+        double T[3][3];
+        for (int r = 0; r < 3; r++)
+            for (int k = 0; k < 3; k++) T[r][k] = (k == c) ? v[r] : M[r][k];
+        y[c] = (T[0][0] * (T[1][1] * T[2][2] - T[1][2] * T[2][1])
+              - T[0][1] * (T[1][0] * T[2][2] - T[1][2] * T[2][0])
+              + T[0][2] * (T[1][0] * T[2][1] - T[1][1] * T[2][0])) / det;
+    }
+}
+
+// Splits dx, dz over the feet that can push into the part A sees,
+// A^T (A A^T)^-1 A d, and returns the rest in px, pz. In double, straight
+// from the definition.
+template <int N>
+static void NullPart(const struct StanceForceSolver<N>& s, const double dx[N], const double dz[N],
+                     double px[N], double pz[N]) {
+    double M[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}}, u[3] = {0, 0, 0};
+    for (int i = 0; i < N; i++) {
+        if (s.max_vertical[i] <= 0) continue;
+        double ax[3] = {1, 0, -s.foot_z[i]}, az[3] = {0, 1, s.foot_x[i]};
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) M[r][c] += ax[r] * ax[c] + az[r] * az[c];
+            u[r] += ax[r] * dx[i] + az[r] * dz[i];
+        }
+    }
+    double v[3];
+    Solve3(M, u, v);
+    for (int i = 0; i < N; i++) {
+        px[i] = pz[i] = 0;
+        if (s.max_vertical[i] <= 0) continue;
+        px[i] = dx[i] - (v[0] - s.foot_z[i] * v[2]);
+        pz[i] = dz[i] - (v[1] + s.foot_x[i] * v[2]);
+    }
+}
+
+template <int N>
+static double Cost(const struct StanceForceSolver<N>& s, const struct BodyWrench& d,
+                   const struct StanceForceParams& p) {
+    double share_x, share_z;
+    Share(s, d, share_x, share_z);
+    double fx = 0, fz = 0, t = 0, dx[N], dz[N], px[N], pz[N];
+    for (int i = 0; i < N; i++) {
+        fx += s.rx[i];
+        fz += s.rz[i];
+        t += (double)s.foot_x[i] * s.rz[i] - (double)s.foot_z[i] * s.rx[i];
+        dx[i] = s.rx[i] - share_x;
+        dz[i] = s.rz[i] - share_z;
+    }
+    NullPart(s, dx, dz, px, pz);
+    double norm = 0;
+    for (int i = 0; i < N; i++) norm += px[i] * px[i] + pz[i] * pz[i];
+    return 0.5 * (p.force_weight * ((fx - d.fx) * (fx - d.fx) + (fz - d.fz) * (fz - d.fz))
+                  + p.torque_weight * (t - d.torque) * (t - d.torque) + p.regularization * norm);
+}
+
+// Worst violation of the friction cone and force limits (N)
+template <int N>
+static double Violation(const struct StanceForceSolver<N>& s, const struct StanceForceParams& p) {
+    double worst = 0;
+    for (int i = 0; i < N; i++) {
+        double lo = fmin(p.min_vertical, s.max_vertical[i]);
+        worst = fmax(worst, fabs(s.rx[i]) - p.friction * s.rz[i]);
+        worst = fmax(worst, lo - s.rz[i]);
+        worst = fmax(worst, s.rz[i] - s.max_vertical[i]);
+    }
+    return worst;
+}
+
+// Unconstrained optimum, every foot pushing: the wrench exactly, with the
+// smallest change from the even share, r = share + A^T (A A^T)^-1 (b - A share)
+template <int N>
+static void ClosedForm(const struct StanceForceSolver<N>& s, const struct BodyWrench& d,
+                       double rx[N], double rz[N]) {
+    double share_x, share_z;
+    Share(s, d, share_x, share_z);
+    double M[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+    double b[3] = {d.fx - N * share_x, d.fz - N * share_z, d.torque};
+    for (int i = 0; i < N; i++) {
+        double ax[3] = {1, 0, -s.foot_z[i]}, az[3] = {0, 1, s.foot_x[i]};
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 3; c++) M[r][c] += ax[r] * ax[c] + az[r] * az[c];
+        b[2] -= s.foot_x[i] * share_z - s.foot_z[i] * share_x;
+    }
+    double y[3];
+    Solve3(M, b, y);
+    for (int i = 0; i < N; i++) {
+        rx[i] = share_x + y[0] - s.foot_z[i] * y[2];
+        rz[i] = share_z + y[1] + s.foot_x[i] * y[2];
+    }
+}
+
+template <int N>
+static void RunChecks(const char* name) {
+    printf("-- %d legs (%s)\n", N, name);
+    const int cases = 2000;
+    double interior_err = 0, gap = 0, mean_gap = 0, violation = 0;
+    for (int c = 0; c < cases; c++) {
+        // Within the limits: the weight and a small torque, loose force limits
+        struct StanceForceSolver<N> s;
+        RandomFeet(s, 200.0f);
+        StanceForceReset(s);
+        struct BodyWrench d = {Uniform(-2, 2), ROBOT_MASS * GRAVITY, Uniform(-1, 1)};
+        struct StanceForceParams p = params;
+        p.iterations = 500;
+        StanceForceSolve(s, d, p);
+        double rx[N], rz[N];
+        ClosedForm(s, d, rx, rz);
+        bool inside = true;
+        for (int i = 0; i < N; i++) {
+            inside = inside && fabs(rx[i]) < p.friction * rz[i] && rz[i] > p.min_vertical;
+        }
+        if (inside) {
+            for (int i = 0; i < N; i++) {
+                interior_err = fmax(interior_err, fmax(fabs(s.rx[i] - rx[i]), fabs(s.rz[i] - rz[i])));
+            }
+        }
+
+        // Limits that bind: tight force limits, sideways forces beyond
+        // friction and torques beyond what the feet can give. The firmware's
+        // iteration count from a cold start, against a long solve. On the
+        // robot only a foot that just touched down starts cold.
+        struct StanceForceSolver<N> t;
+        RandomFeet(t, 0);
+        for (int i = 0; i < N; i++) t.max_vertical[i] = Uniform(5, 40);
+        if (N > 2) t.max_vertical[rand() % N] = 0;
+        StanceForceReset(t);
+        struct BodyWrench hard = {Uniform(-30, 30), Uniform(20, 80), Uniform(-8, 8)};
+        StanceForceSolve(t, hard, params);
+        violation = fmax(violation, Violation(t, params));
+        struct StanceForceSolver<N> ref = t;
+        StanceForceReset(ref);
+        struct StanceForceParams long_params = params;
+        long_params.iterations = 20000;
+        StanceForceSolve(ref, hard, long_params);
+        // As the force error that costs the same
+        double extra = sqrt(2 * fmax(0, Cost(t, hard, params) - Cost(ref, hard, params)));
+        gap = fmax(gap, extra);
+        mean_gap += extra / cases;
+    }
+    Check("interior vs closed form (N)", interior_err, 1e-3);
+    Check("bound, cold: extra error (N)", gap, 2.5);
+    Check("bound, cold: mean extra (N)", mean_gap, 0.25);
+    Check("limits violated by (N)", violation, 1e-4);
+
+    // A trot-like run: the stance pair swaps every 150 ticks and the pitch
+    // torque swings. Warm starts should stay close to the long solve.
+    struct StanceForceSolver<N> s;
+    RandomFeet(s, 60.0f);
+    StanceForceReset(s);
+    double tracking_gap = 0, torque_lost = 0;
+    for (int tick = 0; tick < 3000; tick++) {
+        for (int i = 0; i < N; i++) {
+            bool stance = N <= 2 || (i + tick / 150) % 2 == 0;
+            s.max_vertical[i] = stance ? 60.0f : 0;
+        }
+        struct BodyWrench d = {0, ROBOT_MASS * GRAVITY, 3.0f * sinf(tick * 0.05f)};
+        StanceForceSolve(s, d, params);
+        violation = fmax(violation, Violation(s, params));
+        if (tick % 150 < 5) continue;  // Settling after a swap
+        if (fabs(d.torque) > 1) {
+            torque_lost = fmax(torque_lost, 1 - s.achieved.torque / d.torque);
+        }
+        struct StanceForceSolver<N> ref = s;
+        StanceForceReset(ref);
+        struct StanceForceParams long_params = params;
+        long_params.iterations = 20000;
+        StanceForceSolve(ref, d, long_params);
+        tracking_gap = fmax(tracking_gap, sqrt(2 * fmax(0, Cost(s, d, params) - Cost(ref, d, params))));
+    }
+    Check("warm tracking: extra error (N)", tracking_gap, 0.05);
+    Check("warm tracking: torque given up", torque_lost, 0.01);
+}
+
+template <int N>
+static void Benchmark() {
+    const int solves = 200000;
+    struct StanceForceSolver<N> s;
+    RandomFeet(s, 60.0f);
+    StanceForceReset(s);
+    volatile float sink = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int k = 0; k < solves; k++) {
+        struct BodyWrench d = {0, ROBOT_MASS * GRAVITY, 3.0f * sinf(k * 0.05f)};
+        StanceForceSolve(s, d, params);
+        sink += s.rz[0];
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / solves;
+    printf("%d legs, %d iterations: %.0f ns per solve\n", N, params.iterations, ns);
+}
+
+int main() {
+    srand(1);
+
+    // Projection onto one foot's limits
+    double proj_err = 0;
+    for (int k = 0; k < 100000; k++) {
+        float rx = Uniform(-50, 50), rz = Uniform(-20, 60);
+        float lo = 2, hi = Uniform(0, 40);
+        float px = rx, pz = rz;
+        ProjectFrictionTrapezoid(px, pz, 0.6f, lo, hi);
+        // Nothing on a grid over the limits may be closer
+        double d = hypot(px - rx, pz - rz);
+        if (hi <= 0) continue;
+        double l = fmin(lo, hi);
+        for (int a = 0; a <= 40; a++) {
+            double gz = l + (hi - l) * a / 40.0;
+            for (int b = -20; b <= 20; b++) {
+                double gx = 0.6 * gz * b / 20.0;
+                proj_err = fmax(proj_err, d - hypot(gx - rx, gz - rz));
+            }
+        }
+    }
+    Check("projection not nearest by (N)", proj_err, 1e-4);
+
+    RunChecks<2>("bound, one pair per end");
+    RunChecks<4>("trot and stand");
+
+    Benchmark<2>();
+    Benchmark<4>();
+
+    return failures > 0 ? 1 : 0;
+}
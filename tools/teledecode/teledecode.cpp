@@ -0,0 +1,175 @@
+// Host decoder for the binary telemetry stream sent by PrintDebugThread
+// (frame format described in src/telemetry_format.h, channels in
+// src/telemetry_channels.h).
+//
+// Reads the raw serial stream, prints one tab separated line per valid frame
+// to stdout and passes any console text found between frames through to
+// stderr, so it can sit directly on the XBee port:
+//   stty -F /dev/ttyUSB0 115200 raw && teledecode < /dev/ttyUSB0
+//
+// Build from the repository root, from the same revision as the firmware:
+//   g++ -std=c++14 -O2 -Isrc tools/teledecode/teledecode.cpp -o teledecode
+//
+// Usage:
+//   teledecode [capture.bin] [--stats]
+// With no file the stream is read from stdin. Columns are t_us followed by
+// every telemetry channel; channels not in a frame (unsubscribed or decimated)
+// are left empty. Acks to binary host commands go to stderr with the console
+// text. --stats prints frame, CRC error and lost frame counts and the frame
+// rate to stderr at the end.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "telemetry_format.h"
+#include "telemetry_channels.h"
+#include "command_format.h"
+
+struct Stats {
+    unsigned long frames = 0;
+    unsigned long crc_errors = 0;
+    unsigned long lost = 0;
+    uint32_t first_t_us = 0;
+    uint32_t last_t_us = 0;
+    int last_seq = -1;
+};
+
+struct Channel {
+    const char* name;
+    float scale;
+};
+
+#define X(name, expr, scale) {name, scale},
+static const Channel kChannels[] = { TELEMETRY_CHANNELS(X) };
+#undef X
+static const int kChannelCount = sizeof(kChannels) / sizeof(kChannels[0]);
+
+/**
+ * Try to decode one chunk found between 0x00 delimiters as a frame.
+ * @return false if the chunk is not a frame, in which case it is console text
+ */
+static bool HandleChunk(std::vector<uint8_t>& chunk, Stats& stats) {
+    const size_t min_len = sizeof(TelemetryHeader) + 2;
+    if (chunk.size() < min_len || chunk.size() > TELEMETRY_WIRE_SIZE(TELEMETRY_MAX_FRAME) - 2) return false;
+    std::vector<uint8_t> buf(chunk);
+    size_t len = TelemetryCobsDecode(buf.data(), buf.size());
+    if (len < min_len) return false;
+
+    // Console text almost never passes the CRC, so a bad CRC on something that
+    // doesn't even have a known frame type is most likely text
+    uint16_t crc;
+    memcpy(&crc, buf.data() + len - 2, 2);
+    TelemetryHeader header;
+    memcpy(&header, buf.data(), sizeof(header));
+    bool known_type = header.type == TELEMETRY_CHANNELS || header.type == TELEMETRY_ACK ||
+                      header.type == TELEMETRY_TRAJECTORY_ACK;
+    if (crc != TelemetryCrc16(buf.data(), len - 2)) {
+        if (!known_type) return false;
+        stats.crc_errors++;
+        return true;
+    }
+    if (!known_type) return true;
+
+    if (stats.last_seq >= 0) {
+        stats.lost += (uint8_t)(header.seq - stats.last_seq - 1);
+    } else {
+        stats.first_t_us = header.t_us;
+    }
+    stats.last_seq = header.seq;
+    stats.last_t_us = header.t_us;
+    stats.frames++;
+
+    const uint8_t* payload = buf.data() + sizeof(header);
+    size_t payload_len = len - sizeof(header) - 2;
+
+    static const char* status_names[] = {"ok", "rejected", "bad checksum", "bad format"};
+    if (header.type == TELEMETRY_ACK) {
+        TelemetryAckPayload ack;
+        if (payload_len != sizeof(ack)) return true;
+        memcpy(&ack, payload, sizeof(ack));
+        fprintf(stderr, "ack %u: '%c' seq %u %s\n", header.t_us, ack.command, ack.seq,
+                ack.status <= COMMAND_BAD_FORMAT ? status_names[ack.status] : "?");
+        return true;
+    }
+    if (header.type == TELEMETRY_TRAJECTORY_ACK) {
+        TelemetryTrajectoryAckPayload ack;
+        if (payload_len != sizeof(ack)) return true;
+        memcpy(&ack, payload, sizeof(ack));
+        fprintf(stderr, "ack %u: 'Q' seq %u %s, %u free, playing %ums, %u underruns\n",
+                header.t_us, ack.seq, ack.status <= COMMAND_BAD_FORMAT ? status_names[ack.status] : "?",
+                ack.free, ack.play_t_ms, ack.underruns);
+        return true;
+    }
+
+    uint32_t mask;
+    if (payload_len < sizeof(mask)) return true;
+    memcpy(&mask, payload, sizeof(mask));
+    size_t off = sizeof(mask);
+    if (off + 2 * __builtin_popcount(mask) != payload_len) return true;
+
+    printf("%u", header.t_us);
+    for (int i = 0; i < kChannelCount; i++) {
+        if ((mask & (1UL << i)) == 0) {
+            printf("\t");
+            continue;
+        }
+        int16_t q;
+        memcpy(&q, payload + off, sizeof(q));
+        off += sizeof(q);
+        if (q == TELEMETRY_NAN) {
+            printf("\tnan");
+        } else if (kChannels[i].scale == 1) {
+            printf("\t%d", q);
+        } else {
+            printf("\t%g", q / (double)kChannels[i].scale);
+        }
+    }
+    printf("\n");
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* path = NULL;
+    bool print_stats = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) print_stats = true;
+        else path = argv[i];
+    }
+
+    FILE* in = path ? fopen(path, "rb") : stdin;
+    if (in == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+
+    printf("t_us");
+    for (const Channel& c : kChannels) printf("\t%s", c.name);
+    printf("\n");
+
+    Stats stats;
+    std::vector<uint8_t> chunk;
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        if (c != 0) {
+            chunk.push_back((uint8_t)c);
+            continue;
+        }
+        if (!chunk.empty() && !HandleChunk(chunk, stats)) {
+            fwrite(chunk.data(), 1, chunk.size(), stderr);
+        }
+        chunk.clear();
+        fflush(stdout);
+    }
+    if (!chunk.empty()) fwrite(chunk.data(), 1, chunk.size(), stderr);
+
+    if (print_stats) {
+        double s = (uint32_t)(stats.last_t_us - stats.first_t_us) / 1e6;
+        fprintf(stderr, "%lu frames, %lu CRC errors, %lu lost, %.1f frames/s\n",
+                stats.frames, stats.crc_errors, stats.lost,
+                s > 0 ? (stats.frames - 1) / s : 0.0);
+    }
+    if (in != stdin) fclose(in);
+    return 0;
+}
@@ -0,0 +1,268 @@
+// Streams a trajectory computed offline to the robot's trajectory buffer and
+// starts playback ('Q'), with flow control from the TELEMETRY_TRAJECTORY_ACK
+// frames (see src/command_format.h and src/telemetry_format.h).
+//
+// Build from the repository root, from the same revision as the firmware:
+//   g++ -std=c++14 -O2 -Isrc tools/trajstream/trajstream.cpp -o trajstream
+//
+// Usage:
+//   trajstream <traj.csv> <port> [--baud N] [--prefill N] [--ack-every N]
+//   trajstream <traj.csv> --replay <t_us> [--rate N] [--prefill N]
+// The CSV has one row per point: t_ms, then theta and gamma in radians for
+// ODrives 0 to 3, as sent to them. Rows that don't start with a number are
+// skipped and times are taken relative to the first row.
+//
+// Playback starts once --prefill points (default 50) are buffered. Every
+// --ack-every'th point (default 8) asks for an ack, which reports the free
+// space in the buffer; points are only sent while the last reported space
+// covers them. Once a second the send rate, link throughput, buffer fill and
+// playback time are printed to stderr, along with any console text. The
+// program exits once the robot has buffered the last point.
+//
+// With --replay the frames are written as "cmdhex" lines for a replay pack
+// (tools/replay) instead, --rate points per second (default 200) from t_us,
+// with no flow control.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "command_format.h"
+#include "telemetry_format.h"
+
+static bool ReadTrajectory(const char* path, std::vector<CommandTrajectoryPoint>& points) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open " << path << "\n";
+        return false;
+    }
+    std::string line;
+    double t0 = NAN;
+    for (int line_no = 1; std::getline(in, line); line_no++) {
+        size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || !(isdigit(line[first]) || line[first] == '-' || line[first] == '.')) {
+            continue;
+        }
+        for (char& c : line) {
+            if (c == ',') c = ' ';
+        }
+        std::istringstream row(line);
+        double t, v[8];
+        row >> t;
+        for (double& x : v) row >> x;
+        if (!row) {
+            std::cerr << path << ":" << line_no << ": expected t_ms and 8 joint angles\n";
+            return false;
+        }
+        if (std::isnan(t0)) t0 = t;
+
+        CommandTrajectoryPoint p;
+        memset(&p, 0, sizeof(p));
+        p.t_ms = (uint32_t)std::lround(t - t0);
+        for (int i = 0; i < 4; i++) {
+            p.theta[i] = (int16_t)std::lround(v[2 * i] * 1000);
+            p.gamma[i] = (int16_t)std::lround(v[2 * i + 1] * 1000);
+        }
+        if (!points.empty() && p.t_ms <= points.back().t_ms) {
+            std::cerr << path << ":" << line_no << ": times must increase by at least 1ms\n";
+            return false;
+        }
+        points.push_back(p);
+    }
+    if (points.empty()) {
+        std::cerr << path << ": no points\n";
+        return false;
+    }
+    points.back().flags |= COMMAND_TRAJECTORY_LAST;
+    return true;
+}
+
+static int OpenPort(const char* path, int baud) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) return -1;
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) return -1;
+    cfmakeraw(&tio);
+    speed_t speed = baud == 57600 ? B57600 : baud == 230400 ? B230400 :
+                    baud == 460800 ? B460800 : B115200;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) return -1;
+    return fd;
+}
+
+static bool WriteAll(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* csv = NULL;
+    const char* port = NULL;
+    int baud = 115200, prefill = 50, ack_every = 8, rate = 200;
+    long replay_t_us = -1;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "--baud" && i + 1 < argc) baud = atoi(argv[++i]);
+        else if (a == "--prefill" && i + 1 < argc) prefill = atoi(argv[++i]);
+        else if (a == "--ack-every" && i + 1 < argc) ack_every = std::max(1, atoi(argv[++i]));
+        else if (a == "--rate" && i + 1 < argc) rate = std::max(1, atoi(argv[++i]));
+        else if (a == "--replay" && i + 1 < argc) replay_t_us = atol(argv[++i]);
+        else if (!csv) csv = argv[i];
+        else port = argv[i];
+    }
+    if (csv == NULL || (port == NULL && replay_t_us < 0)) {
+        std::cerr << "usage: trajstream <traj.csv> <port> [--baud N] [--prefill N] [--ack-every N]\n"
+                     "       trajstream <traj.csv> --replay <t_us> [--rate N] [--prefill N]\n";
+        return 2;
+    }
+
+    std::vector<CommandTrajectoryPoint> points;
+    if (!ReadTrajectory(csv, points)) return 1;
+    const size_t n = points.size();
+    prefill = std::min<int>(prefill, n);
+
+    if (replay_t_us >= 0) {
+        for (size_t i = 0; i < n; i++) {
+            uint8_t frame[COMMAND_MAX_PAYLOAD + 3];
+            size_t len = CommandEncode(COMMAND_TRAJECTORY | COMMAND_NO_ACK, (uint8_t)i,
+                                       &points[i], sizeof(points[i]), frame);
+            long t = replay_t_us + (long)(i * 1000000 / rate);
+            printf("%ld cmdhex ", t);
+            for (size_t j = 0; j < len; j++) printf("%02x", frame[j]);
+            printf("\n");
+            if ((int)i + 1 == prefill) printf("%ld cmd Q\n", t);
+        }
+        return 0;
+    }
+
+    int fd = OpenPort(port, baud);
+    if (fd < 0) {
+        std::cerr << "Cannot open " << port << "\n";
+        return 1;
+    }
+
+    // Flow control: every frame gets the next seq, and confirmed[seq] is the
+    // number of points the robot has taken once it has processed that frame.
+    // An ack reporting free space F for seq s means points up to
+    // confirmed[s] + F can be sent. Nothing but point 0 goes out before the
+    // first ack. When the window is shut and no ack is on its way, an empty
+    // frame asks for the buffer state.
+    uint32_t confirmed[256] = {0};
+    uint8_t seq = 0;
+    size_t sent = 0, window_end = 1, done = 0;
+    int acks_pending = 0;
+    bool started = false;
+    uint32_t play_t_ms = 0;
+    uint16_t underruns = 0;
+    int free = 0, min_free = INT32_MAX;
+
+    auto start = std::chrono::steady_clock::now();
+    auto last_report = start, last_ack = start;
+    size_t report_sent = 0, report_bytes = 0, bytes = 0;
+    std::vector<uint8_t> chunk;
+
+    while (done < n) {
+        auto now = std::chrono::steady_clock::now();
+        while (sent < n && sent < window_end && sent - done < 255) {
+            bool ack = sent % ack_every == 0 || sent + 1 == n || sent + 1 == window_end;
+            uint8_t frame[COMMAND_MAX_PAYLOAD + 3];
+            size_t len = CommandEncode(ack ? COMMAND_TRAJECTORY : COMMAND_TRAJECTORY | COMMAND_NO_ACK,
+                                       seq, &points[sent], sizeof(points[sent]), frame);
+            if (!WriteAll(fd, frame, len)) {
+                std::cerr << "Write to " << port << " failed\n";
+                return 1;
+            }
+            bytes += len;
+            sent++;
+            confirmed[seq++] = sent;
+            acks_pending += ack;
+            if (!started && (int)sent >= prefill) {
+                WriteAll(fd, (const uint8_t*)"Q;", 2);
+                started = true;
+            }
+        }
+        // Acks can be lost on the link, so don't wait on them forever
+        if (sent < n && sent >= window_end &&
+            (acks_pending == 0 || now - last_ack > std::chrono::milliseconds(200))) {
+            uint8_t frame[COMMAND_MAX_PAYLOAD + 3];
+            size_t len = CommandEncode(COMMAND_TRAJECTORY, seq, NULL, 0, frame);
+            WriteAll(fd, frame, len);
+            confirmed[seq++] = sent;
+            acks_pending++;
+            last_ack = now;
+        }
+
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 20) > 0) {
+            uint8_t buf[256];
+            ssize_t got = read(fd, buf, sizeof(buf));
+            for (ssize_t i = 0; i < got; i++) {
+                if (buf[i] != 0) {
+                    chunk.push_back(buf[i]);
+                    continue;
+                }
+                std::vector<uint8_t> frame(chunk);
+                size_t len = chunk.empty() ? 0 : TelemetryCobsDecode(frame.data(), frame.size());
+                TelemetryHeader header;
+                TelemetryTrajectoryAckPayload ack;
+                uint16_t crc = 0;
+                if (len >= 2) memcpy(&crc, frame.data() + len - 2, 2);
+                bool valid = len >= sizeof(header) + 2 && crc == TelemetryCrc16(frame.data(), len - 2);
+                if (valid && frame[0] == TELEMETRY_TRAJECTORY_ACK && len == sizeof(header) + sizeof(ack) + 2) {
+                    memcpy(&ack, frame.data() + sizeof(header), sizeof(ack));
+                    if (ack.status != COMMAND_OK) {
+                        std::cerr << "Frame with seq " << (int)ack.seq << " rejected (status "
+                                  << (int)ack.status << "), stopping\n";
+                        WriteAll(fd, (const uint8_t*)"S;", 2);
+                        return 1;
+                    }
+                    done = std::max<size_t>(done, confirmed[ack.seq]);
+                    window_end = std::max<size_t>(window_end, confirmed[ack.seq] + ack.free);
+                    acks_pending = std::max(0, acks_pending - 1);
+                    last_ack = now;
+                    play_t_ms = ack.play_t_ms;
+                    underruns = ack.underruns;
+                    free = ack.free;
+                    min_free = std::min(min_free, free);
+                } else if (!valid && !chunk.empty()) {
+                    // Console text
+                    fwrite(chunk.data(), 1, chunk.size(), stderr);
+                }
+                chunk.clear();
+            }
+        }
+
+        double s = std::chrono::duration<double>(now - last_report).count();
+        if (s >= 1.0) {
+            fprintf(stderr, "%.0f points/s, %.0f bytes/s, %d free, playing %ums, %u underruns\n",
+                    (sent - report_sent) / s, (bytes - report_bytes) / s, free, play_t_ms, underruns);
+            last_report = now;
+            report_sent = sent;
+            report_bytes = bytes;
+        }
+    }
+
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "Sent %zu points in %.1fs (%.0f points/s, %.0f bytes/s), lowest free %d, %u underruns\n",
+            n, s, n / s, bytes / s, min_free, underruns);
+    close(fd);
+    return 0;
+}